@@ -0,0 +1,198 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+#include "ConfigFile.h"
+#include "common.h"
+
+constexpr auto c_cacheHeader = "# wslgd config cache";
+
+namespace {
+
+std::string Trim(const char *start, const char *end)
+{
+    while ((start < end) && isspace(static_cast<unsigned char>(*start))) {
+        start++;
+    }
+
+    while ((end > start) && isspace(static_cast<unsigned char>(end[-1]))) {
+        end--;
+    }
+
+    return std::string(start, end);
+}
+
+std::string ToLower(std::string value)
+{
+    std::transform(value.begin(), value.end(), value.begin(), [](unsigned char c) { return tolower(c); });
+    return value;
+}
+
+}
+
+bool wslgd::ConfigFile::Load(const std::string& path, const char *cachePath)
+{
+    Clear();
+
+    // The source usually lives on a Windows drive where reading is slow, when it did not change
+    // since the last load the cached parse result is used after a single stat.
+    struct stat source;
+    if (stat(path.c_str(), &source) < 0) {
+        return false;
+    }
+
+    if (cachePath && LoadCache(cachePath, path, source)) {
+        return true;
+    }
+
+    std::string data;
+    if (!ReadFile(path.c_str(), data)) {
+        return false;
+    }
+
+    Parse(data.data(), data.size());
+    if (cachePath) {
+        try {
+            WriteCache(cachePath, path, source);
+        }
+        CATCH_LOG();
+    }
+
+    return true;
+}
+
+void wslgd::ConfigFile::Parse(const char *data, size_t size)
+{
+    const char *end = data + size;
+
+    // Skip a UTF-8 byte order mark, as written by some Windows editors.
+    if ((size >= 3) && (memcmp(data, "\xEF\xBB\xBF", 3) == 0)) {
+        data += 3;
+    }
+
+    Section *section = nullptr;
+    while (data < end) {
+        const char *lineEnd = static_cast<const char*>(memchr(data, '\n', end - data));
+        if (!lineEnd) {
+            lineEnd = end;
+        }
+
+        std::string line = Trim(data, lineEnd);
+        data = lineEnd + 1;
+        if (line.empty() || (line[0] == ';') || (line[0] == '#')) {
+            continue;
+        }
+
+        if (line[0] == '[') {
+            auto close = line.find(']');
+            section = (close == std::string::npos) ? nullptr :
+                &m_sections[ToLower(Trim(line.data() + 1, line.data() + close))];
+            continue;
+        }
+
+        auto equals = line.find('=');
+        if (!section || (equals == std::string::npos)) {
+            continue;
+        }
+
+        std::string key = Trim(line.data(), line.data() + equals);
+        std::string value = Trim(line.data() + equals + 1, line.data() + line.size());
+        auto found = std::find_if(section->begin(), section->end(), [&key](auto& entry) { return entry.first == key; });
+        if (found != section->end()) {
+            found->second = std::move(value);
+        } else if (!key.empty()) {
+            section->emplace_back(std::move(key), std::move(value));
+        }
+    }
+}
+
+const wslgd::ConfigFile::Section& wslgd::ConfigFile::GetSection(const std::string& name) const
+{
+    static const Section empty;
+    auto found = m_sections.find(ToLower(name));
+    return (found != m_sections.end()) ? found->second : empty;
+}
+
+const char *wslgd::ConfigFile::GetValue(const std::string& section, const std::string& key) const
+{
+    for (auto &entry : GetSection(section)) {
+        if (entry.first == key) {
+            return entry.second.c_str();
+        }
+    }
+
+    return nullptr;
+}
+
+bool wslgd::ConfigFile::ReadFile(const char *path, std::string& data)
+{
+    wil::unique_fd fd(open(path, (O_RDONLY | O_CLOEXEC)));
+    if (!fd) {
+        return false;
+    }
+
+    std::array<char, 4096> buffer;
+    ssize_t size;
+    while ((size = read(fd.get(), buffer.data(), buffer.size())) > 0) {
+        data.append(buffer.data(), size);
+    }
+
+    return size == 0;
+}
+
+std::string wslgd::ConfigFile::CacheHeader(const std::string& path, const struct stat& source)
+{
+    // The size and time alone match another file saved at the same moment, e.g. after the user
+    // profile changed, so the header also names the file. The path goes last as it may have spaces.
+    return std::string(c_cacheHeader) + " " +
+        std::to_string(source.st_dev) + " " +
+        std::to_string(source.st_ino) + " " +
+        std::to_string(source.st_size) + " " +
+        std::to_string(source.st_mtim.tv_sec) + " " +
+        std::to_string(source.st_mtim.tv_nsec) + " " +
+        path + "\n";
+}
+
+bool wslgd::ConfigFile::LoadCache(const char *cachePath, const std::string& path, const struct stat& source)
+{
+    // The cache is the parse result written back as INI, behind a header identifying its source.
+    std::string data;
+    if (!ReadFile(cachePath, data)) {
+        return false;
+    }
+
+    std::string header = CacheHeader(path, source);
+    if (data.compare(0, header.size(), header) != 0) {
+        return false;
+    }
+
+    Parse(data.data() + header.size(), data.size() - header.size());
+    return true;
+}
+
+void wslgd::ConfigFile::WriteCache(const char *cachePath, const std::string& path, const struct stat& source) const
+{
+    // A path with a newline would not round trip through the header line.
+    if (path.find('\n') != std::string::npos) {
+        return;
+    }
+
+    std::filesystem::path cacheFile(cachePath);
+    std::filesystem::create_directories(cacheFile.parent_path());
+    std::string temporaryPath = cacheFile.string() + ".tmp";
+    {
+        std::unique_ptr<FILE, decltype(&fclose)> file(fopen(temporaryPath.c_str(), "we"), fclose);
+        THROW_LAST_ERROR_IF(!file);
+        fputs(CacheHeader(path, source).c_str(), file.get());
+
+        for (auto &section : m_sections) {
+            fprintf(file.get(), "[%s]\n", section.first.c_str());
+            for (auto &entry : section.second) {
+                fprintf(file.get(), "%s=%s\n", entry.first.c_str(), entry.second.c_str());
+            }
+        }
+
+        THROW_LAST_ERROR_IF(fflush(file.get()) != 0);
+    }
+
+    // Replace the cache at once, a reader never sees a partial one.
+    THROW_LAST_ERROR_IF(rename(temporaryPath.c_str(), cachePath) < 0);
+}
@@ -0,0 +1,32 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+#pragma once
+#include "precomp.h"
+
+namespace wslgd
+{
+    // A parsed INI file such as .wslgconfig. Section names are case insensitive, keys are kept in
+    // file order and a repeated key takes the last value.
+    class ConfigFile
+    {
+    public:
+        using Section = std::vector<std::pair<std::string, std::string>>;
+
+        ConfigFile() = default;
+
+        bool Load(const std::string& path, const char *cachePath = nullptr);
+        void Parse(const char *data, size_t size);
+        void Clear() { m_sections.clear(); }
+
+        const Section& GetSection(const std::string& name) const;
+        const char *GetValue(const std::string& section, const std::string& key) const;
+
+    private:
+        bool LoadCache(const char *cachePath, const std::string& path, const struct stat& source);
+        void WriteCache(const char *cachePath, const std::string& path, const struct stat& source) const;
+        static std::string CacheHeader(const std::string& path, const struct stat& source);
+        static bool ReadFile(const char *path, std::string& data);
+
+        std::map<std::string, Section> m_sections{}; /* by lowercase section name */
+    };
+}
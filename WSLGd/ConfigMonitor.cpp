@@ -0,0 +1,116 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+#include "ConfigMonitor.h"
+#include "ConfigFile.h"
+#include "common.h"
+
+wslgd::ConfigMonitor::ConfigMonitor(EventLoop& loop, std::string&& path, const char *cachePath, const char *section) :
+    m_loop(loop), m_path(std::move(path)), m_cachePath(cachePath), m_section(section)
+{
+}
+
+std::set<std::string> wslgd::ConfigMonitor::Reload()
+{
+    std::set<std::string> changed;
+
+    // Nothing to do while the file keeps its size and modification time.
+    struct stat current{};
+    if (stat(m_path.c_str(), &current) < 0) {
+        current = {};
+    }
+
+    if (m_isLoaded &&
+        (current.st_size == m_stat.st_size) &&
+        (current.st_mtim.tv_sec == m_stat.st_mtim.tv_sec) &&
+        (current.st_mtim.tv_nsec == m_stat.st_mtim.tv_nsec)) {
+        return changed;
+    }
+
+    ConfigFile config;
+    config.Load(m_path, m_cachePath);
+    m_isLoaded = true;
+    m_stat = current;
+
+    std::map<std::string, std::string> env;
+    for (auto &entry : config.GetSection(m_section)) {
+        env[entry.first] = entry.second;
+    }
+
+    // Set new and changed keys, remembering what they replaced.
+    for (auto &entry : env) {
+        auto found = m_env.find(entry.first);
+        if ((found != m_env.end()) && (found->second == entry.second)) {
+            continue;
+        }
+
+        if (m_originalEnv.find(entry.first) == m_originalEnv.end()) {
+            auto original = getenv(entry.first.c_str());
+            m_originalEnv[entry.first] = original ? std::optional<std::string>(original) : std::nullopt;
+        }
+
+        setenv(entry.first.c_str(), entry.second.c_str(), true);
+        changed.insert(entry.first);
+    }
+
+    // Restore keys no longer in the file.
+    for (auto &entry : m_env) {
+        if (env.find(entry.first) != env.end()) {
+            continue;
+        }
+
+        auto& original = m_originalEnv[entry.first];
+        if (original) {
+            setenv(entry.first.c_str(), original->c_str(), true);
+        } else {
+            unsetenv(entry.first.c_str());
+        }
+
+        changed.insert(entry.first);
+    }
+
+    m_env = std::move(env);
+    if (!changed.empty() && m_onChanged) {
+        std::string keys;
+        for (auto &key : changed) {
+            keys += " " + key;
+        }
+
+        LOG_INFO("%s changed:%s", m_path.c_str(), keys.c_str());
+        m_onChanged(changed);
+    }
+
+    return changed;
+}
+
+void wslgd::ConfigMonitor::Start(uint64_t intervalMs, ChangeCallback&& onChanged)
+{
+    m_intervalMs = intervalMs;
+    m_onChanged = std::move(onChanged);
+    SchedulePoll();
+}
+
+void wslgd::ConfigMonitor::Stop()
+{
+    if (m_timer >= 0) {
+        m_loop.CancelTimer(m_timer);
+        m_timer = -1;
+    }
+
+    m_onChanged = nullptr;
+}
+
+void wslgd::ConfigMonitor::SchedulePoll()
+{
+    // N.B. inotify does not see changes made from Windows to a drvfs mount, the file is polled instead.
+    m_timer = m_loop.AddTimer(m_intervalMs, [this]() {
+        m_timer = -1;
+        try {
+            Reload();
+        }
+        CATCH_LOG();
+
+        if (m_onChanged) {
+            SchedulePoll();
+        }
+    });
+}
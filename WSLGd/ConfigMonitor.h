@@ -0,0 +1,40 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+#pragma once
+#include "precomp.h"
+#include "EventLoop.h"
+
+namespace wslgd
+{
+    // Applies the system-distro-env section of .wslgconfig to the environment and keeps it up to
+    // date, reporting which keys changed.
+    class ConfigMonitor
+    {
+    public:
+        using ChangeCallback = std::function<void(const std::set<std::string>& keys)>;
+
+        ConfigMonitor(EventLoop& loop, std::string&& path, const char *cachePath, const char *section);
+        ~ConfigMonitor() { Stop(); }
+        ConfigMonitor(const ConfigMonitor&) = delete;
+        void operator=(const ConfigMonitor&) = delete;
+
+        std::set<std::string> Reload();
+        void Start(uint64_t intervalMs, ChangeCallback&& onChanged);
+        void Stop();
+
+    private:
+        void SchedulePoll();
+
+        EventLoop& m_loop;
+        std::string m_path;
+        const char *m_cachePath;
+        const char *m_section;
+        bool m_isLoaded = false;
+        struct stat m_stat{}; /* of the config file when it was last loaded, zero if it did not exist */
+        std::map<std::string, std::string> m_env{}; /* as set from the config file */
+        std::map<std::string, std::optional<std::string>> m_originalEnv{}; /* before the config file set it */
+        uint64_t m_intervalMs = 0;
+        int m_timer = -1;
+        ChangeCallback m_onChanged;
+    };
+}
@@ -0,0 +1,207 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+#include "ControlServer.h"
+#include "common.h"
+
+constexpr size_t c_maxClients = 8;
+constexpr size_t c_maxRequest = 4096;
+constexpr uint64_t c_idleTimeoutMs = 10000;
+
+void wslgd::ControlServer::AddCommand(const char *name, const char *usage, Command&& command)
+{
+    m_commands[name] = CommandEntry{usage, std::move(command)};
+}
+
+void wslgd::ControlServer::Start(const char *path, uid_t uid, gid_t gid)
+{
+    wil::unique_fd socketFd{socket(AF_UNIX, (SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC), 0)};
+    THROW_LAST_ERROR_IF(!socketFd);
+
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    THROW_ERRNO_IF(ENAMETOOLONG, strlen(path) >= sizeof(address.sun_path));
+    strcpy(address.sun_path, path);
+    unlink(path);
+    THROW_LAST_ERROR_IF(bind(socketFd.get(), reinterpret_cast<const sockaddr*>(&address), sizeof(address)) < 0);
+    THROW_LAST_ERROR_IF(chown(path, 0, gid) < 0);
+    THROW_LAST_ERROR_IF(chmod(path, 0660) < 0);
+    THROW_LAST_ERROR_IF(listen(socketFd.get(), SOMAXCONN) < 0);
+
+    m_path = path;
+    m_uid = uid;
+    m_gid = gid;
+    m_listenFd = std::move(socketFd);
+    m_loop.AddFd(m_listenFd.get(), EPOLLIN, [this](uint32_t) { HandleAccept(); });
+
+    AddCommand("help", "help", [this](const std::vector<std::string>&, std::string& reply) {
+        for (auto &command : m_commands) {
+            reply += command.second.usage + "\n";
+        }
+    });
+}
+
+void wslgd::ControlServer::Stop()
+{
+    while (!m_clients.empty()) {
+        CloseClient(m_clients.begin()->first);
+    }
+
+    if (m_listenFd) {
+        m_loop.RemoveFd(m_listenFd.get());
+        m_listenFd.reset();
+        unlink(m_path.c_str());
+    }
+}
+
+void wslgd::ControlServer::HandleAccept()
+{
+    for (;;) {
+        wil::unique_fd clientFd(accept4(m_listenFd.get(), nullptr, nullptr, (SOCK_NONBLOCK | SOCK_CLOEXEC)));
+        if (!clientFd) {
+            break;
+        }
+
+        // The socket mode already limits who connects, the credentials are checked in case it changed.
+        struct ucred credentials;
+        socklen_t size = sizeof(credentials);
+        if (getsockopt(clientFd.get(), SOL_SOCKET, SO_PEERCRED, &credentials, &size) < 0) {
+            LOG_ERROR("getsockopt(SO_PEERCRED) failed, %s", strerror(errno));
+            continue;
+        }
+
+        if ((credentials.uid != 0) && (credentials.uid != m_uid) && (credentials.gid != m_gid)) {
+            LOG_ERROR("control client pid:%d uid:%u is not allowed", credentials.pid, credentials.uid);
+            continue;
+        }
+
+        if (m_clients.size() >= c_maxClients) {
+            LOG_ERROR("too many control clients, closing the new connection");
+            continue;
+        }
+
+        int fd = clientFd.get();
+        m_clients[fd].fd = std::move(clientFd);
+        m_loop.AddFd(fd, EPOLLIN, [this, fd](uint32_t) { HandleRequest(fd); });
+        ResetTimer(fd);
+    }
+}
+
+void wslgd::ControlServer::ResetTimer(int fd)
+{
+    // Clients are limited, one that connects and never finishes a request must not hold a slot.
+    auto& client = m_clients[fd];
+    if (client.timer >= 0) {
+        m_loop.CancelTimer(client.timer);
+    }
+
+    client.timer = m_loop.AddTimer(c_idleTimeoutMs, [this, fd]() {
+        auto found = m_clients.find(fd);
+        if (found != m_clients.end()) {
+            found->second.timer = -1;
+            CloseClient(fd);
+        }
+    });
+}
+
+void wslgd::ControlServer::HandleRequest(int fd)
+{
+    auto found = m_clients.find(fd);
+    if (found == m_clients.end()) {
+        return;
+    }
+
+    std::array<char, 1024> buffer;
+    auto size = read(fd, buffer.data(), buffer.size());
+    if ((size < 0) && ((errno == EAGAIN) || (errno == EINTR))) {
+        return;
+    }
+
+    if (size <= 0) {
+        CloseClient(fd);
+        return;
+    }
+
+    auto& request = found->second.request;
+    request.append(buffer.data(), size);
+    size_t newline;
+    while ((newline = request.find('\n')) != std::string::npos) {
+        auto reply = Execute(request.substr(0, newline));
+        request.erase(0, newline + 1);
+
+        // Replies are small, a client that does not read them is dropped.
+        if (send(fd, reply.data(), reply.size(), MSG_NOSIGNAL) != static_cast<ssize_t>(reply.size())) {
+            CloseClient(fd);
+            return;
+        }
+    }
+
+    if (request.size() > c_maxRequest) {
+        CloseClient(fd);
+        return;
+    }
+
+    ResetTimer(fd);
+}
+
+std::string wslgd::ControlServer::Execute(const std::string& line)
+{
+    std::vector<std::string> args;
+    for (size_t start = 0; start < line.size();) {
+        size_t end = line.find_first_of(" \t\r", start);
+        if (end == std::string::npos) {
+            end = line.size();
+        }
+
+        if (end > start) {
+            args.emplace_back(line, start, end - start);
+        }
+
+        start = end + 1;
+    }
+
+    if (args.empty()) {
+        return "";
+    }
+
+    std::string reply;
+    auto found = m_commands.find(args[0]);
+    if (found == m_commands.end()) {
+        return "ERROR unknown command " + args[0] + ", try help\n";
+    }
+
+    LOG_INFO("control: %s", line.c_str());
+    try {
+        found->second.command(args, reply);
+    }
+    catch (const wil::ResultException& e) {
+        LOG_CAUGHT_EXCEPTION();
+        reply += "ERROR ";
+        reply += strerror(e.GetErrorCode());
+        if (e.GetErrorCode() == EINVAL) {
+            reply += ", usage: " + found->second.usage;
+        }
+
+        return reply + "\n";
+    }
+    catch (...) {
+        LOG_CAUGHT_EXCEPTION();
+        return reply + "ERROR unexpected failure\n";
+    }
+
+    return reply + "OK\n";
+}
+
+void wslgd::ControlServer::CloseClient(int fd)
+{
+    auto found = m_clients.find(fd);
+    if (found == m_clients.end()) {
+        return;
+    }
+
+    if (found->second.timer >= 0) {
+        m_loop.CancelTimer(found->second.timer);
+    }
+
+    m_loop.RemoveFd(fd);
+    m_clients.erase(found);
+}
@@ -0,0 +1,55 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+#pragma once
+#include "precomp.h"
+#include "EventLoop.h"
+
+namespace wslgd
+{
+    // A line based control protocol on a Unix socket. Each request is a command followed by its
+    // arguments, separated by spaces. The reply is any number of lines followed by "OK" or
+    // "ERROR <reason>", e.g. echo "restart pulseaudio" | socat - UNIX-CONNECT:/mnt/wslg/wslgd-control.sock
+    // Only root and the given user or group may connect, and idle clients are dropped.
+    class ControlServer
+    {
+    public:
+        using Command = std::function<void(const std::vector<std::string>& args, std::string& reply)>;
+
+        ControlServer(EventLoop& loop) : m_loop(loop) {}
+        ~ControlServer() { Stop(); }
+        ControlServer(const ControlServer&) = delete;
+        void operator=(const ControlServer&) = delete;
+
+        void AddCommand(const char *name, const char *usage, Command&& command);
+        void Start(const char *path, uid_t uid, gid_t gid);
+        void Stop();
+
+    private:
+        struct CommandEntry
+        {
+            std::string usage;
+            Command command;
+        };
+
+        struct Client
+        {
+            wil::unique_fd fd;
+            std::string request; /* received data after the last complete line */
+            int timer = -1; /* closes clients that stay idle */
+        };
+
+        void HandleAccept();
+        void HandleRequest(int fd);
+        void ResetTimer(int fd);
+        std::string Execute(const std::string& line);
+        void CloseClient(int fd);
+
+        EventLoop& m_loop;
+        std::string m_path;
+        wil::unique_fd m_listenFd;
+        uid_t m_uid = 0;
+        gid_t m_gid = 0;
+        std::map<std::string, CommandEntry> m_commands{};
+        std::map<int, Client> m_clients{};
+    };
+}
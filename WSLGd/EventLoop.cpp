@@ -0,0 +1,131 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+#include "EventLoop.h"
+#include "common.h"
+
+wslgd::EventLoop::EventLoop()
+{
+    m_epollFd.reset(epoll_create1(EPOLL_CLOEXEC));
+    THROW_LAST_ERROR_IF(!m_epollFd);
+    sigemptyset(&m_signalMask);
+}
+
+void wslgd::EventLoop::AddFd(int fd, uint32_t events, std::function<void(uint32_t)>&& callback)
+{
+    THROW_ERRNO_IF(EEXIST, m_handlers.find(fd) != m_handlers.end());
+
+    std::unique_ptr<Handler> handler(new Handler{});
+    handler->callback = std::move(callback);
+
+    struct epoll_event event = {};
+    event.events = events;
+    event.data.ptr = handler.get();
+    THROW_LAST_ERROR_IF(epoll_ctl(m_epollFd.get(), EPOLL_CTL_ADD, fd, &event) < 0);
+
+    m_handlers[fd] = std::move(handler);
+}
+
+void wslgd::EventLoop::RemoveFd(int fd)
+{
+    auto found = m_handlers.find(fd);
+    if (found == m_handlers.end()) {
+        return;
+    }
+
+    epoll_ctl(m_epollFd.get(), EPOLL_CTL_DEL, fd, nullptr);
+
+    // Events for this handler may still be pending in the current batch.
+    found->second->isRemoved = true;
+    m_removedHandlers.push_back(std::move(found->second));
+    m_handlers.erase(found);
+}
+
+int wslgd::EventLoop::AddTimer(uint64_t delayMs, std::function<void()>&& callback)
+{
+    wil::unique_fd timerFd(timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC));
+    THROW_LAST_ERROR_IF(!timerFd);
+
+    struct itimerspec timeout = {};
+    timeout.it_value.tv_sec = delayMs / 1000;
+    timeout.it_value.tv_nsec = (delayMs % 1000) * 1000000;
+    if (!delayMs) {
+        timeout.it_value.tv_nsec = 1; /* a zero value would disarm the timer */
+    }
+
+    THROW_LAST_ERROR_IF(timerfd_settime(timerFd.get(), 0, &timeout, nullptr) < 0);
+
+    // Timers fire once and are removed before their callback runs.
+    int timerId = timerFd.get();
+    AddFd(timerId, EPOLLIN, [this, timerId, callback = std::move(callback)](uint32_t) mutable {
+        auto timerCallback = std::move(callback);
+        CancelTimer(timerId);
+        timerCallback();
+    });
+
+    m_handlers[timerId]->ownedFd = std::move(timerFd);
+    return timerId;
+}
+
+void wslgd::EventLoop::CancelTimer(int timerId)
+{
+    RemoveFd(timerId);
+}
+
+void wslgd::EventLoop::AddSignal(int signal, std::function<void(const signalfd_siginfo&)>&& callback)
+{
+    // The signal is only delivered through the signalfd from now on.
+    sigaddset(&m_signalMask, signal);
+    THROW_LAST_ERROR_IF(sigprocmask(SIG_BLOCK, &m_signalMask, nullptr) < 0);
+
+    int signalFd = signalfd(m_signalFd ? m_signalFd.get() : -1, &m_signalMask, SFD_NONBLOCK | SFD_CLOEXEC);
+    THROW_LAST_ERROR_IF(signalFd < 0);
+    if (!m_signalFd) {
+        m_signalFd.reset(signalFd);
+        AddFd(signalFd, EPOLLIN, [this](uint32_t) { HandleSignals(); });
+    }
+
+    m_signalHandlers[signal] = std::move(callback);
+}
+
+void wslgd::EventLoop::HandleSignals()
+{
+    signalfd_siginfo info;
+    while (read(m_signalFd.get(), &info, sizeof(info)) == sizeof(info)) {
+        auto found = m_signalHandlers.find(info.ssi_signo);
+        if (found != m_signalHandlers.end()) {
+            found->second(info);
+        }
+    }
+}
+
+int wslgd::EventLoop::Run()
+{
+    std::array<struct epoll_event, 16> events;
+
+    m_isRunning = true;
+    while (m_isRunning) {
+        int count = epoll_wait(m_epollFd.get(), events.data(), events.size(), -1);
+        if (count < 0) {
+            THROW_LAST_ERROR_IF(errno != EINTR);
+            continue;
+        }
+
+        for (int i = 0; i < count; i++) {
+            auto handler = reinterpret_cast<Handler*>(events[i].data.ptr);
+            if (!handler->isRemoved) try {
+                handler->callback(events[i].events);
+            }
+            CATCH_LOG();
+        }
+
+        m_removedHandlers.clear();
+    }
+
+    return m_exitCode;
+}
+
+void wslgd::EventLoop::Stop(int exitCode)
+{
+    m_exitCode = exitCode;
+    m_isRunning = false;
+}
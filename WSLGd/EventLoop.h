@@ -0,0 +1,45 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+#pragma once
+#include "precomp.h"
+
+namespace wslgd
+{
+    class EventLoop
+    {
+    public:
+        EventLoop();
+        EventLoop(const EventLoop&) = delete;
+        void operator=(const EventLoop&) = delete;
+
+        void AddFd(int fd, uint32_t events, std::function<void(uint32_t)>&& callback);
+        void RemoveFd(int fd);
+
+        int AddTimer(uint64_t delayMs, std::function<void()>&& callback);
+        void CancelTimer(int timerId);
+
+        void AddSignal(int signal, std::function<void(const signalfd_siginfo&)>&& callback);
+
+        int Run();
+        void Stop(int exitCode);
+
+    private:
+        struct Handler
+        {
+            wil::unique_fd ownedFd; /* closed with the handler, e.g. a timerfd */
+            std::function<void(uint32_t)> callback;
+            bool isRemoved = false;
+        };
+
+        void HandleSignals();
+
+        wil::unique_fd m_epollFd;
+        std::map<int, std::unique_ptr<Handler>> m_handlers{};
+        std::vector<std::unique_ptr<Handler>> m_removedHandlers{}; /* kept alive until the current dispatch completes */
+        wil::unique_fd m_signalFd;
+        sigset_t m_signalMask;
+        std::map<int, std::function<void(const signalfd_siginfo&)>> m_signalHandlers{};
+        bool m_isRunning = false;
+        int m_exitCode = 0;
+    };
+}
@@ -0,0 +1,176 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+#include "FontCache.h"
+#include "common.h"
+#include "MetricsServer.h"
+
+constexpr auto c_fcCache = "/usr/bin/fc-cache";
+
+// The font folders config/local.conf adds to fontconfig.
+constexpr const char *c_cachedPaths[] = {
+    USER_DISTRO_MOUNT_PATH "/usr/share/fonts",
+    USER_DISTRO_MOUNT_PATH "/usr/local/share/fonts",
+};
+
+// Font files fontconfig reads, any change to them makes the folder's cache stale.
+constexpr const char *c_fontExtensions[] = {
+    ".ttf", ".ttc", ".otf", ".otc", ".pfa", ".pfb", ".pcf", ".pcf.gz", ".bdf", ".bdf.gz", ".woff", ".woff2",
+};
+
+// A package installs many fonts in a row, fc-cache runs once they stop coming.
+constexpr uint64_t c_fontCacheDebounceMs = 2000;
+
+wslgd::FontCache::FontCache(EventLoop& loop, ProcessMonitor& monitor) : m_loop(loop), m_monitor(monitor)
+{
+}
+
+bool wslgd::FontCache::IsFontFile(const char *name)
+{
+    size_t length = strlen(name);
+    for (auto extension : c_fontExtensions) {
+        size_t extensionLength = strlen(extension);
+        if ((length > extensionLength) && (strcasecmp(name + length - extensionLength, extension) == 0)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool wslgd::FontCache::IsCachedPath(const std::string& path)
+{
+    for (auto cachedPath : c_cachedPaths) {
+        size_t length = strlen(cachedPath);
+        if ((path.compare(0, length, cachedPath) == 0) && ((path.size() == length) || (path[length] == '/'))) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void wslgd::FontCache::Start()
+{
+    if (m_isStarted) {
+        return;
+    }
+
+    if (access(c_fcCache, X_OK) < 0) {
+        LOG_INFO("FontCache: %s is not available, fontconfig caches are left to apps", c_fcCache);
+        return;
+    }
+
+    // fc-cache only rescans folders changed since their cache was written, the rest costs a stat.
+    m_isStarted = true;
+    for (auto cachedPath : c_cachedPaths) {
+        m_pending.insert(cachedPath);
+    }
+
+    Schedule(c_fontCacheDebounceMs);
+}
+
+void wslgd::FontCache::Stop()
+{
+    if (m_timer >= 0) {
+        m_loop.CancelTimer(m_timer);
+        m_timer = -1;
+    }
+
+    // The caches are written atomically, so a run cut short leaves nothing half written.
+    if (m_pid > 0) {
+        m_monitor.StopHelper(m_pid);
+        m_pid = -1;
+    }
+
+    m_pending.clear();
+    m_isStarted = false;
+}
+
+void wslgd::FontCache::Invalidate(const std::string& path)
+{
+    if (!m_isStarted || !IsCachedPath(path)) {
+        return;
+    }
+
+    m_pending.insert(path);
+    Schedule(c_fontCacheDebounceMs);
+}
+
+void wslgd::FontCache::Schedule(uint64_t delayMs)
+{
+    if (m_timer >= 0) {
+        m_loop.CancelTimer(m_timer);
+    }
+
+    m_timer = m_loop.AddTimer(delayMs, [this]() {
+        m_timer = -1;
+        Run();
+    });
+}
+
+void wslgd::FontCache::Run()
+{
+    // One run at a time, changes seen meanwhile wait for the next one.
+    if (m_pid > 0) {
+        return;
+    }
+
+    // A folder also rescans its subfolders, so those are not passed again.
+    std::vector<std::string> paths;
+    for (auto &path : m_pending) {
+        if (!paths.empty() && (path.compare(0, paths.back().size(), paths.back()) == 0) && (path[paths.back().size()] == '/')) {
+            continue;
+        }
+
+        std::error_code error;
+        if (std::filesystem::is_directory(path, error)) {
+            paths.push_back(path);
+        }
+    }
+
+    m_pending.clear();
+    if (paths.empty()) {
+        return;
+    }
+
+    std::vector<std::string> argv{c_fcCache};
+    argv.insert(argv.end(), paths.begin(), paths.end());
+
+    // Idle CPU and I/O priority, the cache is only built when nothing else needs the machine.
+    try {
+        m_pid = m_monitor.LaunchHelper(std::move(argv), true, [this](int status) { HandleExit(status); });
+        m_runCount++;
+        m_folderCount += paths.size();
+        LOG_INFO("FontCache: pid:%d updating fontconfig caches of %zu folders", m_pid, paths.size());
+    }
+    CATCH_LOG();
+}
+
+void wslgd::FontCache::HandleExit(int status)
+{
+    LOG_INFO("FontCache: pid:%d exited with %s", m_pid,
+        (WIFEXITED(status) && (WEXITSTATUS(status) == 0)) ? "success" : "fail");
+
+    m_pid = -1;
+    if (!m_pending.empty()) {
+        Schedule(c_fontCacheDebounceMs);
+    }
+}
+
+void wslgd::FontCache::WriteMetrics(std::string& out) const
+{
+    MetricsServer::Describe(out, "wslgd_fontconfig_cache_runs_total", "counter", "fc-cache runs for the user distro's font folders.");
+    MetricsServer::Add(out, "wslgd_fontconfig_cache_runs_total", "", m_runCount);
+    MetricsServer::Describe(out, "wslgd_fontconfig_cache_folders_total", "counter", "Font folders passed to those runs.");
+    MetricsServer::Add(out, "wslgd_fontconfig_cache_folders_total", "", m_folderCount);
+}
+
+void wslgd::FontCache::DumpState(std::string& out) const
+{
+    out += std::string("fontconfig cache ") + (m_isStarted ? "active" : "inactive");
+    if (m_pid > 0) {
+        out += ", fc-cache pid " + std::to_string(m_pid);
+    }
+
+    out += ", " + std::to_string(m_pending.size()) + " folders pending\n";
+}
@@ -0,0 +1,47 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+#pragma once
+#include "precomp.h"
+#include "EventLoop.h"
+#include "ProcessMonitor.h"
+
+namespace wslgd
+{
+    // Keeps the fontconfig caches of the system distro current for the user distro's font folders
+    // added by /etc/fonts/local.conf, so the first app of a session does not scan the shared folders
+    // itself. fc-cache runs in the background at idle priority, on the whole folders once started
+    // and then only on the folders that changed.
+    class FontCache
+    {
+    public:
+        FontCache(EventLoop& loop, ProcessMonitor& monitor);
+        ~FontCache() { Stop(); }
+
+        FontCache(const FontCache&) = delete;
+        void operator=(const FontCache&) = delete;
+
+        static bool IsFontFile(const char *name);
+        static bool IsCachedPath(const std::string& path);
+
+        void Start();
+        void Stop();
+        void Invalidate(const std::string& path);
+
+        void WriteMetrics(std::string& out) const;
+        void DumpState(std::string& out) const;
+
+    private:
+        void Schedule(uint64_t delayMs);
+        void Run();
+        void HandleExit(int status);
+
+        EventLoop& m_loop;
+        ProcessMonitor& m_monitor;
+        bool m_isStarted = false;
+        std::set<std::string> m_pending{}; /* folders to rescan on the next run */
+        int m_timer = -1; /* starts the next run once changes stop coming */
+        int m_pid = -1; /* running fc-cache */
+        uint64_t m_runCount = 0;
+        uint64_t m_folderCount = 0; /* folders passed to those runs */
+    };
+}
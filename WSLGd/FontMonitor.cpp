@@ -2,6 +2,8 @@
 // Licensed under the MIT license.
 #include "FontMonitor.h"
 #include "common.h"
+#include "Trace.h"
+#include "MetricsServer.h"
 
 #define DEFAULT_FONT_PATH "/usr/share/fonts"
 #define USER_DISTRO_FONT_PATH USER_DISTRO_MOUNT_PATH DEFAULT_FONT_PATH
@@ -9,21 +11,46 @@
 #define ALT_DISTRO_FONT_PATH USER_DISTRO_MOUNT_PATH ALT_FONT_PATH
 
 constexpr auto c_fontsdir = "fonts.dir";
-constexpr auto c_xset = "/usr/bin/xset";
+constexpr auto c_fontsalias = "fonts.alias";
+
+// Font path changes are applied once folder events stop for the debounce window, so installing a
+// font package changes the font path once, but never later than the maximum delay.
+constexpr uint64_t c_fontPathDebounceMs = 500;
+constexpr uint64_t c_fontPathMaxDelayMs = 5000;
+
+// Reconnection attempts after the X server went away, e.g. weston restarted.
+constexpr uint64_t c_reconnectInitialDelayMs = 1000;
+constexpr uint64_t c_reconnectMaxDelayMs = 30000;
+
+// Changes fanotify reports for the whole filesystem, the values match their inotify counterparts.
+constexpr uint64_t c_fanotifyMask = FAN_CREATE | FAN_DELETE | FAN_MOVED_FROM | FAN_MOVED_TO | FAN_CLOSE_WRITE | FAN_ONDIR;
+static_assert((FAN_CREATE == IN_CREATE) && (FAN_DELETE == IN_DELETE) && (FAN_MOVED_FROM == IN_MOVED_FROM) &&
+              (FAN_MOVED_TO == IN_MOVED_TO) && (FAN_CLOSE_WRITE == IN_CLOSE_WRITE));
+
+static uint64_t GetFsidKey(const void *fsid)
+{
+    uint64_t key;
+    memcpy(&key, fsid, sizeof(key));
+    return key;
+}
+
+static uint64_t GetTimeMs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (static_cast<uint64_t>(ts.tv_sec) * 1000) + (ts.tv_nsec / 1000000);
+}
 
 wslgd::FontFolder::FontFolder(int fd, const char *path)
 {
     LOG_INFO("FontMonitor: start monitoring %s", path);
 
     m_path = path;
+    if (fd < 0) {
+        return;
+    }
 
-    /* check if folder is already ready to be added to font path */
     try {
-        std::filesystem::path fonts_dir(path);
-        fonts_dir /= c_fontsdir;
-        if (access(fonts_dir.c_str(), R_OK) == 0) {
-            ModifyX11FontPath(true);
-        }
         m_fd.reset(dup(fd));
         THROW_LAST_ERROR_IF(!m_fd);
         /* add watch for install or uninstall of fonts on this folder */
@@ -36,8 +63,6 @@ wslgd::FontFolder::~FontFolder()
 {
     LOG_INFO("FontMonitor: stop monitoring %s", m_path.c_str());
 
-    ModifyX11FontPath(false);
-
     /* if still under watch, remove it */
     if (m_wd >= 0) {
         inotify_rm_watch(m_fd.get(), m_wd);
@@ -45,77 +70,17 @@ wslgd::FontFolder::~FontFolder()
     }
 }
 
-bool wslgd::FontFolder::ExecuteShellCommand(std::vector<const char*>&& argv)
+bool wslgd::FontFolder::HasFontsDir() const
 {
-    bool success = false;
-    int childPid = -1, waitPid = -1;
-    std::string cmd;
-
-    try {
-        THROW_LAST_ERROR_IF((childPid = fork()) < 0);
-        if (childPid == 0) {
-            /* move this process to own process group to avoid interfere with Process Monitor */
-            THROW_LAST_ERROR_IF(setpgid(0, 0) < 0);
-            THROW_LAST_ERROR_IF(execvp(argv[0], const_cast<char *const *>(argv.data())) < 0);
-        } else if (childPid > 0) {
-            /* move child to own process group to avoid interfere with Process Monitor */
-            THROW_LAST_ERROR_IF(setpgid(childPid, childPid) < 0);
-        }
-    }
-    CATCH_LOG();
-
-    // Ensure that the child process exits.
-    if (childPid == 0) {
-        _exit(1);
-    }
-
-    if (childPid > 0) try {
-        int status;
-        THROW_LAST_ERROR_IF((waitPid = waitpid(childPid, &status, 0)) < 0);
-        if (WIFEXITED(status)) {
-            success = (WEXITSTATUS(status) == 0);
-        }
-    }
-    CATCH_LOG();
-
-    try {
-        for (std::vector<const char *>::iterator it = argv.begin(); *it != nullptr; it++) {
-            cmd += *it;
-            cmd += " ";
-        }
-        LOG_INFO("FontMonitor: pid:%d exited with %s, %s",
-            waitPid, success ? "success" : "fail", cmd.c_str());
-    }
-    CATCH_LOG();
-
-    return success;
+    std::filesystem::path fonts_dir(m_path);
+    fonts_dir /= c_fontsdir;
+    return access(fonts_dir.c_str(), R_OK) == 0;
 }
 
-void wslgd::FontFolder::ModifyX11FontPath(bool isAdd)
-{
-    std::vector<const char*> argv;
-    sleep(2); /* workaround for optional fonts.alias, wait 2 sec before invoking xset */
-    if (m_isPathAdded != isAdd) try {
-        argv.push_back(c_xset);
-        argv.push_back(isAdd ? "+fp" : "-fp");
-        argv.push_back(m_path.c_str());
-        argv.push_back(nullptr);
-        if (ExecuteShellCommand(std::move(argv))) {
-            m_isPathAdded = isAdd;
-            /* let X server reread font database */
-            argv.clear();
-            argv.push_back(c_xset);
-            argv.push_back("fp");
-            argv.push_back("rehash");
-            argv.push_back(nullptr);
-            ExecuteShellCommand(std::move(argv));
-        }
-    }
-    CATCH_LOG();
-}
-
-wslgd::FontMonitor::FontMonitor()
+wslgd::FontMonitor::FontMonitor(EventLoop& loop, ProcessMonitor& monitor) :
+    m_loop(loop), m_fontPath(loop, monitor), m_fontCache(loop, monitor)
 {
+    m_fontPath.SetDisconnectCallback([this]() { HandleX11Disconnect(); });
 }
 
 void wslgd::FontMonitor::DumpMonitorFolders()
@@ -135,9 +100,17 @@ void wslgd::FontMonitor::AddMonitorFolder(const char *path)
         std::string monitorPath(path);
         // checkf if path is tracked already.
         if (m_fontMonitorFolders.find(monitorPath) == m_fontMonitorFolders.end()) {
-            std::unique_ptr<FontFolder> fontFolder(new FontFolder(m_fd.get(), path));
-            if (fontFolder.get()->GetWd() >= 0) {
-                m_fontMonitorFolders.insert(std::make_pair(std::move(monitorPath), std::move(fontFolder)));
+            std::unique_ptr<FontFolder> fontFolder(new FontFolder(m_isFanotify ? -1 : m_fd.get(), path));
+            if (m_isFanotify || (fontFolder.get()->GetWd() >= 0)) {
+                if (fontFolder->GetWd() >= 0) {
+                    m_foldersByWd[fontFolder->GetWd()] = fontFolder.get();
+                }
+                m_fontMonitorFolders.insert(std::make_pair(monitorPath, std::move(fontFolder)));
+                m_folderAddCount++;
+                // check if folder is already ready to be added to font path.
+                if (m_isX11Ready) {
+                    ScheduleFontPathUpdate(monitorPath, true);
+                }
                 // If this is mount path, only track under X11 folder if it's already exist.
                 if (strcmp(path, USER_DISTRO_FONT_PATH) == 0) {
                     if (std::filesystem::exists(USER_DISTRO_FONT_PATH "/X11")) {
@@ -165,110 +138,444 @@ void wslgd::FontMonitor::RemoveMonitorFolder(const char *path)
 
     try {
         std::string monitorPath(path);
-        m_fontMonitorFolders.erase(monitorPath);
+        auto found = m_fontMonitorFolders.find(monitorPath);
+        if (found != m_fontMonitorFolders.end()) {
+            if (found->second->IsPathAdded()) {
+                ScheduleFontPathUpdate(monitorPath, false);
+            }
+
+            auto indexed = m_foldersByWd.find(found->second->GetWd());
+            if ((indexed != m_foldersByWd.end()) && (indexed->second == found->second.get())) {
+                m_foldersByWd.erase(indexed);
+            }
+
+            m_fontMonitorFolders.erase(found);
+            m_folderRemoveCount++;
+        }
     }
     CATCH_LOG();
 }
 
-void wslgd::FontMonitor::HandleFolderEvent(struct inotify_event *event)
+void wslgd::FontMonitor::RescanMonitorFolders()
 {
+    // Events were lost, so the trees are walked again as on Scan, folders gone are dropped, new
+    // ones are tracked and every fonts.dir is checked again.
+    LOG_INFO("FontMonitor: rescanning font folders");
+    std::vector<std::string> removed;
+    for (auto &folder : m_fontMonitorFolders) {
+        std::error_code error;
+        if (!std::filesystem::is_directory(folder.first, error)) {
+            removed.push_back(folder.first);
+        }
+    }
+
+    for (auto &path : removed) {
+        RemoveMonitorFolder(path.c_str());
+    }
+
+    for (auto &path : m_rootPaths) {
+        m_fontCache.Invalidate(path);
+        RescanMonitorFolder(path);
+    }
+}
+
+void wslgd::FontMonitor::RescanMonitorFolder(const std::string& path)
+{
+    if (m_fontMonitorFolders.find(path) == m_fontMonitorFolders.end()) {
+        AddMonitorFolder(path.c_str());
+        return;
+    }
+
+    ScheduleFontPathUpdate(path, true);
     try {
-        std::map<std::string, std::unique_ptr<FontFolder>>::iterator it;
-        for (it = m_fontMonitorFolders.begin(); it != m_fontMonitorFolders.end(); it++) {
-            if (event->wd == it->second->GetWd()) {
-                if (event->mask & (IN_CREATE|IN_MOVED_TO)) {
-                    bool addMonitorFolder = true;
-                    std::filesystem::path fullPath(it->second->GetPath());
-                    if (fullPath.compare(USER_DISTRO_FONT_PATH) == 0) {
-                        /* Immediately under mount folder, only monitor "X11" and its subfolder */
-                        addMonitorFolder = (strcmp(event->name, "X11") == 0);
-                    }
-                    if (addMonitorFolder) {
-                        fullPath /= event->name;
-                        AddMonitorFolder(fullPath.c_str());
-                    }
-                } else if (event->mask & (IN_DELETE|IN_MOVED_FROM)) {
-                    std::filesystem::path fullPath(it->second->GetPath());
-                    fullPath /= event->name;
-                    RemoveMonitorFolder(fullPath.c_str());
+        // Only X11 is tracked under the mount path, as in AddMonitorFolder.
+        if (path == USER_DISTRO_FONT_PATH) {
+            if (std::filesystem::exists(USER_DISTRO_FONT_PATH "/X11")) {
+                RescanMonitorFolder(USER_DISTRO_FONT_PATH "/X11");
+            }
+        } else {
+            for (auto& dir_entry : std::filesystem::directory_iterator{path}) {
+                if (dir_entry.is_directory()) {
+                    RescanMonitorFolder(dir_entry.path());
                 }
-                break;
             }
         }
     }
     CATCH_LOG();
 }
 
-void wslgd::FontMonitor::HandleFontsDirEvent(struct inotify_event *event)
+wslgd::FontFolder* wslgd::FontMonitor::FindFolder(int wd) const
+{
+    auto found = m_foldersByWd.find(wd);
+    return (found != m_foldersByWd.end()) ? found->second : nullptr;
+}
+
+void wslgd::FontMonitor::HandleFolderEvent(FontFolder& folder, uint32_t mask, const char *name)
 {
     try {
-        std::map<std::string, std::unique_ptr<FontFolder>>::iterator it;
-        for (it = m_fontMonitorFolders.begin(); it != m_fontMonitorFolders.end(); it++) {
-            if (event->wd == it->second->GetWd()) {
-                if (event->mask & (IN_CREATE|IN_CLOSE_WRITE|IN_MOVED_TO)) {
-                    std::filesystem::path fonts_dir(it->second->GetPath());
-                    fonts_dir /= event->name;
-                    THROW_LAST_ERROR_IF(access(fonts_dir.c_str(), R_OK) != 0);
-                    it->second->ModifyX11FontPath(true);
-                } else if (event->mask & (IN_DELETE|IN_MOVED_FROM)) {
-                    it->second->ModifyX11FontPath(false);
-                }
-                break;
+        std::filesystem::path fullPath(folder.GetPath());
+        fullPath /= name;
+
+        // fanotify merges events on the same name, then whether the folder is there now decides.
+        bool isCreated = (mask & (IN_CREATE|IN_MOVED_TO)) &&
+            (!(mask & (IN_DELETE|IN_MOVED_FROM)) || std::filesystem::is_directory(fullPath));
+
+        if (isCreated) {
+            bool addMonitorFolder = true;
+            if (strcmp(folder.GetPath(), USER_DISTRO_FONT_PATH) == 0) {
+                /* Immediately under mount folder, only monitor "X11" and its subfolder */
+                addMonitorFolder = (strcmp(name, "X11") == 0);
             }
+            if (addMonitorFolder) {
+                AddMonitorFolder(fullPath.c_str());
+            }
+        } else if (mask & (IN_DELETE|IN_MOVED_FROM)) {
+            RemoveMonitorFolder(fullPath.c_str());
+        }
+    }
+    CATCH_LOG();
+}
+
+void wslgd::FontMonitor::HandleFontsDirEvent(FontFolder& folder, uint32_t mask, const char *name)
+{
+    try {
+        // A created file is only used once it is closed, so a half written fonts.dir is never read.
+        // fanotify may merge the create with the close, then the close wins.
+        if (mask & (IN_CLOSE_WRITE|IN_MOVED_TO)) {
+            folder.SetWriting(false);
+            ScheduleFontPathUpdate(folder.GetPath(), true);
+        } else if (mask & IN_CREATE) {
+            folder.SetWriting(true);
+            ScheduleFontPathUpdate(folder.GetPath(), true);
+        } else if (mask & (IN_DELETE|IN_MOVED_FROM)) {
+            // Without fonts.alias the folder only needs a rehash, without fonts.dir it is removed.
+            ScheduleFontPathUpdate(folder.GetPath(), strcmp(name, c_fontsdir) != 0);
         }
     }
     CATCH_LOG();
 }
-        
-void* wslgd::FontMonitor::FontMonitorThread(void *context)
+
+void wslgd::FontMonitor::HandleEvents()
+{
+    if (m_isFanotify) {
+        HandleFanotifyEvents();
+    } else {
+        HandleInotifyEvents();
+    }
+}
+
+void wslgd::FontMonitor::HandleInotifyEvents()
 {
-    FontMonitor *This = reinterpret_cast<FontMonitor*>(context);
     struct inotify_event *event;
     int len, cur;
     char buf[10 * (sizeof *event + 256)];
 
-    LOG_INFO("FontMonitor: monitoring thread started.");
-
-    pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL);
-    pthread_setcanceltype(PTHREAD_CANCEL_DEFERRED, NULL);
-
-    // Dump currently tracking folders.
-    This->DumpMonitorFolders();
-
-    // Start listening folder add/remove.
-    for (;;) {
-        len = read(This->GetFd(), buf, sizeof buf);
+    // Drain folder add/remove events.
+    while ((len = read(GetFd(), buf, sizeof buf)) > 0) {
         cur = 0;
         while (cur < len) {
             event = (struct inotify_event *)&buf[cur];
-            if (event->len) {
+            m_eventCount++;
+            if (event->mask & IN_Q_OVERFLOW) {
+                LOG_ERROR("FontMonitor: inotify queue overflowed");
+                RescanMonitorFolders();
+                cur += (sizeof *event + event->len);
+                continue;
+            }
+
+            FontFolder *folder = event->len ? FindFolder(event->wd) : nullptr;
+            if (folder) {
                 if (event->mask & IN_ISDIR) {
                     // A directory is added or removed.
-                    This->HandleFolderEvent(event);
-                } else if (strcmp(event->name, c_fontsdir) == 0) {
-                    // A fonts.dir is added or removed.
-                    This->HandleFontsDirEvent(event);
+                    m_fontCache.Invalidate(folder->GetPath());
+                    HandleFolderEvent(*folder, event->mask, event->name);
+                } else if ((strcmp(event->name, c_fontsdir) == 0) || (strcmp(event->name, c_fontsalias) == 0)) {
+                    // A fonts.dir or fonts.alias is written or removed.
+                    m_fontCache.Invalidate(folder->GetPath());
+                    HandleFontsDirEvent(*folder, event->mask, event->name);
+                } else if (FontCache::IsFontFile(event->name)) {
+                    m_fontCache.Invalidate(folder->GetPath());
                 }
             }
             cur += (sizeof *event + event->len);
         }
     }
-    // never hit here.
-    assert(true);
+}
 
-    return 0;
+void wslgd::FontMonitor::HandleFanotifyEvents()
+{
+    alignas(struct fanotify_event_metadata) char buf[8192];
+    ssize_t len;
+
+    while ((len = read(GetFd(), buf, sizeof buf)) > 0) {
+        auto metadata = reinterpret_cast<struct fanotify_event_metadata *>(buf);
+        for (; FAN_EVENT_OK(metadata, len); metadata = FAN_EVENT_NEXT(metadata, len)) {
+            m_eventCount++;
+            if (metadata->mask & FAN_Q_OVERFLOW) {
+                LOG_ERROR("FontMonitor: fanotify queue overflowed");
+                RescanMonitorFolders();
+                continue;
+            }
+
+            // Each event names the entry within its parent directory, given as a file handle.
+            auto info = reinterpret_cast<struct fanotify_event_info_fid *>(metadata + 1);
+            if ((metadata->event_len < (sizeof(*metadata) + sizeof(*info))) ||
+                (info->hdr.info_type != FAN_EVENT_INFO_TYPE_DFID_NAME)) {
+                continue;
+            }
+
+            // The mark covers the whole filesystem, so skip files other than fonts.dir, fonts.alias
+            // and font files before looking up the directory.
+            auto handle = reinterpret_cast<struct file_handle *>(info->handle);
+            auto name = reinterpret_cast<const char *>(handle->f_handle + handle->handle_bytes);
+            bool isFolder = (metadata->mask & FAN_ONDIR);
+            bool isFontsDir = !isFolder && ((strcmp(name, c_fontsdir) == 0) || (strcmp(name, c_fontsalias) == 0));
+            if (!isFolder && !isFontsDir && !FontCache::IsFontFile(name)) {
+                continue;
+            }
+
+            // fontconfig reads every folder under its font directories, not only the tracked ones.
+            std::string path = GetHandlePath(info);
+            m_fontCache.Invalidate(path);
+            auto found = m_fontMonitorFolders.find(path);
+            if (found == m_fontMonitorFolders.end()) {
+                continue;
+            }
+
+            if (isFolder) {
+                HandleFolderEvent(*found->second, metadata->mask, name);
+            } else if (isFontsDir) {
+                HandleFontsDirEvent(*found->second, metadata->mask, name);
+            }
+        }
+    }
 }
 
-int wslgd::FontMonitor::Start()
+std::string wslgd::FontMonitor::GetHandlePath(const struct fanotify_event_info_fid *info) const
+{
+    auto mount = m_mountFds.find(GetFsidKey(&info->fsid));
+    if (mount == m_mountFds.end()) {
+        return {};
+    }
+
+    // The directory may be gone already, then there is nothing to look up.
+    auto handle = reinterpret_cast<struct file_handle *>(const_cast<unsigned char *>(info->handle));
+    wil::unique_fd fd(open_by_handle_at(mount->second.get(), handle, O_PATH | O_CLOEXEC));
+    if (!fd) {
+        return {};
+    }
+
+    std::error_code error;
+    auto path = std::filesystem::read_symlink("/proc/self/fd/" + std::to_string(fd.get()), error);
+    return error ? std::string() : path.string();
+}
+
+bool wslgd::FontMonitor::InitFanotify(const std::vector<const char*>& paths)
+{
+    // A filesystem mark reports changes anywhere below the font folders without a watch per folder,
+    // it needs CAP_SYS_ADMIN and a kernel reporting directory handles with names (5.9). Mount marks
+    // cannot report directory entry events, so the mark wakes WSLGd for every file created on the
+    // filesystem holding the fonts, which is why it is only used when asked for.
+    wil::unique_fd fd(fanotify_init(FAN_CLASS_NOTIF | FAN_REPORT_DFID_NAME | FAN_NONBLOCK | FAN_CLOEXEC, O_RDONLY | O_CLOEXEC));
+    if (!fd) {
+        LOG_INFO("FontMonitor: fanotify is not available, %s, using inotify", strerror(errno));
+        return false;
+    }
+
+    std::map<uint64_t, wil::unique_fd> mountFds;
+    for (auto path : paths) {
+        wil::unique_fd mountFd(open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC));
+        struct statfs status;
+        if (!mountFd || (fstatfs(mountFd.get(), &status) < 0) ||
+            (fanotify_mark(fd.get(), FAN_MARK_ADD | FAN_MARK_FILESYSTEM, c_fanotifyMask, AT_FDCWD, path) < 0)) {
+            LOG_INFO("FontMonitor: fanotify cannot watch %s, %s, using inotify", path, strerror(errno));
+            return false;
+        }
+
+        mountFds[GetFsidKey(&status.f_fsid)] = std::move(mountFd);
+    }
+
+    LOG_INFO("FontMonitor: using fanotify");
+    m_fd.reset(fd.release());
+    m_mountFds = std::move(mountFds);
+    m_isFanotify = true;
+    return true;
+}
+
+void wslgd::FontMonitor::ScheduleFontPathUpdate(const std::string& path, bool isAdd)
+{
+    // The last change to a folder wins, e.g. a folder created and removed again is left alone.
+    if (isAdd) {
+        m_pendingRemoves.erase(path);
+        m_pendingAdds.insert(path);
+    } else {
+        m_pendingAdds.erase(path);
+        m_pendingRemoves.insert(path);
+    }
+
+    if (!m_isX11Ready) {
+        return;
+    }
+
+    // Restart the debounce window on every event, up to the maximum delay from the first one.
+    auto now = GetTimeMs();
+    if (m_updateTimer >= 0) {
+        m_loop.CancelTimer(m_updateTimer);
+    } else {
+        m_updateFirstMs = now;
+    }
+
+    uint64_t deadline = m_updateFirstMs + c_fontPathMaxDelayMs;
+    uint64_t delay = std::min(c_fontPathDebounceMs, (deadline > now) ? (deadline - now) : 0);
+    m_updateTimer = m_loop.AddTimer(delay, [this]() {
+        m_updateTimer = -1;
+        ApplyFontPathUpdates(false);
+    });
+}
+
+void wslgd::FontMonitor::ApplyFontPathUpdates(bool isForced)
+{
+    // While the X server is away, the changes are applied in full once it is back. Changes seen
+    // while one is in flight are applied once it completes.
+    if (!m_fontPath.IsConnected() || m_isChanging) {
+        return;
+    }
+
+    std::vector<std::string> removes;
+    for (auto &path : m_pendingRemoves) {
+        removes.push_back(path);
+    }
+
+    // Folders with fonts.dir or fonts.alias still being written wait, unless waiting took too long.
+    std::vector<std::string> adds;
+    std::set<std::string> deferred;
+    bool isRehashNeeded = false;
+    bool canDefer = !isForced && ((GetTimeMs() - m_updateFirstMs) < c_fontPathMaxDelayMs);
+    for (auto &path : m_pendingAdds) {
+        auto found = m_fontMonitorFolders.find(path);
+        if (found == m_fontMonitorFolders.end()) {
+            continue;
+        }
+
+        auto &folder = found->second;
+        if (folder->IsWriting() && canDefer) {
+            deferred.insert(path);
+        } else if (!folder->HasFontsDir()) {
+            if (folder->IsPathAdded()) {
+                removes.push_back(path);
+            }
+        } else if (folder->IsPathAdded()) {
+            isRehashNeeded = true;
+        } else {
+            adds.push_back(path);
+        }
+    }
+
+    m_pendingAdds = std::move(deferred);
+    m_pendingRemoves.clear();
+    if (!removes.empty() || !adds.empty() || isRehashNeeded) {
+        LOG_INFO("FontMonitor: updating font path, %zu removed, %zu added", removes.size(), adds.size());
+        m_fontPathUpdateCount++;
+        m_fontPathFolderCount += removes.size() + adds.size();
+        ChangeX11FontPath(std::move(removes), std::move(adds));
+    }
+
+    if (!m_pendingAdds.empty() && m_isX11Ready) {
+        m_updateTimer = m_loop.AddTimer(c_fontPathDebounceMs, [this]() {
+            m_updateTimer = -1;
+            ApplyFontPathUpdates(false);
+        });
+    }
+}
+
+void wslgd::FontMonitor::ChangeX11FontPath(std::vector<std::string>&& removes, std::vector<std::string>&& adds)
+{
+    // A single change removes and adds every folder of the batch, and rehashes once.
+    m_isChanging = true;
+    m_changingAdds = adds;
+    m_fontPath.Change(std::move(removes), std::move(adds), true,
+        [this](const X11FontPath::Result& result) { HandleFontPathChanged(result); });
+}
+
+void wslgd::FontMonitor::HandleFontPathChanged(const X11FontPath::Result& result)
+{
+    m_isChanging = false;
+    m_changingAdds.clear();
+    for (auto &path : result.removed) {
+        auto found = m_fontMonitorFolders.find(path);
+        if (found != m_fontMonitorFolders.end()) {
+            found->second->SetPathAdded(false);
+        }
+    }
+
+    // A folder removed while its add was in flight is taken out again.
+    for (auto &path : result.added) {
+        auto found = m_fontMonitorFolders.find(path);
+        if (found != m_fontMonitorFolders.end()) {
+            found->second->SetPathAdded(true);
+        } else {
+            m_pendingRemoves.insert(path);
+        }
+    }
+
+    if (!m_fontPath.IsConnected()) {
+        HandleX11Disconnect();
+        return;
+    }
+
+    if ((!m_pendingAdds.empty() || !m_pendingRemoves.empty()) && (m_updateTimer < 0)) {
+        ApplyFontPathUpdates(false);
+    }
+}
+
+void wslgd::FontMonitor::ConnectX11()
+{
+    m_fontPath.Connect([this](bool isConnected) {
+        if (!isConnected) {
+            HandleX11Disconnect();
+            return;
+        }
+
+        // A new X server starts with the default font path, so every folder is added again.
+        m_reconnectDelayMs = 0;
+        m_pendingRemoves.clear();
+        for (auto &folder : m_fontMonitorFolders) {
+            folder.second->SetPathAdded(false);
+            m_pendingAdds.insert(folder.first);
+        }
+
+        ApplyFontPathUpdates(true);
+    });
+}
+
+void wslgd::FontMonitor::HandleX11Disconnect()
+{
+    if (m_reconnectTimer >= 0) {
+        return;
+    }
+
+    // The change in flight is dropped with the connection, every folder is added again on reconnect.
+    m_fontPath.Disconnect();
+    m_isChanging = false;
+    m_changingAdds.clear();
+    m_reconnectDelayMs = m_reconnectDelayMs ? std::min(m_reconnectDelayMs * 2, c_reconnectMaxDelayMs) : c_reconnectInitialDelayMs;
+    LOG_INFO("FontMonitor: X server connection lost, reconnecting in %llu ms", static_cast<unsigned long long>(m_reconnectDelayMs));
+    m_reconnectTimer = m_loop.AddTimer(m_reconnectDelayMs, [this]() {
+        m_reconnectTimer = -1;
+        ConnectX11();
+    });
+}
+
+int wslgd::FontMonitor::Scan(bool isFanotifyEnabled)
 {
     bool succeeded = false;
 
     assert(m_fontMonitorFolders.empty());
-    assert(!m_fontMonitorThread);
+    assert(!m_isX11Ready);
 
     try {
-        // xset must be installed.
-        THROW_LAST_ERROR_IF(access(c_xset, X_OK) < 0);
+        // xcb or xset must be available.
+        THROW_ERRNO_IF(ENOENT, !X11FontPath::IsAvailable());
 
         // if user distro mount folder does not exist, bail out.
         THROW_LAST_ERROR_IF_FALSE(std::filesystem::exists(USER_DISTRO_MOUNT_PATH));
@@ -279,21 +586,62 @@ int wslgd::FontMonitor::Start()
         // and check fonts path inside user distro.
         THROW_LAST_ERROR_IF_FALSE(userDistroFontPathExists || altDistroFontPathExists);
 
-        // start monitoring on mounted font folder.
-        wil::unique_fd fd(inotify_init());
-        THROW_LAST_ERROR_IF(!fd);
-        m_fd.reset(fd.release());
-        
         // add both the default and alternative font paths if they exist.
+        std::vector<const char*> paths;
         if (userDistroFontPathExists) {
-            AddMonitorFolder(USER_DISTRO_FONT_PATH);
+            paths.push_back(USER_DISTRO_FONT_PATH);
         }
         if (altDistroFontPathExists) {
-            AddMonitorFolder(ALT_DISTRO_FONT_PATH);
+            paths.push_back(ALT_DISTRO_FONT_PATH);
+        }
+
+        // start monitoring on mounted font folder, by fanotify if enabled and permitted.
+        if (!isFanotifyEnabled || !InitFanotify(paths)) {
+            wil::unique_fd fd(inotify_init1(IN_NONBLOCK | IN_CLOEXEC));
+            THROW_LAST_ERROR_IF(!fd);
+            m_fd.reset(fd.release());
         }
 
-        // Create font folder monitor thread.
-        THROW_LAST_ERROR_IF(pthread_create(&m_fontMonitorThread, NULL, FontMonitorThread, (void*)this) < 0);
+        for (auto path : paths) {
+            m_rootPaths.push_back(path);
+            AddMonitorFolder(path);
+        }
+
+        succeeded = true;
+    }
+    CATCH_LOG();
+
+    if (!succeeded) {
+        Stop();
+        return -1;
+    }
+
+    return 0;
+}
+
+int wslgd::FontMonitor::Start()
+{
+    bool succeeded = false;
+
+    assert(!m_isX11Ready);
+
+    try {
+        // Scan() must have succeeded.
+        THROW_ERRNO_IF(ENOENT, !m_fd);
+
+        // X server is up now, add folders scanned with fonts.dir to font path at once.
+        m_isX11Ready = true;
+        ConnectX11();
+
+        // Build the fontconfig caches in the background, now that weston is up.
+        m_fontCache.Start();
+
+        // Dump currently tracking folders.
+        DumpMonitorFolders();
+
+        // Start listening folder add/remove.
+        m_loop.AddFd(GetFd(), EPOLLIN, [this](uint32_t) { HandleEvents(); });
+        LOG_INFO("FontMonitor: monitoring started.");
 
         succeeded = true;
     }
@@ -309,23 +657,86 @@ int wslgd::FontMonitor::Start()
 
 void wslgd::FontMonitor::Stop()
 {
-    // Stop font folder monitor thread.
-    if (m_fontMonitorThread) {
-        pthread_cancel(m_fontMonitorThread);
-        pthread_join(m_fontMonitorThread, NULL);
-        m_fontMonitorThread = 0;
+    // Stop listening folder add/remove.
+    if (m_fd) {
+        m_loop.RemoveFd(GetFd());
+    }
+
+    if (m_updateTimer >= 0) {
+        m_loop.CancelTimer(m_updateTimer);
+        m_updateTimer = -1;
     }
 
-    // Remove both the default and alternative font paths if they were added.
-    if (m_fontMonitorFolders.find(USER_DISTRO_FONT_PATH) != m_fontMonitorFolders.end()) {
-        RemoveMonitorFolder(USER_DISTRO_FONT_PATH);
+    // Remove every folder added to the font path, or being added, in a single update queued
+    // behind the change in flight.
+    m_pendingAdds.clear();
+    if (m_isX11Ready) {
+        for (auto &folder : m_fontMonitorFolders) {
+            if (folder.second->IsPathAdded()) {
+                m_pendingRemoves.insert(folder.first);
+            }
+        }
+
+        m_pendingRemoves.insert(m_changingAdds.begin(), m_changingAdds.end());
+        m_isChanging = false;
+        ApplyFontPathUpdates(true);
     }
-    if (m_fontMonitorFolders.find(ALT_DISTRO_FONT_PATH) != m_fontMonitorFolders.end()) {
-        RemoveMonitorFolder(ALT_DISTRO_FONT_PATH);
+
+    if (m_reconnectTimer >= 0) {
+        m_loop.CancelTimer(m_reconnectTimer);
+        m_reconnectTimer = -1;
     }
 
+    m_fontCache.Stop();
+
+    m_fontPath.Disconnect();
+    m_isChanging = false;
+    m_changingAdds.clear();
+    m_reconnectDelayMs = 0;
+    m_pendingRemoves.clear();
+    m_foldersByWd.clear();
     m_fontMonitorFolders.clear();
+    m_rootPaths.clear();
     m_fd.reset();
+    m_mountFds.clear();
+    m_isFanotify = false;
+    m_isX11Ready = false;
 
     LOG_INFO("FontMonitor: monitoring stopped.");
 }
+
+void wslgd::FontMonitor::WriteMetrics(std::string& out) const
+{
+    MetricsServer::Describe(out, "wslgd_font_folders", "gauge", "Font folders being monitored.");
+    MetricsServer::Add(out, "wslgd_font_folders", "", m_fontMonitorFolders.size());
+    MetricsServer::Describe(out, "wslgd_font_events_total", "counter", "Filesystem events read by the font monitor.");
+    MetricsServer::Add(out, "wslgd_font_events_total", "", m_eventCount);
+    MetricsServer::Describe(out, "wslgd_font_folder_adds_total", "counter", "Font folders added to monitoring.");
+    MetricsServer::Add(out, "wslgd_font_folder_adds_total", "", m_folderAddCount);
+    MetricsServer::Describe(out, "wslgd_font_folder_removes_total", "counter", "Font folders removed from monitoring.");
+    MetricsServer::Add(out, "wslgd_font_folder_removes_total", "", m_folderRemoveCount);
+    MetricsServer::Describe(out, "wslgd_font_path_updates_total", "counter", "Batched X11 font path updates after fonts.dir changes.");
+    MetricsServer::Add(out, "wslgd_font_path_updates_total", "", m_fontPathUpdateCount);
+    MetricsServer::Describe(out, "wslgd_font_path_folder_changes_total", "counter", "Font folders added to or removed from the X11 font path.");
+    MetricsServer::Add(out, "wslgd_font_path_folder_changes_total", "", m_fontPathFolderCount);
+    m_fontCache.WriteMetrics(out);
+}
+
+void wslgd::FontMonitor::DumpState(std::string& out) const
+{
+    out += std::string("font monitor ") + (m_fd ? "active" : "inactive") + (m_isFanotify ? ", fanotify" : "") +
+        (m_isX11Ready ? ", X11 ready" : "") + "\n";
+    for (auto &folder : m_fontMonitorFolders) {
+        out += "font folder " + folder.first + (folder.second->IsPathAdded() ? " added" : " not-added");
+        if (m_pendingAdds.count(folder.first)) {
+            out += " update-pending";
+        }
+        if (folder.second->IsWriting()) {
+            out += " writing";
+        }
+
+        out += "\n";
+    }
+
+    m_fontCache.DumpState(out);
+}
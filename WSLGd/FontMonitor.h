@@ -2,23 +2,27 @@
 // Licensed under the MIT license.
 #pragma once
 #include "precomp.h"
+#include "EventLoop.h"
+#include "X11FontPath.h"
+#include "FontCache.h"
 
 namespace wslgd
 {
     class FontFolder
     {
     public:
-        FontFolder(int fd, const char *path);
+        FontFolder(int fd, const char *path); /* fd < 0 when the folder is covered by a fanotify mark */
         ~FontFolder();
 
-        void ModifyX11FontPath(bool add);
-
-        static bool ExecuteShellCommand(std::vector<const char*>&& argv);
+        bool HasFontsDir() const;
 
         int GetFd() const { return m_fd.get(); }
         int GetWd() const { return m_wd; }
 
         bool IsPathAdded() const { return m_isPathAdded; }
+        void SetPathAdded(bool isAdded) { m_isPathAdded = isAdded; }
+        bool IsWriting() const { return m_isWriting; }
+        void SetWriting(bool isWriting) { m_isWriting = isWriting; }
         const char *GetPath() const { return m_path.c_str(); }
 
     private:
@@ -26,34 +30,71 @@ namespace wslgd
         int m_wd = -1; /* from inotify_add_watch() for this folder */
         std::string m_path; /* this folder path */
         bool m_isPathAdded = false; /* whether font path is added to X11 font path */
+        bool m_isWriting = false; /* fonts.dir or fonts.alias was created and is not closed yet */
     };
 
     class FontMonitor
     {
     public:
-        FontMonitor();
+        FontMonitor(EventLoop& loop, ProcessMonitor& monitor);
         ~FontMonitor() { Stop(); }
 
         FontMonitor(const FontMonitor&) = delete;
         void operator=(const FontMonitor&) = delete;
 
+        int Scan(bool isFanotifyEnabled = false);
         int Start();
         void Stop();
 
-        static void* FontMonitorThread(void *context);
-
         void AddMonitorFolder(const char *path);
         void RemoveMonitorFolder(const char *path);
+        void RescanMonitorFolders();
         void DumpMonitorFolders();
 
-        void HandleFolderEvent(struct inotify_event *event);
-        void HandleFontsDirEvent(struct inotify_event *event);
+        void HandleEvents();
+        void HandleFolderEvent(FontFolder& folder, uint32_t mask, const char *name);
+        void HandleFontsDirEvent(FontFolder& folder, uint32_t mask, const char *name);
 
         int GetFd() const { return m_fd.get(); }
+        void WriteMetrics(std::string& out) const;
+        void DumpState(std::string& out) const;
 
     private:
-        wil::unique_fd m_fd; /* from inotify_init() */
+        bool InitFanotify(const std::vector<const char*>& paths);
+        void HandleInotifyEvents();
+        void HandleFanotifyEvents();
+        void RescanMonitorFolder(const std::string& path);
+        std::string GetHandlePath(const struct fanotify_event_info_fid *info) const;
+        FontFolder* FindFolder(int wd) const;
+        void ScheduleFontPathUpdate(const std::string& path, bool isAdd);
+        void ApplyFontPathUpdates(bool isFinal);
+        void ChangeX11FontPath(std::vector<std::string>&& removes, std::vector<std::string>&& adds);
+        void HandleFontPathChanged(const X11FontPath::Result& result);
+        void ConnectX11();
+        void HandleX11Disconnect();
+
+        EventLoop& m_loop;
+        wil::unique_fd m_fd; /* from fanotify_init() or inotify_init() */
+        bool m_isFanotify = false; /* font trees are watched by filesystem marks instead of a watch per folder */
+        std::map<uint64_t, wil::unique_fd> m_mountFds{}; /* by fsid, to open the directories fanotify reports */
+        std::vector<std::string> m_rootPaths{}; /* font trees passed to Scan */
         std::map<std::string, std::unique_ptr<FontFolder>> m_fontMonitorFolders{};
-        pthread_t m_fontMonitorThread = 0;
+        std::unordered_map<int, FontFolder*> m_foldersByWd{}; /* the same folders, by inotify watch */
+        std::set<std::string> m_pendingAdds{}; /* folders whose fonts.dir was written since the last update */
+        std::set<std::string> m_pendingRemoves{}; /* folders to take out of the font path */
+        int m_updateTimer = -1; /* applies the pending changes once events stop coming */
+        uint64_t m_updateFirstMs = 0; /* when the first pending change was queued */
+        bool m_isX11Ready = false; /* whether X server is up to accept font path changes */
+        X11FontPath m_fontPath;
+        bool m_isChanging = false; /* a font path change is in flight, the next one waits for it */
+        std::vector<std::string> m_changingAdds{}; /* folders that change adds */
+        int m_reconnectTimer = -1;
+        uint64_t m_reconnectDelayMs = 0;
+        FontCache m_fontCache;
+        uint64_t m_eventCount = 0; /* inotify events read */
+        uint64_t m_folderAddCount = 0;
+        uint64_t m_folderRemoveCount = 0;
+        uint64_t m_fontPathUpdateCount = 0; /* batched font path updates applied */
+        uint64_t m_fontPathFolderCount = 0; /* folder changes carried by those updates */
     };
 }
@@ -0,0 +1,86 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+#include "LogFile.h"
+#include "common.h"
+
+wslgd::LogFile::LogFile(const char *path, uint64_t segmentSize, int segments) :
+    m_path(path), m_segmentSize(segmentSize), m_segments(segments)
+{
+    THROW_INVALID_IF((m_segmentSize == 0) || (m_segments < 0));
+    Open();
+}
+
+bool wslgd::LogFile::IsRegularFile() const noexcept
+{
+    struct stat buffer;
+    return (lstat(m_path.c_str(), &buffer) < 0) || S_ISREG(buffer.st_mode);
+}
+
+void wslgd::LogFile::Open()
+{
+    // Renaming a FIFO or a symlink would move something WSLGd does not own.
+    m_isRotating = IsRegularFile();
+
+    // The log is readable by everyone but only written through WSLGd.
+    m_fd.reset(open(m_path.c_str(), (O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC), (S_IRUSR | S_IRGRP | S_IROTH)));
+    THROW_LAST_ERROR_IF(!m_fd);
+
+    struct stat buffer;
+    THROW_LAST_ERROR_IF(fstat(m_fd.get(), &buffer) < 0);
+    m_size = buffer.st_size;
+}
+
+std::string wslgd::LogFile::SegmentPath(const std::string& path, int segment)
+{
+    return segment == 0 ? path : path + "." + std::to_string(segment);
+}
+
+void wslgd::LogFile::Rotate()
+{
+    // The path may have been replaced since it was opened.
+    if (!IsRegularFile()) {
+        m_isRotating = false;
+        return;
+    }
+
+    // Shift every segment up by one, the oldest one is overwritten or dropped.
+    if (m_segments == 0) {
+        unlink(m_path.c_str());
+    } else {
+        for (int segment = m_segments - 1; segment >= 0; segment--) {
+            rename(SegmentPath(m_path, segment).c_str(), SegmentPath(m_path, segment + 1).c_str());
+        }
+    }
+
+    Open();
+}
+
+void wslgd::LogFile::Write(const char *buffer, size_t size) noexcept
+{
+    try {
+        if (m_isRotating && (m_size > 0) && ((m_size + size) > m_segmentSize)) {
+            Rotate();
+        }
+    }
+    catch (...) {
+        // Keep writing to whatever is open, the log must not be lost because rotation failed.
+        if (!m_fd) {
+            return;
+        }
+    }
+
+    while (size > 0) {
+        auto written = write(m_fd.get(), buffer, size);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            return;
+        }
+
+        buffer += written;
+        size -= written;
+        m_size += written;
+    }
+}
@@ -0,0 +1,34 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+#pragma once
+#include "precomp.h"
+
+namespace wslgd
+{
+    // An append-only log split into numbered segments: path is the newest, path.1 the one before it,
+    // up to path.<segments>. Disk usage is bounded to (segments + 1) * segmentSize. A path that is not
+    // a regular file, such as a FIFO or a symlink, is written as is and never rotated.
+    class LogFile
+    {
+    public:
+        LogFile(const char *path, uint64_t segmentSize, int segments);
+        LogFile(const LogFile&) = delete;
+        void operator=(const LogFile&) = delete;
+
+        void Write(const char *buffer, size_t size) noexcept;
+
+        static std::string SegmentPath(const std::string& path, int segment);
+
+    private:
+        void Open();
+        void Rotate();
+        bool IsRegularFile() const noexcept;
+
+        std::string m_path;
+        uint64_t m_segmentSize;
+        int m_segments;
+        uint64_t m_size = 0;
+        bool m_isRotating = true;
+        wil::unique_fd m_fd;
+    };
+}
@@ -0,0 +1,328 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+#include "Logger.h"
+#include "common.h"
+
+constexpr size_t c_batchSize = 64 * 1024;
+
+const int wslgd::Logger::c_defaultLevel = LOG_LEVEL_INFO;
+std::atomic<int> wslgd::Logger::s_level{c_defaultLevel};
+std::atomic<bool> wslgd::Logger::s_isStarted{false};
+std::atomic<bool> wslgd::Logger::s_isStopping{false};
+std::atomic<bool> wslgd::Logger::s_isWriterWaiting{false};
+std::atomic<uint64_t> wslgd::Logger::s_tail{0};
+uint64_t wslgd::Logger::s_head = 0;
+std::atomic<uint64_t> wslgd::Logger::s_dropped{0};
+std::atomic<uint64_t> wslgd::Logger::s_droppedTotal{0};
+std::array<wslgd::Logger::Record, wslgd::Logger::c_recordCount> wslgd::Logger::s_records;
+wil::unique_fd wslgd::Logger::s_eventFd;
+std::unique_ptr<wslgd::LogFile> wslgd::Logger::s_file;
+pthread_t wslgd::Logger::s_writerThread = 0;
+
+void LogPrint(int level, const char *func, int line, const char *fmt, ...) noexcept
+{
+    if (!wslgd::Logger::IsEnabled(level)) {
+        return;
+    }
+
+    va_list va_args;
+    va_start(va_args, fmt);
+    wslgd::Logger::Write(level, func, line, fmt, va_args);
+    va_end(va_args);
+}
+
+void wslgd::Logger::Start(std::unique_ptr<LogFile>&& file)
+{
+    s_file = std::move(file);
+    for (size_t i = 0; i < s_records.size(); i++) {
+        s_records[i].sequence.store(i, std::memory_order_relaxed);
+    }
+
+    s_eventFd.reset(eventfd(0, EFD_CLOEXEC));
+    THROW_LAST_ERROR_IF(!s_eventFd);
+
+    // The writer must never take a signal meant for the event loop's signalfd.
+    sigset_t allSignals;
+    sigset_t oldMask;
+    sigfillset(&allSignals);
+    THROW_LAST_ERROR_IF(pthread_sigmask(SIG_SETMASK, &allSignals, &oldMask) != 0);
+    auto restoreMask = wil::scope_exit([&oldMask]() { pthread_sigmask(SIG_SETMASK, &oldMask, nullptr); });
+    int error = pthread_create(&s_writerThread, NULL, WriterThread, NULL);
+    THROW_ERRNO_IF(error, error != 0);
+    s_isStarted.store(true, std::memory_order_release);
+
+    // Flush whatever is still queued when WSLGd exits.
+    atexit(Stop);
+}
+
+void wslgd::Logger::Stop() noexcept
+{
+    if (!s_isStarted.exchange(false)) {
+        return;
+    }
+
+    // Messages logged from here on are written synchronously.
+    s_isStopping = true;
+    uint64_t value = 1;
+    write(s_eventFd.get(), &value, sizeof(value));
+    pthread_join(s_writerThread, NULL);
+    Drain();
+}
+
+void wslgd::Logger::Write(int level, const char *func, int line, const char *fmt, va_list args) noexcept
+{
+    if (!s_isStarted.load(std::memory_order_acquire)) {
+        Message message;
+        clock_gettime(CLOCK_REALTIME, &message.time);
+        message.level = level;
+        message.func = func;
+        message.line = line;
+        message.type = MessageType::Log;
+        vsnprintf(message.text, sizeof(message.text), fmt, args);
+
+        std::array<char, c_messageSize + 128> buffer;
+        WriteAll(buffer.data(), Format(buffer.data(), buffer.size(), message));
+        return;
+    }
+
+    uint64_t position;
+    auto record = Claim(position);
+    if (!record) {
+        return;
+    }
+
+    auto& message = record->message;
+    clock_gettime(CLOCK_REALTIME, &message.time);
+    message.level = level;
+    message.func = func;
+    message.line = line;
+    message.type = MessageType::Log;
+    vsnprintf(message.text, sizeof(message.text), fmt, args);
+    Publish(record, position);
+}
+
+void wslgd::Logger::WriteRaw(const char *buffer, size_t size) noexcept
+{
+    if (!s_isStarted.load(std::memory_order_acquire)) {
+        WriteAll(buffer, size);
+        return;
+    }
+
+    while (size > 0) {
+        uint64_t position;
+        auto record = Claim(position);
+        if (!record) {
+            return;
+        }
+
+        auto& message = record->message;
+        message.type = MessageType::Raw;
+        message.length = std::min(size, sizeof(message.text));
+        memcpy(message.text, buffer, message.length);
+        buffer += message.length;
+        size -= message.length;
+        Publish(record, position);
+    }
+}
+
+void wslgd::Logger::WriteOutput(const char *source, pid_t pid, const char *line, size_t size) noexcept
+{
+    // Long lines are split, each part tagged with its source.
+    do {
+        size_t length;
+        if (!s_isStarted.load(std::memory_order_acquire)) {
+            Message message;
+            length = FormatOutput(message, source, pid, line, size);
+            std::array<char, c_messageSize + 128> buffer;
+            WriteAll(buffer.data(), Format(buffer.data(), buffer.size(), message));
+        } else {
+            uint64_t position;
+            auto record = Claim(position);
+            if (!record) {
+                return;
+            }
+
+            length = FormatOutput(record->message, source, pid, line, size);
+            Publish(record, position);
+        }
+
+        line += length;
+        size -= length;
+    } while (size > 0);
+}
+
+size_t wslgd::Logger::FormatOutput(Message& message, const char *source, pid_t pid, const char *line, size_t size) noexcept
+{
+    clock_gettime(CLOCK_REALTIME, &message.time);
+    message.type = MessageType::Output;
+    int prefix = snprintf(message.text, sizeof(message.text), "%s[%d]: ", source, pid);
+    prefix = std::clamp(prefix, 0, static_cast<int>(sizeof(message.text)) - 1);
+    auto length = std::min(size, sizeof(message.text) - prefix);
+    memcpy(message.text + prefix, line, length);
+    message.length = prefix + length;
+    return length;
+}
+
+wslgd::Logger::Record *wslgd::Logger::Claim(uint64_t& position) noexcept
+{
+    // Claim a slot, see Dmitry Vyukov's bounded MPMC queue. A full ring drops the message rather
+    // than waiting for the writer.
+    position = s_tail.load(std::memory_order_relaxed);
+    for (;;) {
+        auto record = &s_records[position & (c_recordCount - 1)];
+        auto difference = static_cast<int64_t>(record->sequence.load(std::memory_order_acquire) - position);
+        if (difference == 0) {
+            if (s_tail.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                return record;
+            }
+        } else if (difference < 0) {
+            s_dropped.fetch_add(1, std::memory_order_relaxed);
+            s_droppedTotal.fetch_add(1, std::memory_order_relaxed);
+            return nullptr;
+        } else {
+            position = s_tail.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+void wslgd::Logger::Publish(Record *record, uint64_t position) noexcept
+{
+    record->sequence.store(position + 1);
+
+    // Only wake the writer when it is about to sleep, so a burst costs a single syscall.
+    if (s_isWriterWaiting.exchange(false)) {
+        uint64_t value = 1;
+        write(s_eventFd.get(), &value, sizeof(value));
+    }
+}
+
+size_t wslgd::Logger::Format(char *buffer, size_t size, const Message& message) noexcept
+{
+    // A truncated record needs room for at least its newline and snprintf's terminator.
+    if (size < 2) {
+        return 0;
+    }
+
+    if (message.type == MessageType::Raw) {
+        auto length = std::min(message.length, size);
+        memcpy(buffer, message.text, length);
+        return length;
+    }
+
+    struct tm time;
+    std::array<char, 32> timeString;
+    localtime_r(&message.time.tv_sec, &time);
+    strftime(timeString.data(), timeString.size(), "%H:%M:%S", &time);
+    int length;
+    if (message.type == MessageType::Output) {
+        length = snprintf(buffer, size, "[%s.%03ld] %.*s\n",
+            timeString.data(), (message.time.tv_nsec / 1000000),
+            static_cast<int>(message.length), message.text);
+    } else {
+        length = snprintf(buffer, size, "[%s.%03ld] <%d>WSLGd: %s:%u: %s\n",
+            timeString.data(), (message.time.tv_nsec / 1000000),
+            message.level, message.func, message.line, message.text);
+    }
+
+    if (length < 0) {
+        return 0;
+    }
+
+    // Keep the newline of a truncated message.
+    if (static_cast<size_t>(length) >= size) {
+        buffer[size - 2] = '\n';
+        return size - 1;
+    }
+
+    return length;
+}
+
+bool wslgd::Logger::IsEmpty() noexcept
+{
+    return s_records[s_head & (c_recordCount - 1)].sequence.load() != (s_head + 1);
+}
+
+void wslgd::Logger::Drain() noexcept
+{
+    std::array<char, c_batchSize> batch;
+    size_t used = 0;
+    while (!IsEmpty()) {
+        auto& record = s_records[s_head & (c_recordCount - 1)];
+        if ((batch.size() - used) < (c_messageSize + 128)) {
+            WriteAll(batch.data(), used);
+            used = 0;
+        }
+
+        used += Format(batch.data() + used, batch.size() - used, record.message);
+        record.sequence.store(s_head + c_recordCount, std::memory_order_release);
+        s_head++;
+    }
+
+    auto dropped = s_dropped.exchange(0, std::memory_order_relaxed);
+    if (dropped > 0) {
+        Message message;
+        clock_gettime(CLOCK_REALTIME, &message.time);
+        message.level = LOG_LEVEL_ERROR;
+        message.func = __FUNCTION__;
+        message.line = __LINE__;
+        message.type = MessageType::Log;
+        snprintf(message.text, sizeof(message.text), "log buffer full, dropped %llu messages",
+            static_cast<unsigned long long>(dropped));
+
+        if ((batch.size() - used) < (c_messageSize + 128)) {
+            WriteAll(batch.data(), used);
+            used = 0;
+        }
+
+        used += Format(batch.data() + used, batch.size() - used, message);
+    }
+
+    WriteAll(batch.data(), used);
+}
+
+void *wslgd::Logger::WriterThread(void *) noexcept
+{
+    for (;;) {
+        Drain();
+        if (s_isStopping) {
+            break;
+        }
+
+        // Announce the wait before checking once more, so a producer either sees the flag or its
+        // message is seen here.
+        s_isWriterWaiting = true;
+        if (!IsEmpty()) {
+            s_isWriterWaiting = false;
+            continue;
+        }
+
+        uint64_t value;
+        if ((read(s_eventFd.get(), &value, sizeof(value)) < 0) && (errno != EINTR)) {
+            break;
+        }
+    }
+
+    return NULL;
+}
+
+void wslgd::Logger::WriteAll(const char *buffer, size_t size) noexcept
+{
+    if (s_file) {
+        s_file->Write(buffer, size);
+        return;
+    }
+
+    while (size > 0) {
+        auto written = write(STDERR_FILENO, buffer, size);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            return;
+        }
+
+        buffer += written;
+        size -= written;
+    }
+}
@@ -0,0 +1,79 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+#pragma once
+#include "precomp.h"
+#include "LogFile.h"
+
+namespace wslgd
+{
+    // Messages are copied into a lock-free ring by the logging thread and formatted and written
+    // in batches by a background writer, so logging never blocks the supervisor. Output goes to
+    // the log file when there is one, stderr otherwise.
+    class Logger
+    {
+    public:
+        static void Start(std::unique_ptr<LogFile>&& file = nullptr);
+        static void Stop() noexcept;
+
+        static const int c_defaultLevel;
+
+        static void SetLevel(int level) noexcept { s_level.store(level, std::memory_order_relaxed); }
+        static int GetLevel() noexcept { return s_level.load(std::memory_order_relaxed); }
+        static bool IsEnabled(int level) noexcept { return level <= GetLevel(); }
+        static uint64_t GetDropped() noexcept { return s_droppedTotal.load(std::memory_order_relaxed); }
+
+        static void Write(int level, const char *func, int line, const char *fmt, va_list args) noexcept;
+        static void WriteRaw(const char *buffer, size_t size) noexcept;
+        static void WriteOutput(const char *source, pid_t pid, const char *line, size_t size) noexcept;
+
+    private:
+        static constexpr size_t c_recordCount = 512; /* must be a power of two */
+        static constexpr size_t c_messageSize = 512;
+
+        enum class MessageType
+        {
+            Log, /* a WSLGd message with its level, function and line */
+            Raw, /* written as is */
+            Output /* a line of output from a child, timestamped */
+        };
+
+        struct Message
+        {
+            MessageType type;
+            struct timespec time;
+            int level;
+            const char *func;
+            int line;
+            size_t length; /* of text, for raw and output messages */
+            char text[c_messageSize];
+        };
+
+        struct Record
+        {
+            std::atomic<uint64_t> sequence; /* position + 1 once the message is published */
+            Message message;
+        };
+
+        static Record *Claim(uint64_t& position) noexcept;
+        static void Publish(Record *record, uint64_t position) noexcept;
+        static size_t FormatOutput(Message& message, const char *source, pid_t pid, const char *line, size_t size) noexcept;
+        static size_t Format(char *buffer, size_t size, const Message& message) noexcept;
+        static void Drain() noexcept;
+        static bool IsEmpty() noexcept;
+        static void *WriterThread(void *context) noexcept;
+        static void WriteAll(const char *buffer, size_t size) noexcept;
+
+        static std::atomic<int> s_level;
+        static std::atomic<bool> s_isStarted;
+        static std::atomic<bool> s_isStopping;
+        static std::atomic<bool> s_isWriterWaiting;
+        static std::atomic<uint64_t> s_tail; /* next position producers claim */
+        static uint64_t s_head; /* next position the writer consumes */
+        static std::atomic<uint64_t> s_dropped; /* since the writer last reported it */
+        static std::atomic<uint64_t> s_droppedTotal;
+        static std::array<Record, c_recordCount> s_records;
+        static wil::unique_fd s_eventFd;
+        static std::unique_ptr<LogFile> s_file;
+        static pthread_t s_writerThread;
+    };
+}
@@ -0,0 +1,167 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+#include "MetricsServer.h"
+#include "common.h"
+
+constexpr size_t c_maxClients = 8;
+constexpr uint64_t c_requestTimeoutMs = 5000;
+
+void wslgd::MetricsServer::AddSource(std::function<void(std::string&)>&& source)
+{
+    m_sources.push_back(std::move(source));
+}
+
+void wslgd::MetricsServer::Start(const char *path)
+{
+    wil::unique_fd socketFd{socket(AF_UNIX, (SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC), 0)};
+    THROW_LAST_ERROR_IF(!socketFd);
+
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    THROW_ERRNO_IF(ENAMETOOLONG, strlen(path) >= sizeof(address.sun_path));
+    strcpy(address.sun_path, path);
+    unlink(path);
+    THROW_LAST_ERROR_IF(bind(socketFd.get(), reinterpret_cast<const sockaddr*>(&address), sizeof(address)) < 0);
+    THROW_LAST_ERROR_IF(chmod(path, 0666) < 0);
+    THROW_LAST_ERROR_IF(listen(socketFd.get(), SOMAXCONN) < 0);
+
+    m_path = path;
+    m_listenFd = std::move(socketFd);
+    m_loop.AddFd(m_listenFd.get(), EPOLLIN, [this](uint32_t) { HandleAccept(); });
+}
+
+void wslgd::MetricsServer::Stop()
+{
+    while (!m_clients.empty()) {
+        CloseClient(m_clients.begin()->first);
+    }
+
+    if (m_listenFd) {
+        m_loop.RemoveFd(m_listenFd.get());
+        m_listenFd.reset();
+        unlink(m_path.c_str());
+    }
+}
+
+void wslgd::MetricsServer::HandleAccept()
+{
+    for (;;) {
+        wil::unique_fd clientFd(accept4(m_listenFd.get(), nullptr, nullptr, (SOCK_NONBLOCK | SOCK_CLOEXEC)));
+        if (!clientFd) {
+            break;
+        }
+
+        // Anyone in the user distro can connect, each client holds a socket and a timer until it
+        // is answered or times out, so their number is bounded.
+        if (m_clients.size() >= c_maxClients) {
+            LOG_ERROR("too many metrics clients, closing the new connection");
+            continue;
+        }
+
+        int fd = clientFd.get();
+        auto& client = m_clients[fd];
+        client.fd = std::move(clientFd);
+        client.timer = m_loop.AddTimer(c_requestTimeoutMs, [this, fd]() {
+            auto found = m_clients.find(fd);
+            if (found != m_clients.end()) {
+                found->second.timer = -1;
+                CloseClient(fd);
+            }
+        });
+
+        m_loop.AddFd(fd, EPOLLIN, [this, fd](uint32_t) { HandleRequest(fd); });
+    }
+}
+
+void wslgd::MetricsServer::HandleRequest(int fd)
+{
+    // Any request gets the metrics, HTTP requests get them as an HTTP response.
+    std::array<char, 4096> request;
+    auto size = read(fd, request.data(), request.size());
+    if ((size < 0) && (errno == EAGAIN)) {
+        return;
+    }
+
+    std::string body;
+    for (auto &source : m_sources) {
+        try {
+            source(body);
+        }
+        CATCH_LOG();
+    }
+
+    std::string response;
+    if ((size >= 4) && (strncmp(request.data(), "GET ", 4) == 0)) {
+        response = "HTTP/1.0 200 OK\r\n"
+            "Content-Type: text/plain; version=0.0.4\r\n"
+            "Content-Length: " + std::to_string(body.size()) + "\r\n"
+            "\r\n";
+    }
+
+    response += body;
+
+    // The response is small enough for the socket buffer, whatever does not fit is dropped.
+    send(fd, response.data(), response.size(), MSG_NOSIGNAL);
+    CloseClient(fd);
+}
+
+void wslgd::MetricsServer::CloseClient(int fd)
+{
+    auto found = m_clients.find(fd);
+    if (found == m_clients.end()) {
+        return;
+    }
+
+    if (found->second.timer >= 0) {
+        m_loop.CancelTimer(found->second.timer);
+    }
+
+    m_loop.RemoveFd(fd);
+    m_clients.erase(found);
+}
+
+void wslgd::MetricsServer::Describe(std::string& out, const char *name, const char *type, const char *help)
+{
+    out += "# HELP ";
+    out += name;
+    out += " ";
+    out += help;
+    out += "\n# TYPE ";
+    out += name;
+    out += " ";
+    out += type;
+    out += "\n";
+}
+
+void wslgd::MetricsServer::Add(std::string& out, const char *name, const std::string& labels, double value)
+{
+    std::array<char, 64> buffer;
+    snprintf(buffer.data(), buffer.size(), "%.15g", value);
+    out += name;
+    if (!labels.empty()) {
+        out += "{" + labels + "}";
+    }
+
+    out += " ";
+    out += buffer.data();
+    out += "\n";
+}
+
+std::string wslgd::MetricsServer::Label(const char *name, const std::string& value)
+{
+    std::string label(name);
+    label += "=\"";
+    for (char c : value) {
+        if ((c == '\\') || (c == '"')) {
+            label += '\\';
+            label += c;
+        } else if (c == '\n') {
+            label += "\\n";
+        } else {
+            label += c;
+        }
+    }
+
+    label += "\"";
+    return label;
+}
@@ -0,0 +1,44 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+#pragma once
+#include "precomp.h"
+#include "EventLoop.h"
+
+namespace wslgd
+{
+    // Serves metrics in the Prometheus text format on a Unix socket, e.g.
+    // curl --unix-socket /mnt/wslg/wslgd-metrics.sock http://localhost/metrics
+    class MetricsServer
+    {
+    public:
+        MetricsServer(EventLoop& loop) : m_loop(loop) {}
+        ~MetricsServer() { Stop(); }
+        MetricsServer(const MetricsServer&) = delete;
+        void operator=(const MetricsServer&) = delete;
+
+        void AddSource(std::function<void(std::string&)>&& source);
+        void Start(const char *path);
+        void Stop();
+
+        static void Describe(std::string& out, const char *name, const char *type, const char *help);
+        static void Add(std::string& out, const char *name, const std::string& labels, double value);
+        static std::string Label(const char *name, const std::string& value);
+
+    private:
+        struct Client
+        {
+            wil::unique_fd fd;
+            int timer = -1; /* closes clients that never send a request */
+        };
+
+        void HandleAccept();
+        void HandleRequest(int fd);
+        void CloseClient(int fd);
+
+        EventLoop& m_loop;
+        std::string m_path;
+        wil::unique_fd m_listenFd;
+        std::vector<std::function<void(std::string&)>> m_sources{};
+        std::map<int, Client> m_clients{};
+    };
+}
@@ -0,0 +1,162 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+#include "PathTranslator.h"
+#include "common.h"
+#include "Trace.h"
+
+constexpr auto c_mountInfo = "/proc/self/mountinfo";
+constexpr auto c_drvfsPathOption = "path=";
+
+namespace {
+
+// Decode the octal escapes (\040, \134, ...) used by /proc/self/mountinfo.
+std::string UnescapeMountField(const char *field)
+{
+    std::string result;
+    for (const char *p = field; *p; p++) {
+        if ((p[0] == '\\') &&
+            (p[1] >= '0' && p[1] <= '7') &&
+            (p[2] >= '0' && p[2] <= '7') &&
+            (p[3] >= '0' && p[3] <= '7')) {
+            result += static_cast<char>(((p[1] - '0') << 6) | ((p[2] - '0') << 3) | (p[3] - '0'));
+            p += 3;
+        } else {
+            result += *p;
+        }
+    }
+
+    return result;
+}
+
+// Returns the lower case drive letter for "X:" or "X:\", or 0 if the string is not a drive root.
+char GetDriveLetter(const std::string& source)
+{
+    if ((source.size() >= 2) && isalpha(static_cast<unsigned char>(source[0])) && (source[1] == ':') &&
+        ((source.size() == 2) || ((source.size() == 3) && ((source[2] == '\\') || (source[2] == '/'))))) {
+        return tolower(static_cast<unsigned char>(source[0]));
+    }
+
+    return 0;
+}
+
+}
+
+wslgd::PathTranslator::PathTranslator() : m_mountInfo(c_mountInfo), m_fallback(TranslateWithWslpath)
+{
+}
+
+wslgd::PathTranslator::PathTranslator(std::string mountInfo, Fallback fallback) :
+    m_mountInfo(std::move(mountInfo)), m_fallback(std::move(fallback))
+{
+}
+
+void wslgd::PathTranslator::LoadDriveMounts()
+{
+    m_isLoaded = true;
+
+    std::unique_ptr<FILE, decltype(&fclose)> file(fopen(m_mountInfo.c_str(), "r"), fclose);
+    THROW_LAST_ERROR_IF(!file);
+
+    char *line = nullptr;
+    size_t lineSize = 0;
+    auto freeLine = wil::scope_exit([&line]() { free(line); });
+    while (getline(&line, &lineSize, file.get()) > 0) {
+        // <id> <parent> <major:minor> <root> <mount point> <options> [optional...] - <fstype> <source> <super options>
+        std::vector<char*> fields;
+        char *savePtr = nullptr;
+        for (char *field = strtok_r(line, " \n", &savePtr); field; field = strtok_r(nullptr, " \n", &savePtr)) {
+            fields.push_back(field);
+        }
+
+        auto separator = std::find_if(fields.begin(), fields.end(), [](char *field) { return strcmp(field, "-") == 0; });
+        if ((fields.size() < 5) || (strcmp(fields[3], "/") != 0) || (std::distance(separator, fields.end()) < 4)) {
+            continue;
+        }
+
+        // drvfs over 9p reports the drive as the mount source, other transports only in the "path=" option.
+        std::string source = UnescapeMountField(*(separator + 2));
+        char driveLetter = GetDriveLetter(source);
+        if (!driveLetter) {
+            std::string options = UnescapeMountField(*(separator + 3));
+            for (size_t start = 0; !driveLetter && (start < options.size());) {
+                size_t end = options.find_first_of(",;", start);
+                if (end == std::string::npos) {
+                    end = options.size();
+                }
+
+                if (options.compare(start, strlen(c_drvfsPathOption), c_drvfsPathOption) == 0) {
+                    start += strlen(c_drvfsPathOption);
+                    driveLetter = GetDriveLetter(options.substr(start, end - start));
+                }
+
+                start = end + 1;
+            }
+        }
+
+        if (!driveLetter) {
+            continue;
+        }
+
+        // The user distro's own drive mounts show up under the shared mount as well, keep the shortest path.
+        std::string mountPoint = UnescapeMountField(fields[4]);
+        auto found = m_driveMounts.find(driveLetter);
+        if ((found == m_driveMounts.end()) || (mountPoint.size() < found->second.size())) {
+            m_driveMounts[driveLetter] = std::move(mountPoint);
+        }
+    }
+}
+
+std::string wslgd::PathTranslator::Translate(const char *windowsPath)
+{
+    try {
+        if (!m_isLoaded) {
+            LoadDriveMounts();
+        }
+
+        // Only absolute drive paths are translated here, e.g. UNC paths are left to wslpath.
+        std::string path(windowsPath);
+        char driveLetter = GetDriveLetter(path.substr(0, 2));
+        if (driveLetter && ((path.size() == 2) || (path[2] == '\\') || (path[2] == '/'))) {
+            auto found = m_driveMounts.find(driveLetter);
+            if (found != m_driveMounts.end()) {
+                std::string result(found->second);
+                for (size_t i = 2; i < path.size(); i++) {
+                    char c = (path[i] == '\\') ? '/' : path[i];
+                    if ((c != '/') || (result.back() != '/')) {
+                        result += c;
+                    }
+                }
+
+                return result;
+            }
+        }
+    }
+    CATCH_LOG();
+
+    LOG_INFO("falling back to wslpath for %s", windowsPath);
+    return m_fallback(windowsPath);
+}
+
+std::string wslgd::PathTranslator::TranslateWithWslpath(const char *windowsPath)
+{
+    std::string commandLine = "/usr/bin/wslpath -a \"";
+    commandLine += windowsPath;
+    commandLine += "\"";
+    std::array<char, 128> buffer;
+    std::string result;
+    wslgd::Trace::Increment("fork");
+    std::unique_ptr<FILE, decltype(&pclose)> pipe(popen(commandLine.c_str(), "r"), pclose);
+    THROW_LAST_ERROR_IF(!pipe);
+
+    while (fgets(buffer.data(), buffer.size(), pipe.get()) != nullptr) {
+        result += buffer.data();
+    }
+    /* trim '\n' from wslpath output */
+    while (!result.empty() && (result.back() == '\n')) {
+        result.pop_back();
+    }
+
+    THROW_ERRNO_IF(EINVAL, pclose(pipe.release()) != 0);
+
+    return result;
+}
@@ -0,0 +1,29 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+#pragma once
+#include "precomp.h"
+
+namespace wslgd
+{
+    class PathTranslator
+    {
+    public:
+        using Fallback = std::function<std::string(const char*)>;
+
+        PathTranslator();
+        explicit PathTranslator(std::string mountInfo, Fallback fallback = TranslateWithWslpath); /* read instead of /proc/self/mountinfo */
+        PathTranslator(const PathTranslator&) = delete;
+        void operator=(const PathTranslator&) = delete;
+
+        std::string Translate(const char *windowsPath);
+        static std::string TranslateWithWslpath(const char *windowsPath);
+
+    private:
+        void LoadDriveMounts();
+
+        std::string m_mountInfo;
+        Fallback m_fallback; /* for paths not under a drive mount */
+        std::map<char, std::string> m_driveMounts{}; /* drive letter to Linux mount point */
+        bool m_isLoaded = false;
+    };
+}
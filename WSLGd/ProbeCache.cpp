@@ -0,0 +1,222 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+#include "ProbeCache.h"
+#include "common.h"
+
+constexpr auto c_cacheHeader = "# wslgd probe cache 1";
+
+void wslgd::ProbeCache::Load()
+{
+    // One line per probed path: "<exists> <executable> <size> <sec> <nsec>\t<path>\t<local copy>".
+    std::unique_ptr<FILE, decltype(&fclose)> file(fopen(m_cachePath.c_str(), "re"), fclose);
+    if (!file) {
+        return;
+    }
+
+    char *line = nullptr;
+    size_t lineSize = 0;
+    auto freeLine = wil::scope_exit([&line]() { free(line); });
+    if ((getline(&line, &lineSize, file.get()) < 0) || (strncmp(line, c_cacheHeader, strlen(c_cacheHeader)) != 0)) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(m_lock);
+    ssize_t length;
+    while ((length = getline(&line, &lineSize, file.get())) > 0) {
+        if (line[length - 1] == '\n') {
+            line[length - 1] = '\0';
+        }
+
+        Entry entry;
+        int exists, isExecutable;
+        char *path = strchr(line, '\t');
+        char *localPath = path ? strchr(path + 1, '\t') : nullptr;
+        if (!localPath || (sscanf(line, "%d %d %lld %lld %ld", &exists, &isExecutable,
+                &entry.size, &entry.mtimeSec, &entry.mtimeNsec) != 5)) {
+            continue;
+        }
+
+        *localPath++ = '\0';
+        entry.exists = exists;
+        entry.isExecutable = isExecutable;
+        entry.localPath = localPath;
+        m_entries[path + 1] = std::move(entry);
+    }
+}
+
+bool wslgd::ProbeCache::IsExecutable(const std::string& path)
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    auto entry = Find(path);
+    if (!entry) {
+        entry = &(m_entries[path] = Probe(path));
+        m_isDirty = true;
+        Save();
+    }
+
+    return entry->isExecutable;
+}
+
+void wslgd::ProbeCache::Invalidate(const std::string& path)
+{
+    // The next call probes the path again.
+    std::lock_guard<std::mutex> lock(m_lock);
+    if (m_entries.erase(path) > 0) {
+        m_isDirty = true;
+        Save();
+    }
+}
+
+bool wslgd::ProbeCache::CopyLocal(const std::string& path, const std::string& localPath)
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    auto entry = Find(path);
+    if (entry && (entry->localPath == localPath)) {
+        if (!entry->exists) {
+            return false;
+        }
+
+        if (access(localPath.c_str(), R_OK) == 0) {
+            return true;
+        }
+    }
+
+    // Not copied yet, or the copy went missing.
+    Entry probed = Probe(path);
+    bool isCopied = false;
+    if (probed.exists) {
+        try {
+            Copy(path, localPath);
+            isCopied = true;
+        }
+        CATCH_LOG();
+    }
+
+    // A failed copy is not cached, so it is attempted again on the next call.
+    if (isCopied || !probed.exists) {
+        probed.localPath = localPath;
+        m_entries[path] = std::move(probed);
+        m_isDirty = true;
+        Save();
+    }
+
+    return isCopied;
+}
+
+void wslgd::ProbeCache::Refresh()
+{
+    Wait();
+    m_refreshThread = std::thread([this]() {
+        std::vector<std::pair<std::string, Entry>> entries;
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            entries.assign(m_entries.begin(), m_entries.end());
+        }
+
+        // Probe without holding the lock, the mount can take a while to answer.
+        for (auto &cached : entries) {
+            Entry current = Probe(cached.first);
+            if (IsSameFile(cached.second, current)) {
+                continue;
+            }
+
+            LOG_INFO("%s changed since it was cached, using it from the next start", cached.first.c_str());
+            current.localPath = cached.second.localPath;
+            if (!current.localPath.empty()) {
+                try {
+                    if (current.exists) {
+                        Copy(cached.first, current.localPath);
+                    } else {
+                        unlink(current.localPath.c_str());
+                    }
+                }
+                CATCH_LOG();
+            }
+
+            std::lock_guard<std::mutex> lock(m_lock);
+            m_entries[cached.first] = std::move(current);
+            m_isDirty = true;
+        }
+
+        std::lock_guard<std::mutex> lock(m_lock);
+        Save();
+    });
+}
+
+void wslgd::ProbeCache::Wait()
+{
+    if (m_refreshThread.joinable()) {
+        m_refreshThread.join();
+    }
+}
+
+wslgd::ProbeCache::Entry wslgd::ProbeCache::Probe(const std::string& path)
+{
+    Entry entry;
+    struct stat status;
+    if (stat(path.c_str(), &status) == 0) {
+        entry.exists = true;
+        entry.isExecutable = (access(path.c_str(), X_OK) == 0);
+        entry.size = status.st_size;
+        entry.mtimeSec = status.st_mtim.tv_sec;
+        entry.mtimeNsec = status.st_mtim.tv_nsec;
+    }
+
+    return entry;
+}
+
+bool wslgd::ProbeCache::IsSameFile(const Entry& left, const Entry& right)
+{
+    return (left.exists == right.exists) &&
+           (left.isExecutable == right.isExecutable) &&
+           (left.size == right.size) &&
+           (left.mtimeSec == right.mtimeSec) &&
+           (left.mtimeNsec == right.mtimeNsec);
+}
+
+void wslgd::ProbeCache::Copy(const std::string& path, const std::string& localPath)
+{
+    // Replace the copy at once, so pulseaudio never loads a partial sample.
+    std::filesystem::path destination(localPath);
+    std::filesystem::create_directories(destination.parent_path());
+    std::string temporaryPath = localPath + ".tmp";
+    std::filesystem::copy_file(path, temporaryPath, std::filesystem::copy_options::overwrite_existing);
+    THROW_LAST_ERROR_IF(chmod(temporaryPath.c_str(), 0644) < 0);
+    THROW_LAST_ERROR_IF(rename(temporaryPath.c_str(), localPath.c_str()) < 0);
+}
+
+wslgd::ProbeCache::Entry* wslgd::ProbeCache::Find(const std::string& path)
+{
+    auto found = m_entries.find(path);
+    return (found != m_entries.end()) ? &found->second : nullptr;
+}
+
+void wslgd::ProbeCache::Save()
+{
+    if (!m_isDirty) {
+        return;
+    }
+
+    try {
+        std::filesystem::path path(m_cachePath);
+        std::filesystem::create_directories(path.parent_path());
+        std::string temporaryPath = m_cachePath + ".tmp";
+        {
+            std::unique_ptr<FILE, decltype(&fclose)> file(fopen(temporaryPath.c_str(), "we"), fclose);
+            THROW_LAST_ERROR_IF(!file);
+            fprintf(file.get(), "%s\n", c_cacheHeader);
+            for (auto &entry : m_entries) {
+                fprintf(file.get(), "%d %d %lld %lld %ld\t%s\t%s\n",
+                    entry.second.exists, entry.second.isExecutable,
+                    entry.second.size, entry.second.mtimeSec, entry.second.mtimeNsec,
+                    entry.first.c_str(), entry.second.localPath.c_str());
+            }
+
+            THROW_LAST_ERROR_IF(fflush(file.get()) != 0);
+        }
+
+        THROW_LAST_ERROR_IF(rename(temporaryPath.c_str(), m_cachePath.c_str()) < 0);
+        m_isDirty = false;
+    }
+    CATCH_LOG();
+}
@@ -0,0 +1,49 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+#pragma once
+#include "precomp.h"
+
+namespace wslgd
+{
+    // Results of probing files on the Windows drives, kept across boots so the slow mount is not
+    // touched on the boot critical path. Each result carries the size and mtime it was taken with,
+    // and Refresh() checks them again in the background once boot completes.
+    class ProbeCache
+    {
+    public:
+        ProbeCache(const char *cachePath) : m_cachePath(cachePath) {}
+        ~ProbeCache() { Wait(); }
+        ProbeCache(const ProbeCache&) = delete;
+        void operator=(const ProbeCache&) = delete;
+
+        void Load();
+        bool IsExecutable(const std::string& path);
+        void Invalidate(const std::string& path);
+        bool CopyLocal(const std::string& path, const std::string& localPath);
+        void Refresh();
+        void Wait();
+
+    private:
+        struct Entry
+        {
+            bool exists = false;
+            bool isExecutable = false;
+            long long size = 0;
+            long long mtimeSec = 0;
+            long mtimeNsec = 0;
+            std::string localPath; /* copy of the file in the system distro, if any */
+        };
+
+        static Entry Probe(const std::string& path);
+        static bool IsSameFile(const Entry& left, const Entry& right);
+        static void Copy(const std::string& path, const std::string& localPath);
+        Entry* Find(const std::string& path);
+        void Save();
+
+        std::string m_cachePath;
+        std::mutex m_lock; /* protects m_entries against the refresh thread */
+        std::map<std::string, Entry> m_entries{}; /* by probed path */
+        bool m_isDirty = false;
+        std::thread m_refreshThread;
+    };
+}
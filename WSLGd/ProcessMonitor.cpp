@@ -2,10 +2,16 @@
 // Licensed under the MIT license.
 #include "ProcessMonitor.h"
 #include "common.h"
+#include "Trace.h"
+#include "Logger.h"
+#include "MetricsServer.h"
 
-wslgd::ProcessMonitor::ProcessMonitor(const char* userName)
+wslgd::ProcessMonitor::ProcessMonitor(const char* userName, EventLoop& loop) : m_loop(loop), m_random(time(nullptr))
 {
     THROW_ERRNO_IF(ENOENT, !(m_user = getpwnam(userName)));
+
+    // Each child is watched through its pidfd, SIGCHLD only catches children launched elsewhere.
+    m_loop.AddSignal(SIGCHLD, [this](const signalfd_siginfo&) { ReapChildren(); });
 }
 
 passwd* wslgd::ProcessMonitor::GetUserInfo() const
@@ -15,122 +21,1124 @@ passwd* wslgd::ProcessMonitor::GetUserInfo() const
 
 extern char **environ;
 
+constexpr auto c_notifyDir = "/run/wslgd";
+constexpr uint64_t c_listenPollMs = 50;
+constexpr int c_listenFdsStart = 3; /* SD_LISTEN_FDS_START */
+
+// Child output is logged a line at a time, a chatty child is throttled to this rate.
+constexpr double c_outputLinesPerSecond = 100;
+constexpr double c_outputBurstLines = 200;
+constexpr size_t c_outputMaxLine = 4096;
+constexpr int c_outputReadsPerEvent = 16;
+
+constexpr uint64_t c_stopTimeoutMs = 5000;
+
+// ioprio_set() values from linux/ioprio.h.
+constexpr int c_ioprioWhoProcess = 1;
+constexpr int c_ioprioIdle = (3 << 13);
+
+static uint64_t GetTimeMs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (static_cast<uint64_t>(ts.tv_sec) * 1000) + (ts.tv_nsec / 1000000);
+}
+
+// Kernel capset ABI, version 3 carries 64 capability bits in two words.
+constexpr uint32_t c_capabilityVersion3 = 0x20080522;
+constexpr int c_capabilityWords = 2;
+
+namespace {
+
+struct CapabilityHeader
+{
+    uint32_t version;
+    int pid;
+};
+
+struct CapabilityData
+{
+    uint32_t effective;
+    uint32_t permitted;
+    uint32_t inheritable;
+};
+
+// Everything the child needs is prepared by the parent, so the child runs in the parent's
+// memory (CLONE_VM | CLONE_VFORK) without allocating and only makes raw system calls until exec.
+struct SpawnContext
+{
+    const char *path;
+    char *const *argv;
+    char *const *envp;
+    uid_t uid;
+    gid_t gid;
+    const gid_t *groups;
+    size_t groupCount;
+    const char *workingDirectory;
+    bool hasCapabilities;
+    CapabilityHeader capHeader;
+    CapabilityData capData[c_capabilityWords];
+    const cap_value_t *ambient;
+    size_t ambientCount;
+    bool hasCredentials; /* switch to uid, gid and groups, helpers keep WSLGd's own */
+    bool isIdle; /* idle CPU and I/O priority */
+    sigset_t childMask;
+    int outputFd; /* becomes stdout and stderr, -1 keeps WSLGd's */
+    int listenFd; /* socket passed as the first LISTEN_FDS descriptor, -1 if none */
+    char *listenPidEnv; /* "LISTEN_PID=" followed by room for the child's pid */
+    const char *failedStep; /* set by the child when it fails before exec */
+    int error;
+};
+
+int SpawnChild(void *context)
+{
+    auto spawn = reinterpret_cast<SpawnContext*>(context);
+
+    // Signal handlers are not shared, reset any caught signal before unblocking.
+    for (int sig = 1; sig < _NSIG; sig++) {
+        struct sigaction action;
+        if ((sigaction(sig, nullptr, &action) == 0) &&
+            (action.sa_handler != SIG_DFL) && (action.sa_handler != SIG_IGN)) {
+            action.sa_handler = SIG_DFL;
+            sigaction(sig, &action, nullptr);
+        }
+    }
+
+    // N.B. setuid and friends go straight to the kernel, the libc wrappers would try to
+    //      synchronize credentials with the parent's other threads.
+#define SPAWN_STEP(step, condition) if (condition) { spawn->failedStep = step; goto failed; }
+    SPAWN_STEP("setpgid", setpgid(0, 0) < 0);
+    if (spawn->outputFd >= 0) {
+        SPAWN_STEP("dup2", dup2(spawn->outputFd, STDOUT_FILENO) < 0);
+        SPAWN_STEP("dup2", dup2(spawn->outputFd, STDERR_FILENO) < 0);
+    }
+
+    if (spawn->listenFd >= 0) {
+        // Socket activation, see sd_listen_fds(3).
+        SPAWN_STEP("dup2", dup2(spawn->listenFd, c_listenFdsStart) < 0);
+        SPAWN_STEP("fcntl", fcntl(c_listenFdsStart, F_SETFD, 0) < 0);
+        char digits[16];
+        int count = 0;
+        for (long pid = syscall(SYS_getpid); pid > 0; pid /= 10) {
+            digits[count++] = '0' + (pid % 10);
+        }
+
+        char *p = spawn->listenPidEnv + strlen("LISTEN_PID=");
+        while (count > 0) {
+            *p++ = digits[--count];
+        }
+
+        *p = '\0';
+    }
+
+    if (spawn->isIdle) {
+        // The I/O priority is a hint, not every scheduler has an idle class.
+        struct sched_param param = {};
+        SPAWN_STEP("sched_setscheduler", syscall(SYS_sched_setscheduler, 0, SCHED_IDLE, &param) < 0);
+        syscall(SYS_ioprio_set, c_ioprioWhoProcess, 0, c_ioprioIdle);
+    }
+
+    if (spawn->hasCredentials) {
+        SPAWN_STEP("prctl(PR_SET_KEEPCAPS)", spawn->hasCapabilities && (prctl(PR_SET_KEEPCAPS, 1) < 0));
+        SPAWN_STEP("setgid", syscall(SYS_setgid, spawn->gid) < 0);
+        SPAWN_STEP("setgroups", syscall(SYS_setgroups, spawn->groupCount, spawn->groups) < 0);
+        SPAWN_STEP("setuid", syscall(SYS_setuid, spawn->uid) < 0);
+        SPAWN_STEP("chdir", chdir(spawn->workingDirectory) < 0);
+    }
+
+    SPAWN_STEP("capset", spawn->hasCapabilities && (syscall(SYS_capset, &spawn->capHeader, spawn->capData) < 0));
+    for (size_t i = 0; i < spawn->ambientCount; i++) {
+        SPAWN_STEP("prctl(PR_CAP_AMBIENT)", prctl(PR_CAP_AMBIENT, PR_CAP_AMBIENT_RAISE, spawn->ambient[i], 0, 0) < 0);
+    }
+#undef SPAWN_STEP
+
+    sigprocmask(SIG_SETMASK, &spawn->childMask, nullptr);
+    execve(spawn->path, spawn->argv, spawn->envp);
+    spawn->failedStep = "execve";
+    spawn->error = errno;
+
+    // Exit like a shell does for a command it cannot run, so the status tells why.
+    _exit((spawn->error == ENOENT) ? 127 : ((spawn->error == EACCES) ? 126 : 1));
+
+failed:
+    spawn->error = errno;
+    _exit(1);
+}
+
+// Resolve the executable the way execvp would, before the child is created.
+std::string ResolveExecutable(const std::string& file)
+{
+    if (file.find('/') != std::string::npos) {
+        return file;
+    }
+
+    const char *searchPath = getenv("PATH");
+    std::string paths(searchPath ? searchPath : "/usr/bin:/bin");
+    for (size_t start = 0; start <= paths.size();) {
+        size_t end = paths.find(':', start);
+        if (end == std::string::npos) {
+            end = paths.size();
+        }
+
+        std::string candidate(paths, start, end - start);
+        candidate += "/";
+        candidate += file;
+        if (access(candidate.c_str(), X_OK) == 0) {
+            return candidate;
+        }
+
+        start = end + 1;
+    }
+
+    return file;
+}
+
+// Creates the child and returns once it has exec'd or failed, see SpawnChild.
+int Spawn(SpawnContext& spawn, wil::unique_fd& pidFd)
+{
+    // Block all signals so nothing runs on the shared stack until the child has exec'd.
+    std::vector<char> stack(64 * 1024);
+    sigset_t allSignals, oldMask;
+    sigfillset(&allSignals);
+    THROW_LAST_ERROR_IF(pthread_sigmask(SIG_SETMASK, &allSignals, &oldMask) != 0);
+    auto restoreMask = wil::scope_exit([&oldMask]() { pthread_sigmask(SIG_SETMASK, &oldMask, nullptr); });
+
+    int childPid;
+    int childPidFd = -1;
+    wslgd::Trace::Increment("fork");
+    THROW_LAST_ERROR_IF((childPid = clone(SpawnChild, stack.data() + stack.size(), CLONE_VM | CLONE_VFORK | CLONE_PIDFD | SIGCHLD, &spawn, &childPidFd)) < 0);
+    pidFd.reset(childPidFd);
+    return childPid;
+}
+
+}
+
 int wslgd::ProcessMonitor::LaunchProcess(
+    std::string&& name,
     std::vector<std::string>&& argv,
     std::vector<cap_value_t>&& capabilities,
     std::vector<std::string>&& env)
 {
-    int childPid;
-    THROW_LAST_ERROR_IF((childPid = fork()) < 0);
+    uint64_t traceStart = wslgd::Trace::IsEnabled() ? wslgd::Trace::Now() : 0;
+    SpawnContext spawn{};
+    auto& service = GetServiceState(name);
+
+    // Construct a null-terminated argument array, behind the wrapper if any. The wrapper is not
+    // part of the saved command line, so every launch asks for the current one.
+    std::vector<std::string> wrapper;
+    if (service.wrapper) {
+        wrapper = service.wrapper();
+    }
+
+    std::vector<char*> arguments;
+    for (auto &arg : wrapper) {
+        arguments.push_back(const_cast<char*>(arg.c_str()));
+    }
+    for (auto &arg : argv) {
+        arguments.push_back(const_cast<char*>(arg.c_str()));
+    }
+
+    THROW_INVALID_IF(arguments.empty());
+    std::string path = ResolveExecutable(arguments[0]);
+    arguments.push_back(nullptr);
 
-    if (childPid == 0) try {
-        // Construct a null-terminated argument array.
-        std::vector<const char*> arguments;
-        for (auto &arg : argv) {
-            arguments.push_back(arg.c_str());
+    // Construct a null-terminated environment array.
+    std::vector<char*> environments;
+    for (char **c = environ; *c; c++) {
+        environments.push_back(*c);
+    }
+    for (auto &s : env) {
+        if (s.size()) {
+            environments.push_back(const_cast<char*>(s.c_str()));
         }
+    }
 
-        arguments.push_back(nullptr);
+    service.launches++;
+    std::string notifySocketEnv;
+    if (service.readiness.mode == ReadyMode::Notify) {
+        notifySocketEnv = "NOTIFY_SOCKET=" + service.readiness.socketPath;
+        environments.push_back(const_cast<char*>(notifySocketEnv.c_str()));
+    }
 
-        // If any capabilities were specified, set the keepcaps flag so they are not lost across setuid.
-        if (!capabilities.empty()) {
-            THROW_LAST_ERROR_IF(prctl(PR_SET_KEEPCAPS, 1) < 0);
+    // The child fills in LISTEN_PID itself, its pid is not known before it exists.
+    std::string listenFdsEnv("LISTEN_FDS=1");
+    std::string listenFdNamesEnv("LISTEN_FDNAMES=" + name);
+    std::string listenPidEnv("LISTEN_PID=");
+    listenPidEnv.resize(listenPidEnv.size() + 16, '\0');
+    spawn.listenFd = -1;
+    if (service.activationFd) {
+        spawn.listenFd = service.activationFd.get();
+        spawn.listenPidEnv = &listenPidEnv[0];
+        environments.push_back(const_cast<char*>(listenFdsEnv.c_str()));
+        environments.push_back(const_cast<char*>(listenFdNamesEnv.c_str()));
+        environments.push_back(const_cast<char*>(listenPidEnv.c_str()));
+    }
+
+    environments.push_back(nullptr);
+
+    // Resolve user settings, the equivalent of initgroups is applied by the child.
+    int groupCount = 0;
+    getgrouplist(m_user->pw_name, m_user->pw_gid, nullptr, &groupCount);
+    std::vector<gid_t> groups(groupCount);
+    THROW_LAST_ERROR_IF(getgrouplist(m_user->pw_name, m_user->pw_gid, groups.data(), &groupCount) < 0);
+    groups.resize(groupCount);
+
+    // Additional capabilities are kept across setuid and raised to the ambient set, so they survive exec.
+    if (!capabilities.empty()) {
+        spawn.hasCapabilities = true;
+        spawn.capHeader.version = c_capabilityVersion3;
+        for (auto &cap : capabilities) {
+            THROW_INVALID_IF((cap < 0) || (cap >= (c_capabilityWords * 32)));
+            auto &data = spawn.capData[cap / 32];
+            uint32_t mask = 1u << (cap % 32);
+            data.permitted |= mask;
+            data.effective |= mask;
+            data.inheritable |= mask;
         }
+    }
+
+    spawn.path = path.c_str();
+    spawn.argv = arguments.data();
+    spawn.envp = environments.data();
+    spawn.uid = m_user->pw_uid;
+    spawn.gid = m_user->pw_gid;
+    spawn.groups = groups.data();
+    spawn.groupCount = groups.size();
+    spawn.workingDirectory = m_user->pw_dir;
+    spawn.hasCredentials = true;
+    spawn.ambient = capabilities.data();
+    spawn.ambientCount = capabilities.size();
+    sigemptyset(&spawn.childMask);
+
+    // Capture stdout and stderr, so every line is attributed to its service.
+    int outputPipe[2];
+    THROW_LAST_ERROR_IF(pipe2(outputPipe, O_CLOEXEC) < 0);
+    wil::unique_fd outputRead(outputPipe[0]);
+    wil::unique_fd outputWrite(outputPipe[1]);
+    THROW_LAST_ERROR_IF(fcntl(outputRead.get(), F_SETFL, O_NONBLOCK) < 0);
+    spawn.outputFd = outputWrite.get();
+
+    wil::unique_fd childPidFd;
+    int childPid = Spawn(spawn, childPidFd);
+    outputWrite.reset();
+
+    // The child has either exec'd or exited by now; a failed child is reaped and handled by Run().
+    if (spawn.failedStep) {
+        LOG_ERROR("failed to launch %s, %s: %s", name.c_str(), spawn.failedStep, strerror(spawn.error));
+    }
+
+    if (traceStart) {
+        wslgd::Trace::AddSpan("LaunchProcess " + name, "launch", traceStart, wslgd::Trace::Now());
+    }
+
+    // N.B. The pipe outlives the child when its own children inherit it, e.g. Xwayland from weston.
+    int outputFd = outputRead.get();
+    m_outputs[outputFd] = OutputStream{name, childPid, std::move(outputRead), {}};
+    m_loop.AddFd(outputFd, EPOLLIN, [this, outputFd](uint32_t) { HandleOutput(outputFd); });
+
+    m_loop.AddFd(childPidFd.get(), EPOLLIN, [this, childPid](uint32_t) { HandlePidFd(childPid); });
+    auto& child = m_children[childPid];
+    child = ProcessInfo{std::move(name), std::move(argv), std::move(capabilities), std::move(env), std::move(wrapper), std::move(childPidFd), GetTimeMs()};
+    ArmReadiness(childPid, child);
+    return childPid;
+}
 
-        // Construct a null-terminated environment array.
-        std::vector<const char*> environments;
-        for (char **c = environ; *c; c++) {
-            environments.push_back(*c);
+void wslgd::ProcessMonitor::HandlePidFd(int pid)
+{
+    int status;
+    struct rusage usage;
+    if (wait4(pid, &status, WNOHANG, &usage) == pid) {
+        HandleExit(pid, status, usage);
+    }
+}
+
+void wslgd::ProcessMonitor::ReapChildren()
+{
+    // Reap anything that exited, including children not launched through the monitor.
+    int pid;
+    int status;
+    struct rusage usage;
+    while ((pid = wait4(-1, &status, WNOHANG, &usage)) > 0) {
+        HandleExit(pid, status, usage);
+    }
+}
+
+void wslgd::ProcessMonitor::HandleExit(int pid, int status, const struct rusage& usage)
+{
+    auto found = m_children.find(pid);
+    if (found == m_children.end()) {
+        if (m_helpers.count(pid)) {
+            HandleHelperExit(pid, status);
+            return;
         }
-        for (auto &s : env) {
-            if (s.size()) {
-                environments.push_back(s.c_str());
-            }
+
+        LOG_INFO("untracked pid %d exited with status 0x%x.", pid, status);
+        return;
+    }
+
+    // Stop tracking the exited child before it is relaunched, its pid may be reused right away.
+    ProcessInfo info = std::move(found->second);
+    m_children.erase(found);
+    m_loop.RemoveFd(info.pidFd.get());
+    CancelReadiness(info);
+    if (info.stopTimer >= 0) {
+        m_loop.CancelTimer(info.stopTimer);
+    }
+
+    if (info.argv.empty()) {
+        return;
+    }
+
+    std::string cmd;
+    for (auto &arg : info.argv) {
+        cmd += arg.c_str();
+        cmd += " ";
+    }
+
+    auto& service = GetServiceState(info.name);
+    service.cpuUserSeconds += usage.ru_utime.tv_sec + (usage.ru_utime.tv_usec / 1e6);
+    service.cpuSystemSeconds += usage.ru_stime.tv_sec + (usage.ru_stime.tv_usec / 1e6);
+    if (WIFEXITED(status)) {
+        service.exitReasons[{"exited", WEXITSTATUS(status)}]++;
+    } else if (WIFSIGNALED(status)) {
+        service.exitReasons[{"signaled", WTERMSIG(status)}]++;
+    }
+
+    if (WIFEXITED(status)) {
+        LOG_INFO("%s pid %d exited with status %d, %s", info.name.c_str(), pid, WEXITSTATUS(status), cmd.c_str());
+    } else if (WIFSIGNALED(status)) {
+        LOG_INFO("%s pid %d terminated with signal %d, %s", info.name.c_str(), pid, WTERMSIG(status), cmd.c_str());
+    } else {
+        LOG_ERROR("%s pid %d return unknown status %d, %s", info.name.c_str(), pid, status, cmd.c_str());
+    }
+
+    if (m_exitCallback) {
+        m_exitCallback(info.name, status);
+    }
+
+    // A socket activated service exiting cleanly went idle, it is started again by the next client.
+    if (service.activationFd && WIFEXITED(status) && (WEXITSTATUS(status) == 0)) {
+        service.exits = 0;
+        service.isRestartRequested = false;
+        service.pending = std::move(info);
+        WaitForActivation(service.pending.name);
+        return;
+    }
+
+    ScheduleRestart(std::move(info));
+}
+
+wslgd::ProcessMonitor::ServiceState& wslgd::ProcessMonitor::GetServiceState(const std::string& name)
+{
+    auto found = m_services.find(name);
+    if (found == m_services.end()) {
+        ServiceState state;
+        state.policy = m_defaultPolicy;
+        state.outputTokens = c_outputBurstLines;
+        state.outputRefillMs = GetTimeMs();
+        found = m_services.emplace(name, std::move(state)).first;
+    }
+
+    return found->second;
+}
+
+void wslgd::ProcessMonitor::HandleOutput(int fd)
+{
+    auto found = m_outputs.find(fd);
+    if (found == m_outputs.end()) {
+        return;
+    }
+
+    // Bound the work per event, whatever is left is read on the next one.
+    auto& stream = found->second;
+    std::array<char, 4096> buffer;
+    ssize_t size = 0;
+    for (int reads = 0; reads < c_outputReadsPerEvent; reads++) {
+        size = read(fd, buffer.data(), buffer.size());
+        if (size <= 0) {
+            break;
         }
 
-        environments.push_back(nullptr);
-
-        // Set user settings.
-        THROW_LAST_ERROR_IF(setgid(m_user->pw_gid) < 0);
-        THROW_LAST_ERROR_IF(initgroups(m_user->pw_name, m_user->pw_gid) < 0);
-        THROW_LAST_ERROR_IF(setuid(m_user->pw_uid) < 0);
-        THROW_LAST_ERROR_IF(chdir(m_user->pw_dir) < 0);
-
-        // Apply additional capabilities to the process.
-        if (!capabilities.empty()) {
-            cap_t caps{};
-            THROW_LAST_ERROR_IF((caps = cap_get_proc()) == NULL);
-            auto freeCapabilities = wil::scope_exit([&caps]() { cap_free(caps); });
-            THROW_LAST_ERROR_IF(cap_set_flag(caps, CAP_PERMITTED, capabilities.size(), capabilities.data(), CAP_SET) < 0);
-            THROW_LAST_ERROR_IF(cap_set_flag(caps, CAP_EFFECTIVE, capabilities.size(), capabilities.data(), CAP_SET) < 0);
-            THROW_LAST_ERROR_IF(cap_set_flag(caps, CAP_INHERITABLE, capabilities.size(), capabilities.data(), CAP_SET) < 0);
-            THROW_LAST_ERROR_IF(cap_set_proc(caps) < 0);
-            for (auto &cap : capabilities) {
-                THROW_LAST_ERROR_IF(cap_set_ambient(cap, CAP_SET) < 0);
+        const char *start = buffer.data();
+        const char *end = start + size;
+        for (const char *newline; (newline = static_cast<const char*>(memchr(start, '\n', end - start)));) {
+            if (stream.partial.empty()) {
+                WriteOutputLine(stream, start, newline - start);
+            } else {
+                stream.partial.append(start, newline - start);
+                WriteOutputLine(stream, stream.partial.data(), stream.partial.size());
+                stream.partial.clear();
             }
+
+            start = newline + 1;
         }
 
-        // Run the process as the specified user.
-        THROW_LAST_ERROR_IF(execvpe(arguments[0], const_cast<char *const *>(arguments.data()), const_cast<char *const *>(environments.data())) < 0);
+        stream.partial.append(start, end - start);
+        if (stream.partial.size() >= c_outputMaxLine) {
+            WriteOutputLine(stream, stream.partial.data(), stream.partial.size());
+            stream.partial.clear();
+        }
     }
-    CATCH_LOG();
 
-    // Ensure that the child process exits.
-    if (childPid == 0) {
-        _exit(1);
+    // Every writer is gone, including anything the child passed its output to.
+    if ((size == 0) || ((size < 0) && (errno != EAGAIN) && (errno != EINTR))) {
+        if (!stream.partial.empty()) {
+            WriteOutputLine(stream, stream.partial.data(), stream.partial.size());
+        }
+
+        ReportSuppressedOutput(stream);
+        m_loop.RemoveFd(fd);
+        m_outputs.erase(found);
     }
+}
 
-    m_children[childPid] = ProcessInfo{std::move(argv), std::move(capabilities), std::move(env)};
-    return childPid;
+void wslgd::ProcessMonitor::WriteOutputLine(OutputStream& stream, const char *line, size_t size)
+{
+    // Token bucket per service, shared by its restarts so a crash loop cannot reset it.
+    auto& service = GetServiceState(stream.name);
+    auto now = GetTimeMs();
+    service.outputTokens = std::min(c_outputBurstLines,
+        service.outputTokens + (((now - service.outputRefillMs) * c_outputLinesPerSecond) / 1000));
+    service.outputRefillMs = now;
+    if (service.outputTokens < 1) {
+        service.outputSuppressed++;
+        service.outputSuppressedTotal++;
+        return;
+    }
+
+    service.outputTokens -= 1;
+    ReportSuppressedOutput(stream);
+    wslgd::Logger::WriteOutput(stream.name.c_str(), stream.pid, line, size);
 }
 
-int wslgd::ProcessMonitor::Run() try {
-    std::map<std::string, std::vector<time_t>> crashes;
-
-    for (;;) {
-        // Reap any zombie child processes and re-launch any tracked processes.
-        int pid;
-        int status;
-
-        /* monitor only processes within same group as caller */
-        THROW_LAST_ERROR_IF((pid = waitpid(0, &status, 0)) <= 0);
-
-        auto found = m_children.find(pid);
-        if (found != m_children.end()) {
-            if (!found->second.argv.empty()) {
-                std::string cmd;
-                for (auto &arg : found->second.argv) {
-                    cmd += arg.c_str();
-                    cmd += " ";
-                }
+void wslgd::ProcessMonitor::ReportSuppressedOutput(OutputStream& stream)
+{
+    auto& service = GetServiceState(stream.name);
+    if (service.outputSuppressed > 0) {
+        std::string message("(" + std::to_string(service.outputSuppressed) + " lines suppressed)");
+        wslgd::Logger::WriteOutput(stream.name.c_str(), stream.pid, message.data(), message.size());
+        service.outputSuppressed = 0;
+    }
+}
 
-                if (WIFEXITED(status)) {
-                    LOG_INFO("pid %d exited with status %d, %s", pid, WEXITSTATUS(status), cmd.c_str());
-                } else if (WIFSIGNALED(status)) {
-                    LOG_INFO("pid %d terminated with signal %d, %s", pid, WTERMSIG(status), cmd.c_str());
-                } else {
-                    LOG_ERROR("pid %d return unknown status %d, %s", pid, status, cmd.c_str());
-                }
+namespace {
 
-                auto& crashTimestamps = crashes[cmd];
-                auto now = time(nullptr);
-                crashTimestamps.erase(std::remove_if(crashTimestamps.begin(), crashTimestamps.end(), [&](auto ts) { return ts < now - 60; }), crashTimestamps.end());
-                crashTimestamps.emplace_back(now);
+// User and system time of a running process, from /proc/<pid>/stat.
+bool ReadProcessTimes(int pid, double& user, double& system)
+{
+    std::string path("/proc/" + std::to_string(pid) + "/stat");
+    std::unique_ptr<FILE, decltype(&fclose)> file(fopen(path.c_str(), "r"), fclose);
+    if (!file) {
+        return false;
+    }
+
+    std::array<char, 1024> buffer;
+    if (!fgets(buffer.data(), buffer.size(), file.get())) {
+        return false;
+    }
+
+    // The command name may contain anything, fields resume after its closing parenthesis.
+    const char *fields = strrchr(buffer.data(), ')');
+    unsigned long long utime, stime;
+    if (!fields || (sscanf(fields + 1, " %*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %llu %llu", &utime, &stime) != 2)) {
+        return false;
+    }
 
-                if (crashTimestamps.size() > 10) {
-                    LOG_INFO("%s exited more than 10 times in 60 seconds, not starting it again", cmd.c_str());
-                } else {
-                    LaunchProcess(std::move(found->second.argv), std::move(found->second.capabilities), std::move(found->second.env));
+    double ticks = sysconf(_SC_CLK_TCK);
+    user = utime / ticks;
+    system = stime / ticks;
+    return true;
+}
+
+}
+
+void wslgd::ProcessMonitor::WriteMetrics(std::string& out)
+{
+    // The current child of each service, if it is running.
+    std::map<std::string, std::pair<int, const ProcessInfo*>> running;
+    for (auto &child : m_children) {
+        running[child.second.name] = {child.first, &child.second};
+    }
+
+    auto now = GetTimeMs();
+    auto forEachService = [&](const char *name, const char *type, const char *help, auto value) {
+        MetricsServer::Describe(out, name, type, help);
+        for (auto &service : m_services) {
+            auto found = running.find(service.first);
+            auto child = (found != running.end()) ? found->second.second : nullptr;
+            int pid = (found != running.end()) ? found->second.first : 0;
+            MetricsServer::Add(out, name, MetricsServer::Label("service", service.first), value(service.second, pid, child));
+        }
+    };
+
+    forEachService("wslgd_service_up", "gauge", "Whether the service has a running process.",
+        [](const ServiceState&, int, const ProcessInfo *child) { return child ? 1.0 : 0.0; });
+    forEachService("wslgd_service_ready", "gauge", "Whether the running process of the service is ready.",
+        [](const ServiceState&, int, const ProcessInfo *child) { return (child && child->isReady) ? 1.0 : 0.0; });
+    forEachService("wslgd_service_uptime_seconds", "gauge", "Time since the running process of the service was launched.",
+        [now](const ServiceState&, int, const ProcessInfo *child) { return child ? (now - child->startTimeMs) / 1000.0 : 0.0; });
+    forEachService("wslgd_service_ready_seconds", "gauge", "Time the service last took from launch to ready.",
+        [](const ServiceState& service, int, const ProcessInfo*) { return service.readyDelayMs / 1000.0; });
+    forEachService("wslgd_service_launches_total", "counter", "Processes launched for the service.",
+        [](const ServiceState& service, int, const ProcessInfo*) { return static_cast<double>(service.launches); });
+    forEachService("wslgd_service_restarts_total", "counter", "Restarts of the service after its process exited.",
+        [](const ServiceState& service, int, const ProcessInfo*) { return static_cast<double>(service.restarts); });
+    forEachService("wslgd_service_output_suppressed_lines_total", "counter", "Lines of output dropped by rate limiting.",
+        [](const ServiceState& service, int, const ProcessInfo*) { return static_cast<double>(service.outputSuppressedTotal); });
+
+    // CPU time of exited processes plus that of the running one.
+    double user;
+    double system;
+    forEachService("wslgd_service_cpu_user_seconds_total", "counter", "User CPU time of the service's processes.",
+        [&](const ServiceState& service, int pid, const ProcessInfo*) {
+            return service.cpuUserSeconds + ((pid && ReadProcessTimes(pid, user, system)) ? user : 0);
+        });
+    forEachService("wslgd_service_cpu_system_seconds_total", "counter", "System CPU time of the service's processes.",
+        [&](const ServiceState& service, int pid, const ProcessInfo*) {
+            return service.cpuSystemSeconds + ((pid && ReadProcessTimes(pid, user, system)) ? system : 0);
+        });
+
+    MetricsServer::Describe(out, "wslgd_service_exits_total", "counter", "Exits of the service's processes by reason.");
+    for (auto &service : m_services) {
+        for (auto &reason : service.second.exitReasons) {
+            MetricsServer::Add(out, "wslgd_service_exits_total",
+                MetricsServer::Label("service", service.first) + "," +
+                MetricsServer::Label("reason", reason.first.first) + "," +
+                MetricsServer::Label("code", std::to_string(reason.first.second)),
+                static_cast<double>(reason.second));
+        }
+    }
+}
+
+void wslgd::ProcessMonitor::SetEnvironmentKeys(const std::string& name, std::vector<std::string>&& keys)
+{
+    GetServiceState(name).environmentKeys = std::move(keys);
+}
+
+void wslgd::ProcessMonitor::SetWrapper(const std::string& name, std::function<std::vector<std::string>()>&& wrapper)
+{
+    GetServiceState(name).wrapper = std::move(wrapper);
+}
+
+void wslgd::ProcessMonitor::SetCommand(const std::string& name, std::function<LaunchCommand()>&& command)
+{
+    GetServiceState(name).command = std::move(command);
+}
+
+std::vector<std::string> wslgd::ProcessMonitor::GetServicesUsing(const std::set<std::string>& keys)
+{
+    std::vector<std::string> names;
+    for (auto &service : m_services) {
+        bool isUsed = std::any_of(keys.begin(), keys.end(), [&service](const std::string& key) {
+            for (auto &pattern : service.second.environmentKeys) {
+                if (!pattern.empty() && (pattern.back() == '*')) {
+                    if (key.compare(0, pattern.size() - 1, pattern, 0, pattern.size() - 1) == 0) {
+                        return true;
+                    }
+                } else if (key == pattern) {
+                    return true;
                 }
             }
 
-            m_children.erase(found);
+            return false;
+        });
 
+        if (isUsed) {
+            names.push_back(service.first);
+        }
+    }
+
+    return names;
+}
+
+void wslgd::ProcessMonitor::RestartService(const std::string& name)
+{
+    auto found = m_services.find(name);
+    THROW_ERRNO_IF(ENOENT, found == m_services.end());
+    auto& service = found->second;
+
+    // Stop the running process, it is restarted without backoff once it exits.
+    for (auto &child : m_children) {
+        if (child.second.name == name) {
+            int pid = child.first;
+            LOG_INFO("restarting %s, stopping pid %d", name.c_str(), pid);
+            service.isRestartRequested = true;
+            THROW_LAST_ERROR_IF((kill(-pid, SIGTERM) < 0) && (errno != ESRCH));
+            if (child.second.stopTimer < 0) {
+                child.second.stopTimer = m_loop.AddTimer(c_stopTimeoutMs, [this, pid]() {
+                    auto found = m_children.find(pid);
+                    if (found != m_children.end()) {
+                        found->second.stopTimer = -1;
+                        LOG_ERROR("%s pid %d did not stop in time, killing it", found->second.name.c_str(), pid);
+                        kill(-pid, SIGKILL);
+                    }
+                });
+            }
+
+            return;
+        }
+    }
+
+    // Otherwise skip what is left of the backoff.
+    THROW_ERRNO_IF(ESRCH, service.restartTimer < 0);
+    LOG_INFO("restarting %s now instead of after its backoff", name.c_str());
+    m_loop.CancelTimer(service.restartTimer);
+    service.restartTimer = -1;
+    service.exits = 0;
+    Relaunch(name);
+}
+
+void wslgd::ProcessMonitor::ListServices(std::string& out)
+{
+    auto now = GetTimeMs();
+    for (auto &service : m_services) {
+        std::string line = service.first;
+        const ProcessInfo *child = nullptr;
+        int pid = 0;
+        for (auto &entry : m_children) {
+            if (entry.second.name == service.first) {
+                pid = entry.first;
+                child = &entry.second;
+                break;
+            }
+        }
+
+        if (child) {
+            line += child->isReady ? " ready" : " starting";
+            if (!child->wrapper.empty()) {
+                line += " wrapper=" + child->wrapper[0];
+            }
+
+            line += " pid=" + std::to_string(pid);
+            line += " uptime=" + std::to_string((now - child->startTimeMs) / 1000) + "s";
+        } else if (service.second.restartTimer >= 0) {
+            line += " restart-pending";
+        } else if (service.second.activationFd) {
+            line += " on-demand";
         } else {
-            LOG_INFO("untracked pid %d exited with status 0x%x.", pid, status);
+            line += " stopped";
+        }
+
+        line += " restarts=" + std::to_string(service.second.restarts);
+        out += line + "\n";
+    }
+}
+
+void wslgd::ProcessMonitor::DumpState(std::string& out)
+{
+    auto now = GetTimeMs();
+    for (auto &child : m_children) {
+        auto& info = child.second;
+        out += "process " + info.name + " pid=" + std::to_string(child.first);
+        out += " ready=" + std::string(info.isReady ? "yes" : "no");
+        out += " uptime=" + std::to_string(now - info.startTimeMs) + "ms";
+        out += " stopping=" + std::string((info.stopTimer >= 0) ? "yes" : "no");
+        out += " argv:";
+        for (auto &arg : info.argv) {
+            out += " " + arg;
+        }
+
+        if (!info.wrapper.empty()) {
+            out += " wrapper:";
+            for (auto &arg : info.wrapper) {
+                out += " " + arg;
+            }
+        }
+
+        out += "\n";
+    }
+
+    const char *readyModes[] = {"started", "notify", "connect", "listen"};
+    for (auto &entry : m_services) {
+        auto& service = entry.second;
+        out += "service " + entry.first;
+        out += " launches=" + std::to_string(service.launches);
+        out += " restarts=" + std::to_string(service.restarts);
+        out += " exits-in-a-row=" + std::to_string(service.exits);
+        out += " restart-pending=" + std::string((service.restartTimer >= 0) ? "yes" : "no");
+        out += " readiness=" + std::string(readyModes[static_cast<int>(service.readiness.mode)]);
+        out += " ready-delay=" + std::to_string(service.readyDelayMs) + "ms";
+        out += " on-demand=" + std::string(service.activationFd ? "yes" : "no");
+        out += " max-delay=" + std::to_string(service.policy.maxDelayMs) + "ms";
+        out += "\n";
+    }
+
+    for (auto &output : m_outputs) {
+        out += "output " + output.second.name + " pid=" + std::to_string(output.second.pid);
+        out += " buffered=" + std::to_string(output.second.partial.size()) + "\n";
+    }
+}
+
+void wslgd::ProcessMonitor::SetDefaultRestartPolicy(const RestartPolicy& policy)
+{
+    m_defaultPolicy = policy;
+}
+
+void wslgd::ProcessMonitor::SetRestartPolicy(const std::string& name, const RestartPolicy& policy)
+{
+    GetServiceState(name).policy = policy;
+}
+
+void wslgd::ProcessMonitor::ScheduleRestart(ProcessInfo&& info)
+{
+    auto& service = GetServiceState(info.name);
+    auto& policy = service.policy;
+
+    // A child that ran stably is restarted right away, like any one-off crash or a requested restart.
+    if (((GetTimeMs() - info.startTimeMs) >= policy.stableMs) || service.isRestartRequested) {
+        service.exits = 0;
+        service.isRestartRequested = false;
+    }
+
+    service.exits++;
+    service.restarts++;
+    uint64_t delayMs = 0;
+    if (service.exits > policy.maxRestarts) {
+        // Instead of giving up for good, try again after a long pause with a fresh backoff.
+        delayMs = policy.restartLaterMs;
+        service.exits = 0;
+        LOG_INFO("%s exited more than %u times in a row, restarting it later in %llu s",
+            info.name.c_str(), policy.maxRestarts, static_cast<unsigned long long>(delayMs / 1000));
+    } else if (service.exits > 1) {
+        // Exponential backoff with equal jitter, so services crashing together do not restart in lockstep.
+        delayMs = policy.initialDelayMs;
+        for (unsigned int i = 2; (i < service.exits) && (delayMs < policy.maxDelayMs); i++) {
+            delayMs *= 2;
+        }
+
+        delayMs = std::min(delayMs, policy.maxDelayMs);
+        delayMs = (delayMs / 2) + (m_random() % ((delayMs / 2) + 1));
+        LOG_INFO("%s exited %u times in a row, restarting it in %llu ms",
+            info.name.c_str(), service.exits, static_cast<unsigned long long>(delayMs));
+    }
+
+    std::string name = info.name;
+    service.pending = std::move(info);
+    if (delayMs == 0) {
+        Relaunch(name);
+        return;
+    }
+
+    service.restartTimer = m_loop.AddTimer(delayMs, [this, name]() {
+        GetServiceState(name).restartTimer = -1;
+        Relaunch(name);
+    });
+}
+
+void wslgd::ProcessMonitor::Relaunch(const std::string& name)
+{
+    auto& service = GetServiceState(name);
+    if (service.activationFd) {
+        WaitForActivation(name);
+        return;
+    }
+
+    LaunchPending(name);
+}
+
+void wslgd::ProcessMonitor::LaunchPending(const std::string& name)
+{
+    // The command line may refer to variables changed since the last launch, e.g. by a reload of
+    // .wslgconfig, so it is expanded again when the service has a command provider.
+    auto& service = GetServiceState(name);
+    auto pending = std::move(service.pending);
+    try {
+        if (service.command) {
+            auto command = service.command();
+            pending.argv = std::move(command.argv);
+            pending.env = std::move(command.env);
+        }
+
+        LaunchProcess(std::string(pending.name),
+                      std::vector<std::string>(pending.argv),
+                      std::vector<cap_value_t>(pending.capabilities),
+                      std::vector<std::string>(pending.env));
+    } catch (...) {
+        // e.g. clone failing with EAGAIN or an empty command line, retried with backoff like a crash
+        // so the service is never given up on.
+        LOG_CAUGHT_EXCEPTION_MSG(("failed to launch " + name).c_str());
+        pending.startTimeMs = GetTimeMs();
+        ScheduleRestart(std::move(pending));
+    }
+}
+
+void wslgd::ProcessMonitor::SetSocketActivation(const std::string& name, wil::unique_fd&& listenFd)
+{
+    GetServiceState(name).activationFd = std::move(listenFd);
+}
+
+void wslgd::ProcessMonitor::LaunchOnDemand(
+    std::string&& name,
+    std::vector<std::string>&& argv,
+    std::vector<cap_value_t>&& capabilities,
+    std::vector<std::string>&& env)
+{
+    auto& service = GetServiceState(name);
+    THROW_INVALID_IF(!service.activationFd);
+    service.pending.name = std::move(name);
+    service.pending.argv = std::move(argv);
+    service.pending.capabilities = std::move(capabilities);
+    service.pending.env = std::move(env);
+    WaitForActivation(service.pending.name);
+}
+
+void wslgd::ProcessMonitor::WaitForActivation(const std::string& name)
+{
+    // Pending connections stay in the socket's backlog until the service accepts them.
+    auto& service = GetServiceState(name);
+    LOG_INFO("%s will be started by its first client", name.c_str());
+    m_loop.AddFd(service.activationFd.get(), EPOLLIN, [this, name](uint32_t) {
+        auto& service = GetServiceState(name);
+        m_loop.RemoveFd(service.activationFd.get());
+        LOG_INFO("a client connected, starting %s", name.c_str());
+        LaunchPending(name);
+    });
+}
+
+void wslgd::ProcessMonitor::SetReadyCallback(std::function<void(const std::string&)>&& callback)
+{
+    m_readyCallback = std::move(callback);
+}
+
+int wslgd::ProcessMonitor::LaunchHelper(std::vector<std::string>&& argv, bool isIdle, std::function<void(int)>&& onExit)
+{
+    THROW_INVALID_IF(argv.empty());
+    std::vector<char*> arguments;
+    for (auto &arg : argv) {
+        arguments.push_back(const_cast<char*>(arg.c_str()));
+    }
+
+    std::string path = ResolveExecutable(argv[0]);
+    arguments.push_back(nullptr);
+
+    SpawnContext spawn{};
+    spawn.path = path.c_str();
+    spawn.argv = arguments.data();
+    spawn.envp = environ;
+    spawn.isIdle = isIdle;
+    spawn.outputFd = -1;
+    spawn.listenFd = -1;
+    sigemptyset(&spawn.childMask);
+
+    wil::unique_fd pidFd;
+    int pid = Spawn(spawn, pidFd);
+    if (spawn.failedStep) {
+        LOG_ERROR("failed to launch %s, %s: %s", argv[0].c_str(), spawn.failedStep, strerror(spawn.error));
+    }
+
+    m_loop.AddFd(pidFd.get(), EPOLLIN, [this, pid](uint32_t) { HandlePidFd(pid); });
+    m_helpers[pid] = HelperInfo{std::move(pidFd), std::move(onExit)};
+    return pid;
+}
+
+void wslgd::ProcessMonitor::StopHelper(int pid)
+{
+    if (m_helpers.count(pid)) {
+        ReleaseHelper(pid);
+        kill(pid, SIGTERM);
+    }
+}
+
+void wslgd::ProcessMonitor::ReleaseHelper(int pid)
+{
+    // The exit is still reaped, only the callback is dropped.
+    auto found = m_helpers.find(pid);
+    if (found != m_helpers.end()) {
+        found->second.onExit = nullptr;
+    }
+}
+
+void wslgd::ProcessMonitor::HandleHelperExit(int pid, int status)
+{
+    auto found = m_helpers.find(pid);
+    auto onExit = std::move(found->second.onExit);
+    m_loop.RemoveFd(found->second.pidFd.get());
+    m_helpers.erase(found);
+    if (onExit) {
+        onExit(status);
+    }
+}
+
+void wslgd::ProcessMonitor::SetExitCallback(std::function<void(const std::string&, int)>&& callback)
+{
+    m_exitCallback = std::move(callback);
+}
+
+void wslgd::ProcessMonitor::SetReadiness(const std::string& name, const ReadinessPolicy& readiness)
+{
+    auto& service = GetServiceState(name);
+    service.readiness = readiness;
+    if ((readiness.mode != ReadyMode::Notify) && (readiness.mode != ReadyMode::Connect)) {
+        return;
+    }
+
+    // The socket outlives the child, so restarted children report readiness the same way.
+    if (service.readiness.socketPath.empty()) {
+        std::filesystem::create_directories(c_notifyDir);
+        service.readiness.socketPath = c_notifyDir;
+        service.readiness.socketPath += "/" + name + ".notify";
+    }
+
+    struct sockaddr_un addr = {};
+    socklen_t size, name_size;
+
+    addr.sun_family = AF_LOCAL;
+    name_size = snprintf(addr.sun_path, sizeof addr.sun_path,
+                         "%s", service.readiness.socketPath.c_str()) + 1;
+    size = offsetof(struct sockaddr_un, sun_path) + name_size;
+    unlink(addr.sun_path);
+
+    int type = (readiness.mode == ReadyMode::Notify) ? SOCK_DGRAM : SOCK_SEQPACKET;
+    wil::unique_fd socketFd{socket(PF_LOCAL, type | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)};
+    THROW_LAST_ERROR_IF(!socketFd);
+
+    THROW_LAST_ERROR_IF(bind(socketFd.get(), reinterpret_cast<const sockaddr*>(&addr), size) < 0);
+    THROW_LAST_ERROR_IF(chown(addr.sun_path, m_user->pw_uid, m_user->pw_gid) < 0);
+    if (readiness.mode == ReadyMode::Connect) {
+        THROW_LAST_ERROR_IF(listen(socketFd.get(), 1) < 0);
+        m_loop.AddFd(socketFd.get(), EPOLLIN, [this, name](uint32_t) { HandleConnect(name); });
+    } else {
+        m_loop.AddFd(socketFd.get(), EPOLLIN, [this, name](uint32_t) { HandleNotify(name); });
+    }
+
+    service.readyFd = std::move(socketFd);
+}
+
+void wslgd::ProcessMonitor::ArmReadiness(int pid, ProcessInfo& info)
+{
+    auto& readiness = GetServiceState(info.name).readiness;
+    if (readiness.mode == ReadyMode::Started) {
+        info.isReady = true;
+        return;
+    }
+
+    if (readiness.timeoutMs) {
+        info.readyTimer = m_loop.AddTimer(readiness.timeoutMs, [this, pid]() { HandleReadyTimeout(pid); });
+    }
+
+    if (readiness.mode == ReadyMode::Listen) {
+        info.pollTimer = m_loop.AddTimer(c_listenPollMs, [this, pid]() { PollListen(pid); });
+    }
+}
+
+void wslgd::ProcessMonitor::CancelReadiness(ProcessInfo& info)
+{
+    if (info.readyTimer >= 0) {
+        m_loop.CancelTimer(info.readyTimer);
+        info.readyTimer = -1;
+    }
+
+    if (info.pollTimer >= 0) {
+        m_loop.CancelTimer(info.pollTimer);
+        info.pollTimer = -1;
+    }
+}
+
+void wslgd::ProcessMonitor::HandleNotify(const std::string& name)
+{
+    auto& service = GetServiceState(name);
+    std::array<char, 4096> buffer;
+    ssize_t size;
+    while ((size = recv(service.readyFd.get(), buffer.data(), buffer.size() - 1, 0)) > 0) {
+        // Newline-separated assignments, as in sd_notify(3).
+        buffer[size] = '\0';
+        char *savePtr = nullptr;
+        for (char *line = strtok_r(buffer.data(), "\n", &savePtr); line; line = strtok_r(nullptr, "\n", &savePtr)) {
+            if (strcmp(line, "READY=1") == 0) {
+                SetProcessReady(name);
+            } else if (strncmp(line, "STATUS=", 7) == 0) {
+                LOG_INFO("%s status: %s", name.c_str(), line + 7);
+            }
         }
     }
+}
 
-    return 0;
+void wslgd::ProcessMonitor::HandleConnect(const std::string& name)
+{
+    auto& service = GetServiceState(name);
+    int fd;
+    while ((fd = accept4(service.readyFd.get(), nullptr, nullptr, SOCK_CLOEXEC)) >= 0) {
+        close(fd);
+        SetProcessReady(name);
+    }
+}
+
+void wslgd::ProcessMonitor::PollListen(int pid)
+{
+    auto found = m_children.find(pid);
+    if (found == m_children.end()) {
+        return;
+    }
+
+    auto& info = found->second;
+    info.pollTimer = -1;
+
+    struct sockaddr_un addr = {};
+    addr.sun_family = AF_LOCAL;
+    snprintf(addr.sun_path, sizeof addr.sun_path, "%s", GetServiceState(info.name).readiness.socketPath.c_str());
+    wil::unique_fd socketFd{socket(PF_LOCAL, SOCK_STREAM | SOCK_CLOEXEC, 0)};
+    if (!socketFd) {
+        // e.g. EMFILE, which may pass, so keep polling until the ready timeout decides.
+        LOG_ERROR("%s pid %d readiness poll failed, socket: %s", info.name.c_str(), pid, strerror(errno));
+    } else if (connect(socketFd.get(), reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) == 0) {
+        SetProcessReady(info.name);
+        return;
+    }
+
+    info.pollTimer = m_loop.AddTimer(c_listenPollMs, [this, pid]() { PollListen(pid); });
+}
+
+void wslgd::ProcessMonitor::HandleReadyTimeout(int pid)
+{
+    auto found = m_children.find(pid);
+    if (found == m_children.end()) {
+        return;
+    }
+
+    // A child under a wrapper may be waiting for a debugger to attach, or running many times slower
+    // under a profiler, so it is left running and its dependents keep waiting for it.
+    auto& info = found->second;
+    info.readyTimer = -1;
+    if (!info.wrapper.empty()) {
+        LOG_ERROR("%s pid %d did not become ready within %llu ms, still waiting as it runs under %s", info.name.c_str(), pid,
+            static_cast<unsigned long long>(GetServiceState(info.name).readiness.timeoutMs), info.wrapper[0].c_str());
+        return;
+    }
+
+    // Kill the whole process group of a child stuck in init, it is then restarted as if it crashed.
+    LOG_ERROR("%s pid %d did not become ready within %llu ms, restarting it", info.name.c_str(), pid,
+        static_cast<unsigned long long>(GetServiceState(info.name).readiness.timeoutMs));
+    if (kill(-pid, SIGKILL) < 0) {
+        kill(pid, SIGKILL);
+    }
+}
+
+void wslgd::ProcessMonitor::SetProcessReady(const std::string& name)
+{
+    for (auto &child : m_children) {
+        auto& info = child.second;
+        if ((info.name != name) || info.isReady) {
+            continue;
+        }
+
+        info.isReady = true;
+        CancelReadiness(info);
+
+        auto& service = GetServiceState(name);
+        service.readyTimeMs = GetTimeMs();
+        service.readyDelayMs = service.readyTimeMs - info.startTimeMs;
+        LOG_INFO("%s pid %d is ready after %llu ms", name.c_str(), child.first,
+            static_cast<unsigned long long>(service.readyDelayMs));
+
+        if (m_readyCallback) {
+            m_readyCallback(name);
+        }
+
+        break;
+    }
+}
+
+int wslgd::ProcessMonitor::Run() try {
+    return m_loop.Run();
 }
 CATCH_RETURN_ERRNO();
@@ -2,31 +2,163 @@
 // Licensed under the MIT license.
 #pragma once
 #include "precomp.h"
+#include "EventLoop.h"
 
 namespace wslgd
 {
+    struct RestartPolicy
+    {
+        uint64_t initialDelayMs = 250; /* delay after the second exit in a row, doubled for each exit after that */
+        uint64_t maxDelayMs = 30000; /* ceiling for the exponential backoff */
+        uint64_t stableMs = 60000; /* running this long resets the backoff */
+        unsigned int maxRestarts = 10; /* exits in a row before backing off to restartLaterMs */
+        uint64_t restartLaterMs = 5 * 60 * 1000;
+    };
+
+    enum class ReadyMode
+    {
+        Started, /* ready as soon as it is launched */
+        Notify, /* sends sd_notify's READY=1 to the datagram socket in NOTIFY_SOCKET */
+        Connect, /* connects to a listening socket, e.g. wslgd-notify.so in weston */
+        Listen, /* accepts connections on its own socket */
+    };
+
+    struct ReadinessPolicy
+    {
+        ReadyMode mode = ReadyMode::Started;
+        std::string socketPath; /* socket to connect to in Listen and Connect modes, default one in Notify mode */
+        uint64_t timeoutMs = 0; /* the child is restarted if not ready in time, 0 waits forever, see SetWrapper */
+    };
+
+    // The command line and additional environment of a service, see SetCommand.
+    struct LaunchCommand
+    {
+        std::vector<std::string> argv;
+        std::vector<std::string> env;
+    };
+
     class ProcessMonitor
     {
     public:
-        ProcessMonitor(const char* username);
+        ProcessMonitor(const char* username, EventLoop& loop);
         ProcessMonitor(const ProcessMonitor&) = delete;
         void operator=(const ProcessMonitor&) = delete;
 
         passwd* GetUserInfo() const;
-        int LaunchProcess(std::vector<std::string>&& argv,
+        int LaunchProcess(std::string&& name,
+                          std::vector<std::string>&& argv,
                           std::vector<cap_value_t>&& capabilities = {},
                           std::vector<std::string>&& env = {});
+        void SetDefaultRestartPolicy(const RestartPolicy& policy);
+        void SetRestartPolicy(const std::string& name, const RestartPolicy& policy);
+        void SetReadiness(const std::string& name, const ReadinessPolicy& readiness);
+        void SetSocketActivation(const std::string& name, wil::unique_fd&& listenFd);
+        void SetEnvironmentKeys(const std::string& name, std::vector<std::string>&& keys);
+        void SetWrapper(const std::string& name, std::function<std::vector<std::string>()>&& wrapper);
+        void SetCommand(const std::string& name, std::function<LaunchCommand()>&& command);
+        std::vector<std::string> GetServicesUsing(const std::set<std::string>& keys);
+        void LaunchOnDemand(std::string&& name,
+                            std::vector<std::string>&& argv,
+                            std::vector<cap_value_t>&& capabilities = {},
+                            std::vector<std::string>&& env = {});
+        int LaunchHelper(std::vector<std::string>&& argv, bool isIdle, std::function<void(int)>&& onExit);
+        void StopHelper(int pid);
+        void ReleaseHelper(int pid);
+        void SetReadyCallback(std::function<void(const std::string&)>&& callback);
+        void SetExitCallback(std::function<void(const std::string&, int)>&& callback);
+        void WriteMetrics(std::string& out);
+        void ListServices(std::string& out);
+        void DumpState(std::string& out);
+        void RestartService(const std::string& name);
         int Run();
 
     private:
         struct ProcessInfo
         {
+            std::string name;
             std::vector<std::string> argv;
             std::vector<cap_value_t> capabilities;
             std::vector<std::string> env;
+            std::vector<std::string> wrapper; /* as launched, not reused by restarts */
+            wil::unique_fd pidFd;
+            uint64_t startTimeMs = 0;
+            bool isReady = false;
+            int readyTimer = -1; /* readiness timeout */
+            int pollTimer = -1; /* next connection attempt in Listen mode */
+            int stopTimer = -1; /* kills the process group if it ignores SIGTERM */
+        };
+
+        struct ServiceState
+        {
+            RestartPolicy policy;
+            unsigned int exits = 0; /* exits in a row without running stably */
+            int restartTimer = -1;
+            bool isRestartRequested = false; /* restart right away on the next exit, without backoff */
+            ProcessInfo pending; /* launch parameters while a restart is scheduled */
+            ReadinessPolicy readiness;
+            wil::unique_fd readyFd; /* notify or listening socket */
+            uint64_t readyTimeMs = 0; /* when the current child became ready */
+            uint64_t readyDelayMs = 0; /* how long it took from launch */
+            wil::unique_fd activationFd; /* listening socket the service is started on demand for */
+            std::vector<std::string> environmentKeys; /* variables read at launch, a trailing '*' matches a prefix */
+            std::function<std::vector<std::string>()> wrapper; /* returns the command to launch the service under, e.g. a profiler, which suspends the ready timeout */
+            std::function<LaunchCommand()> command; /* returns the current argv and env, so a restart sees reloaded variables */
+            double outputTokens = 0; /* lines of output that can be logged right now */
+            uint64_t outputRefillMs = 0;
+            uint64_t outputSuppressed = 0; /* lines dropped since the last one logged */
+            uint64_t outputSuppressedTotal = 0;
+            uint64_t launches = 0;
+            uint64_t restarts = 0;
+            std::map<std::pair<std::string, int>, uint64_t> exitReasons{}; /* "exited" with its status or "signaled" with its signal */
+            double cpuUserSeconds = 0; /* of exited children, from wait4 */
+            double cpuSystemSeconds = 0;
         };
 
+        // A short lived child of WSLGd itself rather than a service, e.g. fc-cache. It keeps WSLGd's
+        // credentials and output, and is not restarted.
+        struct HelperInfo
+        {
+            wil::unique_fd pidFd;
+            std::function<void(int)> onExit; /* called with the wait status */
+        };
+
+        struct OutputStream
+        {
+            std::string name;
+            int pid;
+            wil::unique_fd fd; /* read end of the child's stdout and stderr */
+            std::string partial; /* output after the last newline */
+        };
+
+        void HandlePidFd(int pid);
+        void HandleHelperExit(int pid, int status);
+        void HandleExit(int pid, int status, const struct rusage& usage);
+        void ReapChildren();
+        void ScheduleRestart(ProcessInfo&& info);
+        void Relaunch(const std::string& name);
+        void LaunchPending(const std::string& name);
+        void WaitForActivation(const std::string& name);
+        void ArmReadiness(int pid, ProcessInfo& info);
+        void CancelReadiness(ProcessInfo& info);
+        void HandleNotify(const std::string& name);
+        void HandleConnect(const std::string& name);
+        void HandleReadyTimeout(int pid);
+        void PollListen(int pid);
+        void SetProcessReady(const std::string& name);
+        void HandleOutput(int fd);
+        void WriteOutputLine(OutputStream& stream, const char *line, size_t size);
+        void ReportSuppressedOutput(OutputStream& stream);
+        ServiceState& GetServiceState(const std::string& name);
+
+        EventLoop& m_loop;
         std::map<int, ProcessInfo> m_children{};
+        std::map<std::string, ServiceState> m_services{};
+        std::map<int, OutputStream> m_outputs{}; /* by read end of the pipe */
+        std::map<int, HelperInfo> m_helpers{};
+        RestartPolicy m_defaultPolicy{};
+        std::minstd_rand m_random;
+        std::function<void(const std::string&)> m_readyCallback;
+        std::function<void(const std::string&, int)> m_exitCallback; /* runs before the restart is scheduled */
         passwd* m_user;
     };
 }
@@ -0,0 +1,151 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+#include "ServiceGraph.h"
+#include "common.h"
+#include "Trace.h"
+#include "MetricsServer.h"
+
+void wslgd::ServiceGraph::Add(ServiceDefinition&& service)
+{
+    THROW_ERRNO_IF(EEXIST, Find(service.name) != nullptr);
+    m_services.push_back(ServiceNode{std::move(service)});
+}
+
+wslgd::ServiceGraph::ServiceNode* wslgd::ServiceGraph::Find(const std::string& name)
+{
+    for (auto &node : m_services) {
+        if (node.definition.name == name) {
+            return &node;
+        }
+    }
+
+    return nullptr;
+}
+
+bool wslgd::ServiceGraph::CanStart(const ServiceNode& node) const
+{
+    for (auto &dependency : node.definition.dependencies) {
+        for (auto &other : m_services) {
+            if ((other.definition.name == dependency) && !other.isReady) {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+void wslgd::ServiceGraph::SetReady(ServiceNode& node)
+{
+    node.isReady = true;
+    node.readyTime = wslgd::Trace::Now();
+    LOG_INFO("%s is ready", node.definition.name.c_str());
+    if (node.definition.waitForReady) {
+        wslgd::Trace::AddSpan(node.definition.name + " ready", "readiness", node.startTime, wslgd::Trace::Now());
+    }
+}
+
+void wslgd::ServiceGraph::Start(std::function<void()>&& onStarted)
+{
+    // Reject dependencies on services that are not part of the graph.
+    for (auto &node : m_services) {
+        for (auto &dependency : node.definition.dependencies) {
+            if (!Find(dependency)) {
+                LOG_ERROR("%s depends on unknown service %s", node.definition.name.c_str(), dependency.c_str());
+                THROW_ERRNO(ENOENT);
+            }
+        }
+    }
+
+    m_startTime = wslgd::Trace::Now();
+    m_onStarted = std::move(onStarted);
+    StartReadyServices();
+    CheckStarted();
+}
+
+void wslgd::ServiceGraph::StartReadyServices()
+{
+    // Start everything whose dependencies are satisfied, in table order.
+    bool progress;
+    do {
+        progress = false;
+        for (auto &node : m_services) {
+            if (!node.isStarted && CanStart(node)) {
+                LOG_INFO("starting %s", node.definition.name.c_str());
+                node.isStarted = true;
+                node.startTime = wslgd::Trace::Now();
+                {
+                    TRACE_SPAN(node.definition.name.c_str());
+                    node.definition.start();
+                }
+
+                if (!node.definition.waitForReady) {
+                    SetReady(node);
+                }
+
+                progress = true;
+            }
+        }
+    } while (progress);
+}
+
+void wslgd::ServiceGraph::SetReady(const std::string& name)
+{
+    auto node = Find(name);
+    if (!node || !node->isStarted || node->isReady) {
+        return;
+    }
+
+    try {
+        SetReady(*node);
+        StartReadyServices();
+        CheckStarted();
+    }
+    catch (...) {
+        // A service that fails to start is fatal, just like it is during the initial start.
+        LOG_CAUGHT_EXCEPTION();
+        m_loop.Stop(-1);
+    }
+}
+
+void wslgd::ServiceGraph::CheckStarted()
+{
+    for (auto &node : m_services) {
+        if (node.isStarted && !node.isReady) {
+            return;
+        }
+    }
+
+    // Anything left over is part of a dependency cycle.
+    for (auto &node : m_services) {
+        if (!node.isStarted) {
+            LOG_ERROR("%s has cyclic dependencies, not starting it", node.definition.name.c_str());
+        }
+    }
+
+    if (!m_completeTime) {
+        m_completeTime = wslgd::Trace::Now();
+    }
+
+    if (m_onStarted) {
+        auto onStarted = std::move(m_onStarted);
+        m_onStarted = nullptr;
+        onStarted();
+    }
+}
+
+void wslgd::ServiceGraph::WriteMetrics(std::string& out) const
+{
+    MetricsServer::Describe(out, "wslgd_boot_phase_seconds", "gauge", "Time each service took from start to ready during boot.");
+    for (auto &node : m_services) {
+        if (node.isReady) {
+            MetricsServer::Add(out, "wslgd_boot_phase_seconds", MetricsServer::Label("phase", node.definition.name),
+                (node.readyTime - node.startTime) / 1e6);
+        }
+    }
+
+    if (m_completeTime) {
+        MetricsServer::Describe(out, "wslgd_boot_seconds", "gauge", "Time from starting the services until all of them were ready.");
+        MetricsServer::Add(out, "wslgd_boot_seconds", "", (m_completeTime - m_startTime) / 1e6);
+    }
+}
@@ -0,0 +1,51 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+#pragma once
+#include "precomp.h"
+#include "EventLoop.h"
+
+namespace wslgd
+{
+    struct ServiceDefinition
+    {
+        std::string name;
+        std::vector<std::string> dependencies; /* services that must be ready before this one starts */
+        std::function<void()> start; /* launches the service or performs the task */
+        bool waitForReady = false; /* wait for SetReady(), otherwise ready as soon as started */
+    };
+
+    class ServiceGraph
+    {
+    public:
+        ServiceGraph(EventLoop& loop) : m_loop(loop) {}
+        ServiceGraph(const ServiceGraph&) = delete;
+        void operator=(const ServiceGraph&) = delete;
+
+        void Add(ServiceDefinition&& service);
+        void Start(std::function<void()>&& onStarted);
+        void SetReady(const std::string& name);
+        void WriteMetrics(std::string& out) const;
+
+    private:
+        struct ServiceNode
+        {
+            ServiceDefinition definition;
+            bool isStarted = false;
+            bool isReady = false;
+            uint64_t startTime = 0; /* CLOCK_MONOTONIC, in microseconds */
+            uint64_t readyTime = 0;
+        };
+
+        bool CanStart(const ServiceNode& node) const;
+        void CheckStarted();
+        ServiceNode* Find(const std::string& name);
+        void SetReady(ServiceNode& node);
+        void StartReadyServices();
+
+        EventLoop& m_loop;
+        std::vector<ServiceNode> m_services{};
+        std::function<void()> m_onStarted; /* called once every service is ready */
+        uint64_t m_startTime = 0;
+        uint64_t m_completeTime = 0; /* when every service was ready */
+    };
+}
@@ -0,0 +1,366 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+#include "ServiceManifest.h"
+#include "ConfigFile.h"
+#include "common.h"
+
+constexpr auto c_manifestExtension = ".conf";
+constexpr auto c_wrapperOutputDir = SHARE_PATH;
+
+namespace {
+
+// Tools a service can be run under by naming them in WSLG_<SERVICE>_WRAPPER, "%o" is replaced by
+// the output file.
+struct WrapperPreset
+{
+    const char *name;
+    std::vector<const char*> argv;
+    const char *extension;
+};
+
+const WrapperPreset c_wrapperPresets[] = {
+    {"perf", {"/usr/bin/perf", "record", "-g", "-o", "%o", "--"}, ".data"},
+    {"heaptrack", {"/usr/bin/heaptrack", "-o", "%o"}, ""}, /* heaptrack adds the compression suffix */
+    {"massif", {"/usr/bin/valgrind", "--tool=massif", "--massif-out-file=%o"}, ".out"},
+    {"strace", {"/usr/bin/strace", "-c", "-f", "-o", "%o"}, ".txt"},
+    {"ltrace", {"/usr/bin/ltrace", "-f", "-o", "%o"}, ".txt"},
+};
+
+std::string GetWrapperKey(const std::string& name)
+{
+    std::string key("WSLG_");
+    for (unsigned char c : name) {
+        key += isalnum(c) ? toupper(c) : '_';
+    }
+
+    return key + "_WRAPPER";
+}
+
+std::string GetWrapperOutput(const std::string& tool, const std::string& service, const char *extension)
+{
+    // e.g. /mnt/wslg/perf-weston-20240131-093000.123.data, unique per launch.
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    struct tm local;
+    localtime_r(&now.tv_sec, &local);
+    char stamp[32];
+    size_t size = strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", &local);
+    snprintf(stamp + size, sizeof(stamp) - size, ".%03ld", now.tv_nsec / 1000000);
+    return std::string(c_wrapperOutputDir) + "/" + tool + "-" + service + "-" + stamp + extension;
+}
+
+uint64_t ParseNumber(const std::string& path, const char *key, const std::string& value)
+{
+    char *end;
+    errno = 0;
+    uint64_t number = strtoull(value.c_str(), &end, 10);
+    if (value.empty() || *end || errno) {
+        LOG_ERROR("%s: %s is not a number: %s", path.c_str(), key, value.c_str());
+        THROW_INVALID();
+    }
+
+    return number;
+}
+
+}
+
+void wslgd::ServiceManifest::SetVariable(const std::string& name, std::string value)
+{
+    m_variables[name] = std::move(value);
+}
+
+void wslgd::ServiceManifest::Load(const char *directory, const RestartPolicy& defaultPolicy)
+{
+    std::vector<std::filesystem::path> paths;
+    std::error_code error;
+    for (auto &entry : std::filesystem::directory_iterator(directory, error)) {
+        if (entry.is_regular_file() && (entry.path().extension() == c_manifestExtension)) {
+            paths.push_back(entry.path());
+        }
+    }
+
+    if (error) {
+        LOG_ERROR("failed to read service manifests from %s: %s", directory, error.message().c_str());
+        return;
+    }
+
+    // Files are read in name order, so a numeric prefix decides the order services are started in.
+    std::sort(paths.begin(), paths.end());
+    for (auto &path : paths) {
+        try {
+            LoadFile(path, defaultPolicy);
+        }
+        CATCH_LOG_MSG(path.c_str());
+    }
+}
+
+void wslgd::ServiceManifest::LoadFile(const std::filesystem::path& path, const RestartPolicy& defaultPolicy)
+{
+    ConfigFile file;
+    THROW_LAST_ERROR_IF(!file.Load(path.string()));
+
+    auto getValue = [&file](const char *section, const char *key) {
+        auto value = file.GetValue(section, key);
+        return std::string(value ? value : "");
+    };
+
+    ManifestService service;
+    service.name = getValue("service", "name");
+    if (service.name.empty()) {
+        service.name = path.stem().string();
+    }
+
+    service.exec = getValue("service", "exec");
+    if (Split(service.exec).empty()) {
+        LOG_ERROR("%s: exec is missing", path.c_str());
+        THROW_INVALID();
+    }
+
+    service.environment = getValue("service", "environment");
+    for (auto &name : Split(getValue("service", "capabilities"))) {
+        cap_value_t capability;
+        if (cap_from_name(name.c_str(), &capability) < 0) {
+            LOG_ERROR("%s: unknown capability %s", path.c_str(), name.c_str());
+            THROW_INVALID();
+        }
+
+        service.capabilities.push_back(capability);
+    }
+
+    service.dependencies = Split(getValue("service", "after"));
+    service.environmentKeys = Split(getValue("service", "environment-keys"));
+    service.environmentKeys.push_back(GetWrapperKey(service.name));
+
+    // ready=<started|notify|connect|listen> [socket] [timeout in ms]
+    auto ready = Split(getValue("service", "ready"));
+    if (!ready.empty()) {
+        const std::pair<const char*, ReadyMode> modes[] = {
+            {"started", ReadyMode::Started},
+            {"notify", ReadyMode::Notify},
+            {"connect", ReadyMode::Connect},
+            {"listen", ReadyMode::Listen},
+        };
+
+        auto mode = std::find_if(std::begin(modes), std::end(modes), [&ready](auto& entry) { return ready[0] == entry.first; });
+        if ((mode == std::end(modes)) || (ready.size() > 3)) {
+            LOG_ERROR("%s: invalid ready: %s", path.c_str(), getValue("service", "ready").c_str());
+            THROW_INVALID();
+        }
+
+        service.readiness.mode = mode->second;
+        if (ready.size() > 1) {
+            service.readiness.socketPath = ready[1];
+        }
+        if (ready.size() > 2) {
+            service.readiness.timeoutMs = ParseNumber(path, "ready timeout", ready[2]);
+        }
+    }
+
+    // Restart settings not given keep the default policy.
+    const std::pair<const char*, uint64_t RestartPolicy::*> restartKeys[] = {
+        {"restart-initial-delay-ms", &RestartPolicy::initialDelayMs},
+        {"restart-max-delay-ms", &RestartPolicy::maxDelayMs},
+        {"restart-stable-ms", &RestartPolicy::stableMs},
+        {"restart-later-ms", &RestartPolicy::restartLaterMs},
+    };
+
+    for (auto &key : restartKeys) {
+        auto value = Expand(getValue("service", key.first));
+        if (!value.empty()) {
+            if (!service.restartPolicy) {
+                service.restartPolicy = defaultPolicy;
+            }
+
+            (*service.restartPolicy).*(key.second) = ParseNumber(path, key.first, value);
+        }
+    }
+
+    auto maxRestarts = Expand(getValue("service", "restart-max-restarts"));
+    if (!maxRestarts.empty()) {
+        if (!service.restartPolicy) {
+            service.restartPolicy = defaultPolicy;
+        }
+
+        service.restartPolicy->maxRestarts = ParseNumber(path, "restart-max-restarts", maxRestarts);
+    }
+
+    // listen=<socket> with on-demand=true starts the service on the first connection instead.
+    service.activationSocket = Expand(getValue("service", "listen"));
+    auto onDemand = Expand(getValue("service", "on-demand"));
+    service.isOnDemand = ((onDemand == "true") || (onDemand == "1")) && !service.activationSocket.empty();
+
+    service.wrapper = getValue("wrapper", "exec");
+    service.wrapperCondition = getValue("wrapper", "if");
+
+    auto found = std::find_if(m_services.begin(), m_services.end(), [&service](auto& other) { return other.name == service.name; });
+    if (found != m_services.end()) {
+        LOG_INFO("%s replaces the earlier definition of %s", path.c_str(), service.name.c_str());
+        *found = std::move(service);
+    } else {
+        m_services.push_back(std::move(service));
+    }
+}
+
+std::vector<std::string> wslgd::ServiceManifest::GetArgv(const ManifestService& service) const
+{
+    return Split(service.exec);
+}
+
+std::vector<std::string> wslgd::ServiceManifest::GetEnvironment(const ManifestService& service) const
+{
+    return Split(service.environment);
+}
+
+wslgd::LaunchCommand wslgd::ServiceManifest::GetCommand(const ManifestService& service) const
+{
+    return LaunchCommand{GetArgv(service), GetEnvironment(service)};
+}
+
+std::vector<std::string> wslgd::ServiceManifest::GetWrapper(const ManifestService& service) const
+{
+    // WSLG_<SERVICE>_WRAPPER from .wslgconfig takes precedence over the manifest. It is either the
+    // name of a preset, or a command line with an absolute path or a preset name followed by its
+    // own arguments. "%o" is replaced by an output file named after the launch.
+    std::vector<std::string> wrapper;
+    auto configuredValue = getenv(GetWrapperKey(service.name).c_str());
+    auto configured = Split(configuredValue ? configuredValue : "");
+    if (!configured.empty()) {
+        auto preset = std::find_if(std::begin(c_wrapperPresets), std::end(c_wrapperPresets),
+            [&configured](auto& entry) { return configured[0] == entry.name; });
+
+        std::string tool = std::filesystem::path(configured[0]).filename().string();
+        const char *extension = ".out";
+        if (preset != std::end(c_wrapperPresets)) {
+            extension = preset->extension;
+            if (configured.size() == 1) {
+                configured.assign(preset->argv.begin(), preset->argv.end());
+            } else {
+                configured[0] = preset->argv[0];
+            }
+        }
+
+        std::string output;
+        for (auto &arg : configured) {
+            auto position = arg.find("%o");
+            if (position != std::string::npos) {
+                if (output.empty()) {
+                    output = GetWrapperOutput(tool, service.name, extension);
+                }
+
+                arg.replace(position, 2, output);
+            }
+        }
+
+        wrapper = std::move(configured);
+        if (access(wrapper[0].c_str(), X_OK) == 0) {
+            LOG_INFO("launching %s under %s%s%s", service.name.c_str(), wrapper[0].c_str(),
+                output.empty() ? "" : ", output in ", output.c_str());
+        }
+    } else if (service.wrapperCondition.empty() || !Expand("${" + service.wrapperCondition + "}").empty()) {
+        wrapper = Split(service.wrapper);
+    }
+
+    // The wrapper is skipped when it is not installed.
+    if (!wrapper.empty() && (access(wrapper[0].c_str(), X_OK) < 0)) {
+        LOG_ERROR("%s wrapper %s is not available: %s", service.name.c_str(), wrapper[0].c_str(), strerror(errno));
+        return {};
+    }
+
+    return wrapper;
+}
+
+std::vector<std::string> wslgd::ServiceManifest::Split(const std::string& line) const
+{
+    std::vector<std::string> words;
+    size_t position = 0;
+    while (position < line.size()) {
+        if (isspace(static_cast<unsigned char>(line[position]))) {
+            position++;
+            continue;
+        }
+
+        // Collect a word, spaces only end it outside of quotes and ${...}.
+        std::string word;
+        bool isQuoted = false;
+        char quote = 0;
+        int braces = 0;
+        for (; position < line.size(); position++) {
+            char c = line[position];
+            if (quote) {
+                if (c == quote) {
+                    quote = 0;
+                } else {
+                    word += c;
+                }
+            } else if ((c == '"') || (c == '\'')) {
+                quote = c;
+                isQuoted = true;
+            } else if ((braces == 0) && isspace(static_cast<unsigned char>(c))) {
+                break;
+            } else {
+                if ((c == '{') && !word.empty() && (word.back() == '$')) {
+                    braces++;
+                } else if ((c == '}') && (braces > 0)) {
+                    braces--;
+                }
+
+                word += c;
+            }
+        }
+
+        word = Expand(word);
+        if (!word.empty() || isQuoted) {
+            words.push_back(std::move(word));
+        }
+    }
+
+    return words;
+}
+
+std::string wslgd::ServiceManifest::Expand(const std::string& value) const
+{
+    std::string result;
+    size_t position = 0;
+    while (position < value.size()) {
+        size_t start = value.find("${", position);
+        if (start == std::string::npos) {
+            break;
+        }
+
+        // Find the closing brace, a default value may itself refer to variables.
+        size_t end = start + 2;
+        for (int depth = 1; end < value.size(); end++) {
+            if ((value[end] == '{') && (value[end - 1] == '$')) {
+                depth++;
+            } else if ((value[end] == '}') && (--depth == 0)) {
+                break;
+            }
+        }
+
+        if (end >= value.size()) {
+            break;
+        }
+
+        std::string name = value.substr(start + 2, end - start - 2);
+        std::string fallback;
+        size_t separator = name.find(":-");
+        if (separator != std::string::npos) {
+            fallback = name.substr(separator + 2);
+            name.resize(separator);
+        }
+
+        result.append(value, position, start - position);
+        auto found = m_variables.find(name);
+        const char *variable = (found != m_variables.end()) ? found->second.c_str() : getenv(name.c_str());
+        if (variable && *variable) {
+            result += variable;
+        } else {
+            result += Expand(fallback);
+        }
+
+        position = end + 1;
+    }
+
+    result.append(value, position, std::string::npos);
+    return result;
+}
@@ -0,0 +1,72 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+#pragma once
+#include "precomp.h"
+#include "ProcessMonitor.h"
+
+namespace wslgd
+{
+    // A supervised process, as described by a file in the manifest directory.
+    struct ManifestService
+    {
+        std::string name;
+        std::string exec; /* command line, split and expanded at launch */
+        std::string environment; /* KEY=VALUE words added to the inherited environment */
+        std::vector<cap_value_t> capabilities;
+        std::vector<std::string> dependencies;
+        std::vector<std::string> environmentKeys; /* see ProcessMonitor::SetEnvironmentKeys */
+        ReadinessPolicy readiness;
+        std::optional<RestartPolicy> restartPolicy;
+        std::string activationSocket; /* socket to start the service on, when isOnDemand */
+        bool isOnDemand = false;
+        std::string wrapper; /* command line launched in front of exec */
+        std::string wrapperCondition; /* variable that must be set for the wrapper to apply */
+    };
+
+    // Service definitions read from INI files, e.g. /etc/wslg/services.d/10-weston.conf:
+    //
+    //   [service]
+    //   name=weston
+    //   exec=/usr/bin/weston --socket=${WAYLAND_DISPLAY} --log=${WSLG_WESTON_LOG_PATH:-/mnt/wslg/weston.log}
+    //   environment=WESTON_DISABLE_ABSTRACT_FD=1
+    //   capabilities=CAP_SYS_ADMIN
+    //   after=dbus
+    //   ready=connect /mnt/wslg/weston-notify.sock 60000
+    //
+    //   [wrapper]
+    //   exec=/usr/bin/gdbserver :${WSLG_WESTON_GDBSERVER_PORT}
+    //   if=WSLG_WESTON_GDBSERVER_PORT
+    //
+    // Commands are run directly, not through a shell. Words are split on spaces except within
+    // quotes, and ${NAME} or ${NAME:-default} is replaced by a variable set by WSLGd or else from
+    // the environment. An unquoted word that expands to nothing is dropped.
+    //
+    // WSLG_<SERVICE>_WRAPPER, e.g. WSLG_WESTON_WRAPPER=perf, replaces the manifest's wrapper to run
+    // the service under perf, heaptrack, massif, strace or ltrace, writing to /mnt/wslg. Whenever
+    // GetWrapper() returns a command, the ready timeout is suspended: a service that is not ready in
+    // time is only reported, as a debugger may hold it or a profiler slow it down many times.
+    class ServiceManifest
+    {
+    public:
+        ServiceManifest() = default;
+        ServiceManifest(const ServiceManifest&) = delete;
+        void operator=(const ServiceManifest&) = delete;
+
+        void SetVariable(const std::string& name, std::string value);
+        void Load(const char *directory, const RestartPolicy& defaultPolicy);
+        const std::vector<ManifestService>& GetServices() const { return m_services; }
+
+        std::vector<std::string> GetArgv(const ManifestService& service) const;
+        std::vector<std::string> GetEnvironment(const ManifestService& service) const;
+        LaunchCommand GetCommand(const ManifestService& service) const;
+        std::vector<std::string> GetWrapper(const ManifestService& service) const;
+        std::vector<std::string> Split(const std::string& line) const;
+        std::string Expand(const std::string& value) const;
+
+    private:
+        void LoadFile(const std::filesystem::path& path, const RestartPolicy& defaultPolicy);
+
+        std::map<std::string, std::string> m_variables{};
+        std::vector<ManifestService> m_services{}; /* in file name order, then file order */
+    };
+}
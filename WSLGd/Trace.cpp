@@ -0,0 +1,122 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+#include "Trace.h"
+#include "common.h"
+
+#define TRACE_FILE SHARE_PATH "/wslgd-trace.json"
+
+bool wslgd::Trace::s_isEnabled = false;
+std::mutex wslgd::Trace::s_lock;
+std::vector<wslgd::Trace::Span> wslgd::Trace::s_spans;
+std::map<std::string, uint64_t> wslgd::Trace::s_counters;
+uint64_t wslgd::Trace::s_completeTime = 0;
+
+namespace {
+
+void WriteJsonString(FILE *file, const char *str)
+{
+    fputc('"', file);
+    for (const char *p = str; *p; p++) {
+        if ((*p == '"') || (*p == '\\')) {
+            fprintf(file, "\\%c", *p);
+        } else if (static_cast<unsigned char>(*p) < 0x20) {
+            fprintf(file, "\\u%04x", *p);
+        } else {
+            fputc(*p, file);
+        }
+    }
+    fputc('"', file);
+}
+
+}
+
+void wslgd::Trace::Initialize()
+{
+    // Tracing is off unless WSLG_TRACE is set, which keeps every span down to a single branch.
+    const char *value = getenv("WSLG_TRACE");
+    s_isEnabled = value && ((strcmp(value, "true") == 0) || (strcmp(value, "1") == 0));
+}
+
+uint64_t wslgd::Trace::Now() noexcept
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (static_cast<uint64_t>(ts.tv_sec) * 1000000) + (ts.tv_nsec / 1000);
+}
+
+void wslgd::Trace::AddSpan(std::string&& name, const char *category, uint64_t start, uint64_t end) noexcept
+{
+    if (!s_isEnabled) {
+        return;
+    }
+
+    try {
+        std::lock_guard<std::mutex> lock(s_lock);
+        s_spans.push_back(Span{std::move(name), category, start, end, static_cast<pid_t>(syscall(SYS_gettid))});
+    }
+    CATCH_LOG();
+}
+
+void wslgd::Trace::Increment(const char *counter) noexcept
+{
+    if (!s_isEnabled) {
+        return;
+    }
+
+    try {
+        std::lock_guard<std::mutex> lock(s_lock);
+        s_counters[counter]++;
+    }
+    CATCH_LOG();
+}
+
+void wslgd::Trace::Write() noexcept
+{
+    if (!s_isEnabled) {
+        return;
+    }
+
+    try {
+        const char *tracePath = getenv("WSLG_TRACE_PATH");
+        if (!tracePath) {
+            tracePath = TRACE_FILE;
+        }
+
+        std::unique_ptr<FILE, decltype(&fclose)> file(fopen(tracePath, "w"), fclose);
+        THROW_LAST_ERROR_IF(!file);
+
+        // Chrome trace event format, loadable in chrome://tracing and ui.perfetto.dev.
+        std::lock_guard<std::mutex> lock(s_lock);
+        fprintf(file.get(), "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+        fprintf(file.get(), "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"WSLGd\"}}", getpid());
+        for (auto &span : s_spans) {
+            fprintf(file.get(), ",\n{\"name\":");
+            WriteJsonString(file.get(), span.name.c_str());
+            fprintf(file.get(), ",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%llu,\"dur\":%llu,\"pid\":%d,\"tid\":%d}",
+                span.category,
+                static_cast<unsigned long long>(span.start),
+                static_cast<unsigned long long>(span.end - span.start),
+                getpid(), span.tid);
+        }
+
+        // Mark the end of startup and the number of processes it took to get there.
+        // N.B. The trace may be written again later with more spans, startup still ended the first time.
+        if (!s_completeTime) {
+            s_completeTime = Now();
+        }
+
+        auto now = s_completeTime;
+        fprintf(file.get(), ",\n{\"name\":\"startup complete\",\"cat\":\"startup\",\"ph\":\"i\",\"s\":\"p\",\"ts\":%llu,\"pid\":%d,\"tid\":%d}",
+            static_cast<unsigned long long>(now), getpid(), static_cast<pid_t>(syscall(SYS_gettid)));
+        for (auto &counter : s_counters) {
+            fprintf(file.get(), ",\n{\"name\":");
+            WriteJsonString(file.get(), counter.first.c_str());
+            fprintf(file.get(), ",\"cat\":\"startup\",\"ph\":\"C\",\"ts\":%llu,\"pid\":%d,\"args\":{\"count\":%llu}}",
+                static_cast<unsigned long long>(now), getpid(), static_cast<unsigned long long>(counter.second));
+        }
+        fprintf(file.get(), "\n]}\n");
+
+        LOG_INFO("wrote %zu trace spans to %s", s_spans.size(), tracePath);
+    }
+    CATCH_LOG();
+}
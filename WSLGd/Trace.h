@@ -0,0 +1,64 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+#pragma once
+#include "precomp.h"
+
+namespace wslgd
+{
+    class Trace
+    {
+    public:
+        static void Initialize();
+        static bool IsEnabled() { return s_isEnabled; }
+        static void SetEnabled(bool isEnabled) { s_isEnabled = isEnabled; }
+
+        static uint64_t Now() noexcept;
+        static void AddSpan(std::string&& name, const char *category, uint64_t start, uint64_t end) noexcept;
+        static void Increment(const char *counter) noexcept;
+        static void Write() noexcept;
+
+    private:
+        struct Span
+        {
+            std::string name;
+            const char *category;
+            uint64_t start; /* CLOCK_MONOTONIC, in microseconds */
+            uint64_t end;
+            pid_t tid;
+        };
+
+        static bool s_isEnabled;
+        static std::mutex s_lock;
+        static std::vector<Span> s_spans;
+        static std::map<std::string, uint64_t> s_counters;
+        static uint64_t s_completeTime;
+    };
+
+    class TraceSpan
+    {
+    public:
+        TraceSpan(const char *name, const char *category = "startup") noexcept
+            : m_name(name), m_category(category), m_start(Trace::IsEnabled() ? Trace::Now() : 0)
+        {
+        }
+
+        ~TraceSpan()
+        {
+            if (m_start) {
+                Trace::AddSpan(m_name, m_category, m_start, Trace::Now());
+            }
+        }
+
+        TraceSpan(const TraceSpan&) = delete;
+        void operator=(const TraceSpan&) = delete;
+
+    private:
+        const char *m_name;
+        const char *m_category;
+        uint64_t m_start;
+    };
+}
+
+#define TRACE_SPAN_NAME2(line) __traceSpan##line
+#define TRACE_SPAN_NAME(line) TRACE_SPAN_NAME2(line)
+#define TRACE_SPAN(name) wslgd::TraceSpan TRACE_SPAN_NAME(__LINE__)(name)
@@ -0,0 +1,570 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+#include "X11FontPath.h"
+#include "common.h"
+
+constexpr auto c_xset = "/usr/bin/xset";
+
+wslgd::X11FontPath::X11FontPath(EventLoop& loop, ProcessMonitor& monitor) : m_loop(loop), m_monitor(monitor)
+{
+}
+
+bool wslgd::X11FontPath::IsAvailable()
+{
+#if HAVE_XCB
+    return true;
+#else
+    // xset must be installed.
+    return access(c_xset, X_OK) == 0;
+#endif
+}
+
+void wslgd::X11FontPath::Complete(const Result& result)
+{
+    auto done = std::move(m_changeCallbacks.front());
+    m_changeCallbacks.pop_front();
+    if (done) {
+        done(result);
+    }
+}
+
+#if HAVE_XCB
+
+namespace {
+
+// Address families of Xauthority entries, from X11/Xauth.h.
+constexpr uint16_t c_familyLocal = 256;
+constexpr uint16_t c_familyWild = 65535;
+constexpr auto c_mitMagicCookie = "MIT-MAGIC-COOKIE-1";
+
+bool ReadCounted(FILE *file, std::string& value)
+{
+    std::array<unsigned char, 2> size;
+    if (fread(size.data(), 1, size.size(), file) != size.size()) {
+        return false;
+    }
+
+    value.resize((size[0] << 8) | size[1]);
+    return value.empty() || (fread(&value[0], 1, value.size(), file) == value.size());
+}
+
+// The cookie libxcb would pick for a local display, read here because libxcb looks up XAUTHORITY
+// and HOME itself, and the environment may change under a reload of .wslgconfig. Displays on
+// another host connect without a cookie.
+void ResolveAuthority(const std::string& display, std::string& name, std::string& data)
+{
+    char *host = nullptr;
+    int number;
+    if (!xcb_parse_display(display.c_str(), &host, &number, nullptr)) {
+        return;
+    }
+
+    bool isLocal = !*host || (strcmp(host, "unix") == 0);
+    free(host);
+    if (!isLocal) {
+        return;
+    }
+
+    std::string path;
+    auto authority = getenv("XAUTHORITY");
+    auto home = getenv("HOME");
+    if (authority && *authority) {
+        path = authority;
+    } else if (home && *home) {
+        path = std::string(home) + "/.Xauthority";
+    } else {
+        return;
+    }
+
+    std::array<char, HOST_NAME_MAX + 1> hostName{};
+    gethostname(hostName.data(), hostName.size() - 1);
+    std::unique_ptr<FILE, decltype(&fclose)> file(fopen(path.c_str(), "r"), fclose);
+    if (!file) {
+        return;
+    }
+
+    // Each entry is a big endian family followed by the address, display number, name and data,
+    // each behind a big endian length.
+    std::string numberString = std::to_string(number);
+    for (;;) {
+        std::array<unsigned char, 2> family;
+        std::string address, entryNumber, entryName, entryData;
+        if ((fread(family.data(), 1, family.size(), file.get()) != family.size()) ||
+            !ReadCounted(file.get(), address) || !ReadCounted(file.get(), entryNumber) ||
+            !ReadCounted(file.get(), entryName) || !ReadCounted(file.get(), entryData)) {
+            return;
+        }
+
+        uint16_t entryFamily = (family[0] << 8) | family[1];
+        if (((entryFamily == c_familyWild) || ((entryFamily == c_familyLocal) && (address == hostName.data()))) &&
+            (entryNumber.empty() || (entryNumber == numberString)) && (entryName == c_mitMagicCookie)) {
+            name = std::move(entryName);
+            data = std::move(entryData);
+            return;
+        }
+    }
+}
+
+}
+
+void wslgd::X11FontPath::Connect(std::function<void(bool)>&& done)
+{
+    Disconnect();
+
+    try {
+        auto worker = std::make_shared<Worker>();
+        worker->wakeFd.reset(eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK));
+        THROW_LAST_ERROR_IF(!worker->wakeFd);
+        worker->replyFd.reset(eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK));
+        THROW_LAST_ERROR_IF(!worker->replyFd);
+
+        // The environment is only changed on the event loop, so everything read from it to connect
+        // is resolved here.
+        auto display = getenv("DISPLAY");
+        worker->display = display ? display : "";
+        ResolveAuthority(worker->display, worker->authName, worker->authData);
+
+        // xcb_connect blocks until the X server answers, so the worker connects and owns the
+        // connection. It must never take a signal meant for the event loop's signalfd.
+        sigset_t allSignals;
+        sigset_t oldMask;
+        sigfillset(&allSignals);
+        THROW_LAST_ERROR_IF(pthread_sigmask(SIG_SETMASK, &allSignals, &oldMask) != 0);
+        auto restoreMask = wil::scope_exit([&oldMask]() { pthread_sigmask(SIG_SETMASK, &oldMask, nullptr); });
+        std::thread(RunWorker, worker).detach();
+
+        m_loop.AddFd(worker->replyFd.get(), EPOLLIN, [this](uint32_t) { HandleReplies(); });
+        m_worker = std::move(worker);
+        m_connectCallback = std::move(done);
+        return;
+    }
+    CATCH_LOG();
+
+    done(false);
+}
+
+void wslgd::X11FontPath::Disconnect()
+{
+    if (!m_worker) {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_worker->lock);
+        m_worker->isStopping = true;
+    }
+
+    uint64_t value = 1;
+    write(m_worker->wakeFd.get(), &value, sizeof(value));
+    m_loop.RemoveFd(m_worker->replyFd.get());
+    m_worker.reset();
+    m_connectCallback = nullptr;
+    m_changeCallbacks.clear();
+    m_isConnected = false;
+}
+
+void wslgd::X11FontPath::Change(std::vector<std::string>&& removes, std::vector<std::string>&& adds, bool isRehash,
+                                std::function<void(const Result&)>&& done)
+{
+    if (!m_worker) {
+        done(Result{});
+        return;
+    }
+
+    m_changeCallbacks.push_back(std::move(done));
+    {
+        std::lock_guard<std::mutex> lock(m_worker->lock);
+        m_worker->requests.push_back(Request{std::move(removes), std::move(adds), isRehash});
+    }
+
+    uint64_t value = 1;
+    write(m_worker->wakeFd.get(), &value, sizeof(value));
+}
+
+void wslgd::X11FontPath::HandleReplies()
+{
+    auto worker = m_worker;
+    uint64_t value;
+    read(worker->replyFd.get(), &value, sizeof(value));
+
+    std::deque<Reply> replies;
+    {
+        std::lock_guard<std::mutex> lock(worker->lock);
+        replies.swap(worker->replies);
+    }
+
+    // A callback may disconnect, the replies left belong to the old connection then.
+    for (auto &reply : replies) {
+        if (worker != m_worker) {
+            break;
+        }
+
+        switch (reply.type) {
+        case ReplyType::Connected:
+        case ReplyType::ConnectFailed:
+        {
+            m_isConnected = (reply.type == ReplyType::Connected);
+            auto done = std::move(m_connectCallback);
+            m_connectCallback = nullptr;
+            if (done) {
+                done(m_isConnected);
+            }
+
+            break;
+        }
+
+        case ReplyType::Changed:
+            Complete(reply.result);
+            break;
+
+        case ReplyType::Disconnected:
+            m_isConnected = false;
+            if (m_disconnectCallback) {
+                m_disconnectCallback();
+            }
+
+            break;
+        }
+    }
+}
+
+void wslgd::X11FontPath::PostReply(Worker& worker, Reply&& reply)
+{
+    {
+        std::lock_guard<std::mutex> lock(worker.lock);
+        worker.replies.push_back(std::move(reply));
+    }
+
+    uint64_t value = 1;
+    write(worker.replyFd.get(), &value, sizeof(value));
+}
+
+void wslgd::X11FontPath::RunWorker(std::shared_ptr<Worker> worker)
+{
+    // With the cookie given, xcb does not look for one in the environment. An empty one connects
+    // without authorization, as xcb does when it finds none.
+    xcb_auth_info_t auth{};
+    auth.namelen = worker->authName.size();
+    auth.name = &worker->authName[0];
+    auth.datalen = worker->authData.size();
+    auth.data = &worker->authData[0];
+    xcb_connection_t *connection = xcb_connect_to_display_with_auth_info(worker->display.c_str(), &auth, nullptr);
+    auto disconnect = wil::scope_exit([connection]() { xcb_disconnect(connection); });
+    if (xcb_connection_has_error(connection)) {
+        LOG_ERROR("FontMonitor: failed to connect to X server %s", worker->display.c_str());
+        PostReply(*worker, Reply{ReplyType::ConnectFailed});
+        return;
+    }
+
+    LOG_INFO("FontMonitor: connected to X server %s", worker->display.c_str());
+    PostReply(*worker, Reply{ReplyType::Connected});
+
+    // Requests queued before Disconnect are still applied, then the worker exits.
+    bool isConnected = true;
+    for (;;) {
+        std::optional<Request> request;
+        {
+            std::lock_guard<std::mutex> lock(worker->lock);
+            if (!worker->requests.empty()) {
+                request = std::move(worker->requests.front());
+                worker->requests.pop_front();
+            } else if (worker->isStopping) {
+                break;
+            }
+        }
+
+        if (request) {
+            Reply reply{ReplyType::Changed};
+            if (isConnected) {
+                Apply(connection, *request, reply.result);
+            }
+
+            PostReply(*worker, std::move(reply));
+            if (isConnected && xcb_connection_has_error(connection)) {
+                isConnected = false;
+                PostReply(*worker, Reply{ReplyType::Disconnected});
+            }
+
+            continue;
+        }
+
+        // Nothing is selected, but reading notices when the X server goes away, e.g. Xwayland exits.
+        struct pollfd fds[2] = {
+            {worker->wakeFd.get(), POLLIN, 0},
+            {isConnected ? xcb_get_file_descriptor(connection) : -1, POLLIN, 0},
+        };
+
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            LOG_ERROR("FontMonitor: poll failed %s", strerror(errno));
+            if (isConnected) {
+                PostReply(*worker, Reply{ReplyType::Disconnected});
+            }
+
+            break;
+        }
+
+        if (fds[0].revents & POLLIN) {
+            uint64_t value;
+            read(worker->wakeFd.get(), &value, sizeof(value));
+        }
+
+        if (fds[1].revents) {
+            xcb_generic_event_t *event;
+            while ((event = xcb_poll_for_event(connection))) {
+                free(event);
+            }
+
+            if (xcb_connection_has_error(connection)) {
+                isConnected = false;
+                PostReply(*worker, Reply{ReplyType::Disconnected});
+            }
+        }
+    }
+}
+
+void wslgd::X11FontPath::Apply(xcb_connection_t *connection, const Request& request, Result& result)
+{
+    // A single change removes and adds every folder of the batch, and rehashes once.
+    if (SetFontPath(connection, request.removes, request.adds, request.isRehash)) {
+        result.succeeded = true;
+        result.removed = request.removes;
+        result.added = request.adds;
+        return;
+    }
+
+    if (xcb_connection_has_error(connection) || ((request.removes.size() + request.adds.size()) <= 1)) {
+        return;
+    }
+
+    // The X server rejects the whole change for a single bad folder, apply them one at a time.
+    for (auto &path : request.removes) {
+        if (SetFontPath(connection, {path}, {}, false)) {
+            result.removed.push_back(path);
+        }
+    }
+    for (auto &path : request.adds) {
+        if (SetFontPath(connection, {}, {path}, false)) {
+            result.added.push_back(path);
+        }
+    }
+
+    result.succeeded = SetFontPath(connection, {}, {}, request.isRehash);
+}
+
+bool wslgd::X11FontPath::SetFontPath(xcb_connection_t *connection, const std::vector<std::string>& removes,
+                                     const std::vector<std::string>& adds, bool isRehash)
+{
+    if (removes.empty() && adds.empty() && !isRehash) {
+        return true;
+    }
+
+    std::unique_ptr<xcb_get_font_path_reply_t, decltype(&free)> reply(
+        xcb_get_font_path_reply(connection, xcb_get_font_path(connection), nullptr), free);
+
+    if (!reply) {
+        LOG_ERROR("FontMonitor: GetFontPath failed");
+        return false;
+    }
+
+    // Added folders go first as with xset +fp, the X server reads every folder again on
+    // SetFontPath, which also serves as the rehash.
+    std::vector<std::string> paths(adds);
+    for (auto iterator = xcb_get_font_path_path_iterator(reply.get()); iterator.rem; xcb_str_next(&iterator)) {
+        std::string path(xcb_str_name(iterator.data), xcb_str_name_length(iterator.data));
+        if ((std::find(removes.begin(), removes.end(), path) == removes.end()) &&
+            (std::find(adds.begin(), adds.end(), path) == adds.end())) {
+            paths.push_back(std::move(path));
+        }
+    }
+
+    // The request carries each path behind its length byte.
+    std::string request;
+    uint16_t count = 0;
+    for (auto &path : paths) {
+        if (path.size() > UINT8_MAX) {
+            LOG_ERROR("FontMonitor: font path %s is too long", path.c_str());
+            continue;
+        }
+
+        request += static_cast<char>(path.size());
+        request += path;
+        count++;
+    }
+
+    std::unique_ptr<xcb_generic_error_t, decltype(&free)> error(
+        xcb_request_check(connection, xcb_set_font_path_checked(connection, count,
+            reinterpret_cast<const xcb_str_t*>(request.data()))), free);
+
+    if (error || xcb_connection_has_error(connection)) {
+        LOG_ERROR("FontMonitor: SetFontPath failed, error %d", error ? error->error_code : 0);
+        return false;
+    }
+
+    return true;
+}
+
+#else
+
+void wslgd::X11FontPath::Connect(std::function<void(bool)>&& done)
+{
+    // Every xset connects on its own.
+    m_isConnected = true;
+    done(true);
+}
+
+void wslgd::X11FontPath::Disconnect()
+{
+    if (m_xsetPid > 0) {
+        m_monitor.ReleaseHelper(m_xsetPid);
+        m_xsetPid = -1;
+    }
+
+    // The changes still queued run on their own, without the per folder fallback.
+    for (auto &request : m_requests) {
+        auto argv = GetXsetArgv(request);
+        if (argv.size() > 1) try {
+            m_monitor.LaunchHelper(std::move(argv), false, nullptr);
+        }
+        CATCH_LOG();
+    }
+
+    m_requests.clear();
+    m_changeCallbacks.clear();
+    m_isConnected = false;
+}
+
+void wslgd::X11FontPath::Change(std::vector<std::string>&& removes, std::vector<std::string>&& adds, bool isRehash,
+                                std::function<void(const Result&)>&& done)
+{
+    if (!m_isConnected) {
+        done(Result{});
+        return;
+    }
+
+    m_changeCallbacks.push_back(std::move(done));
+    m_requests.push_back(Request{std::move(removes), std::move(adds), isRehash});
+    if (m_xsetPid < 0) {
+        ChangeNext();
+    }
+}
+
+std::vector<std::string> wslgd::X11FontPath::GetXsetArgv(const Request& request)
+{
+    auto join = [](const std::vector<std::string>& paths) {
+        std::string list;
+        for (auto &path : paths) {
+            list += list.empty() ? "" : ",";
+            list += path;
+        }
+
+        return list;
+    };
+
+    // A single xset removes and adds every folder, then lets the X server reread the font databases.
+    std::vector<std::string> argv{c_xset};
+    if (!request.removes.empty()) {
+        argv.push_back("-fp");
+        argv.push_back(join(request.removes));
+    }
+    if (!request.adds.empty()) {
+        argv.push_back("+fp");
+        argv.push_back(join(request.adds));
+    }
+    if (request.isRehash) {
+        argv.push_back("fp");
+        argv.push_back("rehash");
+    }
+
+    return argv;
+}
+
+void wslgd::X11FontPath::ChangeNext()
+{
+    if (m_requests.empty()) {
+        return;
+    }
+
+    auto request = std::make_shared<Request>(std::move(m_requests.front()));
+    m_requests.pop_front();
+    RunXset(*request, [this, request](bool succeeded) {
+        auto result = std::make_shared<Result>();
+        if (succeeded) {
+            result->succeeded = true;
+            result->removed = request->removes;
+            result->added = request->adds;
+        } else if ((request->removes.size() + request->adds.size()) > 1) {
+            // xset gives up on the whole change for a single bad folder, apply them one at a time.
+            ChangeEach(request, result, 0);
+            return;
+        }
+
+        Complete(*result);
+        if (m_xsetPid < 0) {
+            ChangeNext();
+        }
+    });
+}
+
+void wslgd::X11FontPath::ChangeEach(std::shared_ptr<Request> request, std::shared_ptr<Result> result, size_t index)
+{
+    // The last step rehashes once for every folder.
+    if (index == (request->removes.size() + request->adds.size())) {
+        RunXset(Request{{}, {}, request->isRehash}, [this, result](bool succeeded) {
+            result->succeeded = succeeded;
+            Complete(*result);
+            if (m_xsetPid < 0) {
+                ChangeNext();
+            }
+        });
+
+        return;
+    }
+
+    bool isRemove = index < request->removes.size();
+    const std::string& path = isRemove ? request->removes[index] : request->adds[index - request->removes.size()];
+    Request single;
+    (isRemove ? single.removes : single.adds).push_back(path);
+    RunXset(single, [this, request, result, index, isRemove, path](bool succeeded) {
+        if (succeeded) {
+            (isRemove ? result->removed : result->added).push_back(path);
+        }
+
+        ChangeEach(request, result, index + 1);
+    });
+}
+
+void wslgd::X11FontPath::RunXset(const Request& request, std::function<void(bool)>&& done)
+{
+    auto argv = GetXsetArgv(request);
+    if (argv.size() == 1) {
+        done(true);
+        return;
+    }
+
+    std::string command;
+    for (auto &arg : argv) {
+        command += command.empty() ? "" : " ";
+        command += arg;
+    }
+
+    // xset runs through ProcessMonitor, which reports its exit from the pidfd on the event loop.
+    try {
+        m_xsetPid = m_monitor.LaunchHelper(std::move(argv), false, [this, command, done](int status) {
+            bool succeeded = WIFEXITED(status) && (WEXITSTATUS(status) == 0);
+            LOG_INFO("FontMonitor: pid:%d exited with %s, %s", m_xsetPid, succeeded ? "success" : "fail", command.c_str());
+            m_xsetPid = -1;
+            done(succeeded);
+        });
+
+        return;
+    }
+    CATCH_LOG();
+
+    done(false);
+}
+
+#endif
@@ -0,0 +1,108 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+#pragma once
+#include "precomp.h"
+#include "EventLoop.h"
+#include "ProcessMonitor.h"
+#if HAVE_XCB
+#include <xcb/xcb.h>
+#endif
+
+namespace wslgd
+{
+    // Changes the X server's font path without blocking the event loop. With xcb this is a
+    // GetFontPath and SetFontPath on a connection to $DISPLAY owned by a worker thread, otherwise
+    // xset is run for each change. Changes are applied one at a time, in the order requested, and
+    // their callbacks run on the event loop.
+    class X11FontPath
+    {
+    public:
+        // The folders a change actually took out of and put into the font path.
+        struct Result
+        {
+            bool succeeded = false;
+            std::vector<std::string> removed{};
+            std::vector<std::string> added{};
+        };
+
+        X11FontPath(EventLoop& loop, ProcessMonitor& monitor);
+        ~X11FontPath() { Disconnect(); }
+        X11FontPath(const X11FontPath&) = delete;
+        void operator=(const X11FontPath&) = delete;
+
+        static bool IsAvailable();
+
+        // Disconnect drops the callbacks of the changes still queued, but the changes themselves
+        // are still applied, e.g. the final removal of the monitored folders.
+        void Connect(std::function<void(bool)>&& done);
+        void Disconnect();
+        bool IsConnected() const { return m_isConnected; }
+        void SetDisconnectCallback(std::function<void()>&& callback) { m_disconnectCallback = std::move(callback); }
+        void Change(std::vector<std::string>&& removes, std::vector<std::string>&& adds, bool isRehash,
+                    std::function<void(const Result&)>&& done);
+
+    private:
+        struct Request
+        {
+            std::vector<std::string> removes{};
+            std::vector<std::string> adds{};
+            bool isRehash = false;
+        };
+
+        void Complete(const Result& result);
+
+#if HAVE_XCB
+        enum class ReplyType
+        {
+            Connected,
+            ConnectFailed,
+            Changed,
+            Disconnected
+        };
+
+        struct Reply
+        {
+            ReplyType type;
+            Result result{};
+        };
+
+        // Shared with the worker thread, which outlives Disconnect until the queued changes are applied.
+        struct Worker
+        {
+            std::string display; /* resolved on the event loop, the worker never reads the environment */
+            std::string authName;
+            std::string authData;
+            std::mutex lock;
+            std::deque<Request> requests{};
+            std::deque<Reply> replies{};
+            bool isStopping = false;
+            wil::unique_fd wakeFd; /* eventfd, signals new requests or stopping to the worker */
+            wil::unique_fd replyFd; /* eventfd, signals new replies to the event loop */
+        };
+
+        static void RunWorker(std::shared_ptr<Worker> worker);
+        static void PostReply(Worker& worker, Reply&& reply);
+        static void Apply(xcb_connection_t *connection, const Request& request, Result& result);
+        static bool SetFontPath(xcb_connection_t *connection, const std::vector<std::string>& removes,
+                                const std::vector<std::string>& adds, bool isRehash);
+        void HandleReplies();
+
+        std::shared_ptr<Worker> m_worker;
+        std::function<void(bool)> m_connectCallback;
+#else
+        static std::vector<std::string> GetXsetArgv(const Request& request);
+        void ChangeNext();
+        void ChangeEach(std::shared_ptr<Request> request, std::shared_ptr<Result> result, size_t index);
+        void RunXset(const Request& request, std::function<void(bool)>&& done);
+
+        std::deque<Request> m_requests{}; /* waiting for the running xset */
+        int m_xsetPid = -1; /* running xset */
+#endif
+
+        EventLoop& m_loop;
+        ProcessMonitor& m_monitor;
+        bool m_isConnected = false;
+        std::deque<std::function<void(const Result&)>> m_changeCallbacks{}; /* of the changes not completed yet, in order */
+        std::function<void()> m_disconnectCallback;
+    };
+}
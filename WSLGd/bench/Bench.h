@@ -0,0 +1,27 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+#pragma once
+#include "precomp.h"
+
+namespace wslgd::bench
+{
+    inline uint64_t GetTimeNs()
+    {
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        return (static_cast<uint64_t>(now.tv_sec) * 1000000000ull) + now.tv_nsec;
+    }
+
+    // Prints the mean cost of one operation out of count, measured together over elapsedNs.
+    inline void Report(const char *name, uint64_t count, uint64_t elapsedNs)
+    {
+        printf("%-40s %10llu ops %12.3f us/op\n", name, static_cast<unsigned long long>(count),
+            count ? (elapsedNs / 1000.0 / count) : 0.0);
+    }
+
+    // The run count, from the first argument when given.
+    inline uint64_t GetCount(int argc, char *argv[], uint64_t defaultCount)
+    {
+        return (argc > 1) ? strtoull(argv[1], nullptr, 10) : defaultCount;
+    }
+}
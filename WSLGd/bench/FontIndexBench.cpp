@@ -0,0 +1,114 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+#include "precomp.h"
+#include "common.h"
+#include "EventLoop.h"
+#include "ProcessMonitor.h"
+#include "FontMonitor.h"
+#include "Logger.h"
+#include "LogFile.h"
+#include "Bench.h"
+#include "Sandbox.h"
+
+// Scans a large font collection in the user distro's X11 fonts, e.g. TeX or Noto with families of
+// folders, then handles ten events per folder on random folders: font files and fonts.dir created and
+// removed, as a package upgrade does. Events are read in batches below the inotify queue limit, only
+// reading and handling them is measured.
+//
+// Usage: FontIndexBench [folders]
+constexpr auto c_x11FontPath = USER_DISTRO_MOUNT_PATH "/usr/share/fonts/X11";
+constexpr uint64_t c_foldersPerFamily = 100;
+constexpr uint64_t c_eventsPerFolder = 10;
+constexpr uint64_t c_eventsPerBatch = 8192;
+
+std::string GetFolder(uint64_t index)
+{
+    return std::string(c_x11FontPath) + "/family-" + std::to_string(index / c_foldersPerFamily) +
+        "/folder-" + std::to_string(index % c_foldersPerFamily);
+}
+
+uint64_t GetMetric(const wslgd::FontMonitor& fontMonitor, const char *name)
+{
+    std::string metrics;
+    fontMonitor.WriteMetrics(metrics);
+    auto found = metrics.find(std::string("\n") + name + " ");
+    THROW_ERRNO_IF(ENOENT, found == std::string::npos);
+    return strtoull(metrics.c_str() + found + strlen(name) + 2, nullptr, 10);
+}
+
+int main(int argc, char *argv[])
+try {
+    if (std::filesystem::path(argv[0]).filename() == "xset") {
+        return 0;
+    }
+
+    if (!wslgd::bench::EnterSandbox()) {
+        printf("skipped, the sandbox needs root\n");
+        return wslgd::test::c_skipped;
+    }
+
+    uint64_t folders = wslgd::bench::GetCount(argc, argv, 10000);
+    uint64_t events = folders * c_eventsPerFolder;
+#if !HAVE_XCB
+    wslgd::bench::AddStandIn("/usr/bin/xset");
+#endif
+
+    for (uint64_t i = 0; i < folders; i++) {
+        std::filesystem::create_directories(GetFolder(i));
+    }
+
+    // Logged as WSLGd does, to its log file.
+    wslgd::Logger::Start(std::make_unique<wslgd::LogFile>(SHARE_PATH "/stderr.log", 2 * 1024 * 1024, 4));
+    wslgd::EventLoop loop;
+    wslgd::ProcessMonitor monitor(getpwuid(getuid())->pw_name, loop);
+    wslgd::FontMonitor fontMonitor(loop, monitor);
+
+    auto start = wslgd::bench::GetTimeNs();
+    THROW_LAST_ERROR_IF(fontMonitor.Scan() < 0);
+    auto elapsedNs = wslgd::bench::GetTimeNs() - start;
+    auto watched = GetMetric(fontMonitor, "wslgd_font_folders");
+    THROW_ERRNO_IF(ENOSPC, watched < folders);
+    wslgd::bench::Report("scan, per folder", watched, elapsedNs);
+
+    // Each step creates a file where there is none, IN_CREATE and IN_CLOSE_WRITE, or removes it, IN_DELETE.
+    std::mt19937 random(42);
+    std::vector<uint8_t> hasFile(folders, 0);
+    uint64_t generated = 0;
+    elapsedNs = 0;
+    while (generated < events) {
+        uint64_t batch = 0;
+        while ((batch < c_eventsPerBatch) && ((generated + batch) < events)) {
+            uint64_t index = random() % folders;
+            std::string path = GetFolder(index) + ((index % 4) ? "/font.pcf.gz" : "/fonts.dir");
+            if (hasFile[index]) {
+                THROW_LAST_ERROR_IF(unlink(path.c_str()) < 0);
+                batch += 1;
+            } else {
+                wil::unique_fd fd(open(path.c_str(), (O_WRONLY | O_CREAT | O_CLOEXEC), 0644));
+                THROW_LAST_ERROR_IF(!fd);
+                batch += 2;
+            }
+
+            hasFile[index] = !hasFile[index];
+        }
+
+        start = wslgd::bench::GetTimeNs();
+        fontMonitor.HandleEvents();
+        elapsedNs += wslgd::bench::GetTimeNs() - start;
+        generated += batch;
+    }
+
+    // Every event must have been read, an overflow would rescan instead.
+    auto handled = GetMetric(fontMonitor, "wslgd_font_events_total");
+    THROW_ERRNO_IF(EOVERFLOW, handled != generated);
+    wslgd::bench::Report("events, per event", handled, elapsedNs);
+
+    start = wslgd::bench::GetTimeNs();
+    fontMonitor.Stop();
+    elapsedNs = wslgd::bench::GetTimeNs() - start;
+    wslgd::bench::Report("stop, per folder", watched, elapsedNs);
+
+    wslgd::Logger::Stop();
+    return 0;
+}
+CATCH_RETURN_ERRNO();
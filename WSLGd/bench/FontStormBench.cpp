@@ -0,0 +1,383 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+#include "precomp.h"
+#include "common.h"
+#include "EventLoop.h"
+#include "ProcessMonitor.h"
+#include "FontMonitor.h"
+#include "Logger.h"
+#include "LogFile.h"
+#include "Bench.h"
+#include "Sandbox.h"
+
+// Replays the installation and then the removal of a font package with many folders in the user
+// distro's X11 fonts, as dpkg does it: every folder and font file first, then each folder's fonts.dir
+// and fonts.alias from the mkfontdir trigger. Reports the X11 font path changes FontMonitor makes for
+// it, and how long after the last write the font path is the expected one.
+//
+// With xcb, the X server is a fake one answering the font path requests, otherwise xset is a stand-in
+// logging its command lines. fc-cache is a stand-in too.
+//
+// Usage: FontStormBench [folders]
+constexpr auto c_x11FontPath = USER_DISTRO_MOUNT_PATH "/usr/share/fonts/X11";
+constexpr auto c_display = ":42";
+constexpr auto c_xSocketDir = "/tmp/.X11-unix";
+constexpr auto c_xSocket = "/tmp/.X11-unix/X42";
+constexpr auto c_xsetLog = SHARE_PATH "/xset.log";
+constexpr uint64_t c_fontsPerFolder = 4;
+constexpr uint64_t c_runs = 3;
+constexpr uint64_t c_connectMs = 200;
+constexpr uint64_t c_pollMs = 5;
+constexpr uint64_t c_settleTimeoutMs = 60000;
+
+// The font path as the X server sees it.
+struct FontPathState
+{
+    std::mutex lock;
+    std::set<std::string> paths;
+    uint64_t changes = 0; /* SetFontPath requests, or xset runs */
+    uint64_t requests = 0; /* every request, or xset runs */
+};
+
+FontPathState s_fontPath;
+
+bool ReadAll(int fd, void *buffer, size_t size)
+{
+    auto data = static_cast<uint8_t*>(buffer);
+    while (size > 0) {
+        ssize_t length = read(fd, data, size);
+        if (length <= 0) {
+            return false;
+        }
+
+        data += length;
+        size -= length;
+    }
+
+    return true;
+}
+
+void Put16(uint8_t *data, uint16_t value)
+{
+    memcpy(data, &value, sizeof(value));
+}
+
+void Put32(uint8_t *data, uint32_t value)
+{
+    memcpy(data, &value, sizeof(value));
+}
+
+size_t Pad(size_t size)
+{
+    return (size + 3) & ~3;
+}
+
+// Answers a client in the host's byte order, as xcb connects, with no screens. Only GetFontPath,
+// SetFontPath and the requests xcb makes by itself are understood, everything else is ignored.
+void ServeXClient(int fd)
+{
+    uint8_t setup[12];
+    if (!ReadAll(fd, setup, sizeof(setup))) {
+        return;
+    }
+
+    uint16_t nameLength, dataLength;
+    memcpy(&nameLength, setup + 6, sizeof(nameLength));
+    memcpy(&dataLength, setup + 8, sizeof(dataLength));
+    std::vector<uint8_t> authorization(Pad(nameLength) + Pad(dataLength));
+    if (!ReadAll(fd, authorization.data(), authorization.size())) {
+        return;
+    }
+
+    uint8_t accepted[40] = {1, 0};
+    Put16(accepted + 2, 11);
+    Put16(accepted + 6, 8);
+    Put32(accepted + 12, 0x200000); /* resource id base */
+    Put32(accepted + 16, 0x1fffff); /* resource id mask */
+    Put16(accepted + 26, 0xffff); /* maximum request length */
+    accepted[32] = 32; /* scanline unit and pad */
+    accepted[33] = 32;
+    accepted[34] = 8; /* keycodes */
+    accepted[35] = 255;
+    if (write(fd, accepted, sizeof(accepted)) != sizeof(accepted)) {
+        return;
+    }
+
+    uint16_t sequence = 0;
+    for (;;) {
+        uint8_t header[4];
+        if (!ReadAll(fd, header, sizeof(header))) {
+            return;
+        }
+
+        uint16_t length;
+        memcpy(&length, header + 2, sizeof(length));
+        if (length == 0) {
+            return;
+        }
+
+        std::vector<uint8_t> body((length * 4) - sizeof(header));
+        if (!ReadAll(fd, body.data(), body.size())) {
+            return;
+        }
+
+        sequence++;
+        std::vector<uint8_t> reply(32);
+        reply[0] = 1;
+        Put16(&reply[2], sequence);
+        std::lock_guard<std::mutex> lock(s_fontPath.lock);
+        s_fontPath.requests++;
+        switch (header[0]) {
+        case 43: /* GetInputFocus, for xcb_request_check */
+        case 98: /* QueryExtension, BigRequests is not present */
+            break;
+
+        case 51: /* SetFontPath */
+        {
+            uint16_t count;
+            memcpy(&count, body.data(), sizeof(count));
+            s_fontPath.paths.clear();
+            for (size_t offset = 4; count > 0; count--) {
+                s_fontPath.paths.emplace(reinterpret_cast<char*>(&body[offset + 1]), body[offset]);
+                offset += 1 + body[offset];
+            }
+
+            s_fontPath.changes++;
+            continue;
+        }
+
+        case 52: /* GetFontPath */
+            for (auto &path : s_fontPath.paths) {
+                reply.push_back(path.size());
+                reply.insert(reply.end(), path.begin(), path.end());
+            }
+
+            reply.resize(Pad(reply.size()));
+            Put32(&reply[4], (reply.size() - 32) / 4);
+            Put16(&reply[8], s_fontPath.paths.size());
+            break;
+
+        default:
+            continue;
+        }
+
+        if (write(fd, reply.data(), reply.size()) != static_cast<ssize_t>(reply.size())) {
+            return;
+        }
+    }
+}
+
+void ServeX(wil::unique_fd&& listenFd)
+{
+    for (;;) {
+        wil::unique_fd fd(accept4(listenFd.get(), nullptr, nullptr, SOCK_CLOEXEC));
+        if (fd) {
+            ServeXClient(fd.get());
+        }
+    }
+}
+
+void StartX()
+{
+    std::filesystem::create_directories(c_xSocketDir);
+    THROW_LAST_ERROR_IF(mount("tmpfs", c_xSocketDir, "tmpfs", 0, nullptr) < 0);
+    wil::unique_fd socketFd{socket(AF_UNIX, (SOCK_STREAM | SOCK_CLOEXEC), 0)};
+    THROW_LAST_ERROR_IF(!socketFd);
+
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, c_xSocket);
+    THROW_LAST_ERROR_IF(bind(socketFd.get(), reinterpret_cast<const sockaddr*>(&address), sizeof(address)) < 0);
+    THROW_LAST_ERROR_IF(listen(socketFd.get(), SOMAXCONN) < 0);
+    THROW_LAST_ERROR_IF(setenv("DISPLAY", c_display, true) < 0);
+    std::thread(ServeX, std::move(socketFd)).detach();
+}
+
+// Applies the xset command lines logged since the last call, e.g. "-fp a,b +fp c fp rehash".
+void ReplayXsetLog()
+{
+    static size_t s_offset = 0;
+    std::string log;
+    {
+        wil::unique_fd fd(open(c_xsetLog, (O_RDONLY | O_CLOEXEC)));
+        std::array<char, 4096> buffer;
+        ssize_t size;
+        while (fd && ((size = pread(fd.get(), buffer.data(), buffer.size(), s_offset + log.size())) > 0)) {
+            log.append(buffer.data(), size);
+        }
+    }
+
+    log.resize(log.rfind('\n') + 1);
+    s_offset += log.size();
+    std::lock_guard<std::mutex> lock(s_fontPath.lock);
+    char *savePtr = nullptr;
+    for (char *line = strtok_r(&log[0], "\n", &savePtr); line; line = strtok_r(nullptr, "\n", &savePtr)) {
+        s_fontPath.changes++;
+        s_fontPath.requests++;
+        std::vector<std::string> args;
+        char *argSavePtr = nullptr;
+        for (char *arg = strtok_r(line, " ", &argSavePtr); arg; arg = strtok_r(nullptr, " ", &argSavePtr)) {
+            args.emplace_back(arg);
+        }
+
+        for (size_t i = 0; i + 1 < args.size(); i++) {
+            bool isAdd = (args[i] == "+fp");
+            if (!isAdd && (args[i] != "-fp")) {
+                continue;
+            }
+
+            std::string list = args[++i];
+            char *pathSavePtr = nullptr;
+            for (char *path = strtok_r(&list[0], ",", &pathSavePtr); path; path = strtok_r(nullptr, ",", &pathSavePtr)) {
+                if (isAdd) {
+                    s_fontPath.paths.insert(path);
+                } else {
+                    s_fontPath.paths.erase(path);
+                }
+            }
+        }
+    }
+}
+
+int RunStandIn(const std::string& name, int argc, char *argv[])
+{
+    if (name == "xset") {
+        std::string line;
+        for (int i = 1; i < argc; i++) {
+            line += std::string(line.empty() ? "" : " ") + argv[i];
+        }
+
+        line += "\n";
+        wil::unique_fd fd(open(c_xsetLog, (O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC), 0644));
+        THROW_LAST_ERROR_IF(!fd);
+        THROW_LAST_ERROR_IF(write(fd.get(), line.data(), line.size()) != static_cast<ssize_t>(line.size()));
+    }
+
+    return 0;
+}
+
+std::string GetFolder(uint64_t index)
+{
+    return std::string(c_x11FontPath) + "/font-" + std::to_string(index);
+}
+
+void Install(uint64_t folders)
+{
+    for (uint64_t i = 0; i < folders; i++) {
+        for (uint64_t font = 0; font < c_fontsPerFolder; font++) {
+            wslgd::test::WriteFile(GetFolder(i) + "/font-" + std::to_string(font) + ".pcf.gz", std::string(4096, 'f'));
+        }
+    }
+
+    for (uint64_t i = 0; i < folders; i++) {
+        std::string fontsDir = std::to_string(c_fontsPerFolder) + "\n";
+        for (uint64_t font = 0; font < c_fontsPerFolder; font++) {
+            fontsDir += "font-" + std::to_string(font) + ".pcf.gz -misc-bench-medium-r-normal--0-0-75-75-c-0-iso10646-1\n";
+        }
+
+        wslgd::test::WriteFile(GetFolder(i) + "/fonts.dir", fontsDir);
+        wslgd::test::WriteFile(GetFolder(i) + "/fonts.alias", "bench -misc-bench-medium-r-normal--0-0-75-75-c-0-iso10646-1\n");
+    }
+}
+
+void Remove(uint64_t folders)
+{
+    for (uint64_t i = 0; i < folders; i++) {
+        std::filesystem::remove_all(GetFolder(i));
+    }
+}
+
+// Runs the storm on another thread, as another process would, until the font path is expected.
+void RunStorm(wslgd::EventLoop& loop, const char *name, std::function<void()>&& storm, std::set<std::string>&& expected)
+{
+    uint64_t changes, requests;
+    {
+        std::lock_guard<std::mutex> lock(s_fontPath.lock);
+        changes = s_fontPath.changes;
+        requests = s_fontPath.requests;
+    }
+
+    auto start = wslgd::bench::GetTimeNs();
+    std::atomic<uint64_t> lastWrite{0};
+    std::thread writer([&]() {
+        storm();
+        lastWrite = wslgd::bench::GetTimeNs();
+    });
+
+    uint64_t settled = 0;
+    std::function<void()> poll = [&]() {
+#if !HAVE_XCB
+        ReplayXsetLog();
+#endif
+        auto now = wslgd::bench::GetTimeNs();
+        std::lock_guard<std::mutex> lock(s_fontPath.lock);
+        if (lastWrite && (s_fontPath.paths == expected)) {
+            settled = now;
+            loop.Stop(0);
+        } else if ((now - start) > (c_settleTimeoutMs * 1000000)) {
+            loop.Stop(1);
+        } else {
+            loop.AddTimer(c_pollMs, [&]() { poll(); });
+        }
+    };
+
+    poll();
+    int exitCode = loop.Run();
+    writer.join();
+    THROW_ERRNO_IF(ETIMEDOUT, exitCode != 0);
+
+    std::lock_guard<std::mutex> lock(s_fontPath.lock);
+    printf("%-40s %10.3f ms writing %10.3f ms settling %6llu font path changes %6llu X requests\n", name,
+        (lastWrite - start) / 1000000.0, (settled - lastWrite) / 1000000.0,
+        static_cast<unsigned long long>(s_fontPath.changes - changes),
+        static_cast<unsigned long long>(s_fontPath.requests - requests));
+}
+
+int main(int argc, char *argv[])
+try {
+    std::string name = std::filesystem::path(argv[0]).filename();
+    if ((name == "xset") || (name == "fc-cache")) {
+        return RunStandIn(name, argc, argv);
+    }
+
+    if (!wslgd::bench::EnterSandbox()) {
+        printf("skipped, the sandbox needs root\n");
+        return wslgd::test::c_skipped;
+    }
+
+    uint64_t folders = wslgd::bench::GetCount(argc, argv, 200);
+    wslgd::bench::AddStandIn("/usr/bin/fc-cache");
+#if HAVE_XCB
+    StartX();
+#else
+    wslgd::bench::AddStandIn("/usr/bin/xset");
+#endif
+
+    // Logged as WSLGd does, to its log file.
+    wslgd::Logger::Start(std::make_unique<wslgd::LogFile>(SHARE_PATH "/stderr.log", 2 * 1024 * 1024, 4));
+    std::filesystem::create_directories(c_x11FontPath);
+    wslgd::EventLoop loop;
+    wslgd::ProcessMonitor monitor(getpwuid(getuid())->pw_name, loop);
+    wslgd::FontMonitor fontMonitor(loop, monitor);
+    THROW_LAST_ERROR_IF(fontMonitor.Scan() < 0);
+    THROW_LAST_ERROR_IF(fontMonitor.Start() < 0);
+
+    // The X server is connected on the side, the storms start once that is done.
+    loop.AddTimer(c_connectMs, [&]() { loop.Stop(0); });
+    loop.Run();
+
+    std::set<std::string> installed;
+    for (uint64_t i = 0; i < folders; i++) {
+        installed.insert(GetFolder(i));
+    }
+
+    for (uint64_t run = 0; run < c_runs; run++) {
+        RunStorm(loop, ("install " + std::to_string(folders) + " folders").c_str(), [&]() { Install(folders); }, std::set<std::string>(installed));
+        RunStorm(loop, ("remove " + std::to_string(folders) + " folders").c_str(), [&]() { Remove(folders); }, {});
+    }
+
+    fontMonitor.Stop();
+    wslgd::Logger::Stop();
+    return 0;
+}
+CATCH_RETURN_ERRNO();
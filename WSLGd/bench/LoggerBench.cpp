@@ -0,0 +1,81 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+#include "precomp.h"
+#include "common.h"
+#include "Logger.h"
+#include "Bench.h"
+
+// The cost of one LOG_INFO to the caller: written synchronously as before the logger starts,
+// queued on the ring in bursts it holds, flooding it from one and from several threads, and
+// filtered out by the level. The log goes to the path given second, /dev/null by default, which
+// is never rotated.
+constexpr int c_threads = 4;
+constexpr uint64_t c_burst = 256; /* half the ring */
+
+uint64_t LogMessages(uint64_t count)
+{
+    auto start = wslgd::bench::GetTimeNs();
+    for (uint64_t i = 0; i < count; i++) {
+        LOG_INFO("launching %s, pid %d, attempt %llu", "weston", 42, static_cast<unsigned long long>(i));
+    }
+
+    return wslgd::bench::GetTimeNs() - start;
+}
+
+// Bursts with a pause in between for the writer, only the logging is timed.
+uint64_t LogBursts(uint64_t count)
+{
+    uint64_t elapsedNs = 0;
+    for (uint64_t logged = 0; logged < count; logged += c_burst) {
+        elapsedNs += LogMessages(std::min(c_burst, count - logged));
+        usleep(2000);
+    }
+
+    return elapsedNs;
+}
+
+void ReportDropped(uint64_t& dropped)
+{
+    printf("%-40s %10llu\n", "  dropped", static_cast<unsigned long long>(wslgd::Logger::GetDropped() - dropped));
+    dropped = wslgd::Logger::GetDropped();
+}
+
+int main(int argc, char *argv[])
+try {
+    uint64_t count = wslgd::bench::GetCount(argc, argv, 100000);
+    const char *path = (argc > 2) ? argv[2] : "/dev/null";
+
+    // Before Start, messages are formatted and written by the caller.
+    int output = open(path, O_WRONLY | O_CLOEXEC);
+    THROW_LAST_ERROR_IF(output < 0);
+    int savedStderr = dup(STDERR_FILENO);
+    THROW_LAST_ERROR_IF((savedStderr < 0) || (dup2(output, STDERR_FILENO) < 0));
+    close(output);
+    wslgd::bench::Report("synchronous write", count, LogMessages(count));
+    THROW_LAST_ERROR_IF(dup2(savedStderr, STDERR_FILENO) < 0);
+    close(savedStderr);
+
+    wslgd::Logger::Start(std::make_unique<wslgd::LogFile>(path, 64 * 1024 * 1024, 1));
+    uint64_t dropped = 0;
+    wslgd::bench::Report("ring, bursts", count, LogBursts(count));
+    ReportDropped(dropped);
+    wslgd::bench::Report("ring, flood, 1 thread", count, LogMessages(count));
+    ReportDropped(dropped);
+
+    std::atomic<uint64_t> elapsedNs{0};
+    std::vector<std::thread> threads;
+    for (int i = 0; i < c_threads; i++) {
+        threads.emplace_back([&]() { elapsedNs += LogMessages(count); });
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+    wslgd::bench::Report("ring, flood, 4 threads", c_threads * count, elapsedNs);
+    ReportDropped(dropped);
+
+    wslgd::Logger::SetLevel(LOG_LEVEL_ERROR);
+    wslgd::bench::Report("filtered by level", count, LogMessages(count));
+    wslgd::Logger::Stop();
+    return 0;
+}
+CATCH_RETURN_ERRNO();
@@ -0,0 +1,54 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+#include "precomp.h"
+#include "common.h"
+#include "PathTranslator.h"
+#include "Bench.h"
+
+// Compares translating the rdp client's Windows path in-process with what each wslpath run costs
+// before wslpath does any work, a popen of a trivial program. The mountinfo holds the drive mounts
+// of a typical user distro among the system distro's own mounts.
+int main(int argc, char *argv[])
+try {
+    uint64_t count = wslgd::bench::GetCount(argc, argv, 1000);
+    char folder[] = "/tmp/wslgd-bench.XXXXXX";
+    THROW_LAST_ERROR_IF(!mkdtemp(folder));
+    std::string mountInfo = std::string(folder) + "/mountinfo";
+    auto cleanup = wil::scope_exit([&]() { unlink(mountInfo.c_str()); rmdir(folder); });
+    {
+        std::unique_ptr<FILE, decltype(&fclose)> file(fopen(mountInfo.c_str(), "w"), fclose);
+        THROW_LAST_ERROR_IF(!file);
+        for (int i = 0; i < 40; i++) {
+            fprintf(file.get(), "%d 22 0:%d / /run/mount%d rw,nosuid - tmpfs none rw,mode=755\n", 100 + i, 30 + i, i);
+        }
+        for (char drive = 'c'; drive <= 'f'; drive++) {
+            fprintf(file.get(), "%d 22 0:%d / /mnt/%c rw,noatime - 9p %c:\\134 rw,aname=drvfs;path=%c:\\\n",
+                200 + drive, 80 + drive, drive, toupper(drive), toupper(drive));
+        }
+    }
+
+    const char *path = "C:\\Program Files\\WindowsApps\\MicrosoftCorporationII.WindowsSubsystemForLinux\\msrdc.exe";
+    auto start = wslgd::bench::GetTimeNs();
+    for (uint64_t i = 0; i < count; i++) {
+        wslgd::PathTranslator translator(mountInfo);
+        translator.Translate(path);
+    }
+    wslgd::bench::Report("translate, first call with mountinfo", count, wslgd::bench::GetTimeNs() - start);
+
+    wslgd::PathTranslator translator(mountInfo);
+    translator.Translate(path);
+    start = wslgd::bench::GetTimeNs();
+    for (uint64_t i = 0; i < count * 100; i++) {
+        translator.Translate(path);
+    }
+    wslgd::bench::Report("translate, later calls", count * 100, wslgd::bench::GetTimeNs() - start);
+
+    start = wslgd::bench::GetTimeNs();
+    for (uint64_t i = 0; i < count; i++) {
+        std::unique_ptr<FILE, decltype(&pclose)> pipe(popen("/bin/true", "r"), pclose);
+        THROW_LAST_ERROR_IF(!pipe);
+    }
+    wslgd::bench::Report("popen of /bin/true, the wslpath floor", count, wslgd::bench::GetTimeNs() - start);
+    return 0;
+}
+CATCH_RETURN_ERRNO();
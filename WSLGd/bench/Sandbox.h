@@ -0,0 +1,43 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+#pragma once
+#include "precomp.h"
+#include "common.h"
+#include "tests/Helpers.h"
+
+namespace wslgd::bench
+{
+    // Moves the benchmark to a private mount namespace with an empty SHARE_PATH, so it can use the
+    // paths WSLGd does without touching the host. Needs root, false otherwise.
+    inline bool EnterSandbox()
+    {
+        if (geteuid() != 0) {
+            return false;
+        }
+
+        THROW_LAST_ERROR_IF(unshare(CLONE_NEWNS) < 0);
+        THROW_LAST_ERROR_IF(mount(nullptr, "/", nullptr, (MS_REC | MS_PRIVATE), nullptr) < 0);
+        std::filesystem::create_directories(SHARE_PATH);
+        THROW_LAST_ERROR_IF(mount("tmpfs", SHARE_PATH, "tmpfs", 0, nullptr) < 0);
+        return true;
+    }
+
+    // Puts this binary at path, e.g. /usr/bin/xset, to be run under that name. The folder is
+    // overlaid within the sandbox, with its upper layer in SHARE_PATH.
+    inline void AddStandIn(const char *path)
+    {
+        static std::set<std::string> s_overlays;
+        auto folder = std::filesystem::path(path).parent_path().string();
+        if (s_overlays.insert(folder).second) {
+            std::string layer = SHARE_PATH "/.overlay-" + std::to_string(s_overlays.size());
+            std::filesystem::create_directories(layer + "/upper");
+            std::filesystem::create_directories(layer + "/work");
+            std::string options = "lowerdir=" + folder + ",upperdir=" + layer + "/upper,workdir=" + layer + "/work";
+            THROW_LAST_ERROR_IF(mount("overlay", folder.c_str(), "overlay", 0, options.c_str()) < 0);
+        }
+
+        std::error_code error;
+        std::filesystem::remove(path, error);
+        std::filesystem::create_symlink(std::filesystem::read_symlink("/proc/self/exe"), path);
+    }
+}
@@ -0,0 +1,76 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+#include "precomp.h"
+#include "common.h"
+#include "EventLoop.h"
+#include "ProcessMonitor.h"
+#include "Bench.h"
+
+// Launches /bin/true through ProcessMonitor's clone path and through fork and execve, first from
+// a small parent and then from one with a large resident heap, which fork copies the page tables
+// of. "blocked" is the time the parent spends in the launch call, "round trip" runs to the reaped exit.
+constexpr auto c_program = "/bin/true";
+constexpr size_t c_ballastSize = 512 * 1024 * 1024;
+
+void RunClone(wslgd::ProcessMonitor& monitor, wslgd::EventLoop& loop, uint64_t count, const char *label)
+{
+    uint64_t launched = 0;
+    uint64_t blockedNs = 0;
+    std::function<void(int)> launchNext = [&](int) {
+        if (launched == count) {
+            loop.Stop(0);
+            return;
+        }
+
+        launched++;
+        auto start = wslgd::bench::GetTimeNs();
+        monitor.LaunchHelper({c_program}, false, [&](int status) { launchNext(status); });
+        blockedNs += wslgd::bench::GetTimeNs() - start;
+    };
+
+    auto start = wslgd::bench::GetTimeNs();
+    launchNext(0);
+    loop.Run();
+    auto elapsedNs = wslgd::bench::GetTimeNs() - start;
+    wslgd::bench::Report((std::string("clone, blocked, ") + label).c_str(), count, blockedNs);
+    wslgd::bench::Report((std::string("clone, round trip, ") + label).c_str(), count, elapsedNs);
+}
+
+void RunFork(uint64_t count, const char *label)
+{
+    uint64_t blockedNs = 0;
+    auto start = wslgd::bench::GetTimeNs();
+    for (uint64_t i = 0; i < count; i++) {
+        auto launchStart = wslgd::bench::GetTimeNs();
+        int pid = fork();
+        THROW_LAST_ERROR_IF(pid < 0);
+        if (pid == 0) {
+            execl(c_program, c_program, nullptr);
+            _exit(127);
+        }
+
+        blockedNs += wslgd::bench::GetTimeNs() - launchStart;
+        int status;
+        THROW_LAST_ERROR_IF(waitpid(pid, &status, 0) < 0);
+    }
+
+    auto elapsedNs = wslgd::bench::GetTimeNs() - start;
+    wslgd::bench::Report((std::string("fork, blocked, ") + label).c_str(), count, blockedNs);
+    wslgd::bench::Report((std::string("fork, round trip, ") + label).c_str(), count, elapsedNs);
+}
+
+int main(int argc, char *argv[])
+try {
+    uint64_t count = wslgd::bench::GetCount(argc, argv, 500);
+    wslgd::EventLoop loop;
+    wslgd::ProcessMonitor monitor(getpwuid(getuid())->pw_name, loop);
+
+    RunClone(monitor, loop, count, "small parent");
+    RunFork(count, "small parent");
+
+    std::vector<char> ballast(c_ballastSize, 1);
+    RunClone(monitor, loop, count, "512 MiB parent");
+    RunFork(count, "512 MiB parent");
+    return 0;
+}
+CATCH_RETURN_ERRNO();
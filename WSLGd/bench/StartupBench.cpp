@@ -0,0 +1,542 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+#include "precomp.h"
+#include <sys/ptrace.h>
+#include "common.h"
+#include "EventLoop.h"
+#include "Trace.h"
+#include "tests/Helpers.h"
+
+// Boots the real WSLGd, with the service manifest from config/services.d, again and again in a private
+// mount and pid namespace. Its root is an overlay of the host's root with stand-ins for weston, dbus,
+// pulseaudio, the rdp client, wslinfo, wslpath, xset and fc-cache, which are this same binary run under
+// their names. The stand-in weston connects to its notify socket as wslgd-notify.so does, and the
+// others listen where their readiness is checked. The stand-in rdp client connects to the vsock of
+// /hvsocketserviceid over loopback, which the stand-in weston accepts as the rdp backend does.
+//
+// Reported from exec of WSLGd: the time to ready, i.e. the "startup complete" mark of its trace, and
+// the time to each launch. Separate runs under ptrace count the processes, threads and execs it takes
+// to get to ready. The first run has no probe cache, the others reuse the cache of the previous boot.
+// Also reported, with the rdp client launched after weston and with WSLG_RDP_CLIENT_EARLY_LAUNCH, the
+// time from launch of the rdp client to the first connection weston accepts. It is not reported if
+// the kernel has no vsock loopback.
+//
+// N.B. A user namespace is not enough, binding a vsock port below 1024 needs CAP_NET_BIND_SERVICE in
+//      the initial namespace, so this needs root and is skipped otherwise.
+//
+// Usage: StartupBench <WSLGd> <config/services.d> [runs]
+constexpr auto c_benchDir = "/run/wslgd-bench";
+constexpr auto c_launchLog = "/run/wslgd-bench/launches";
+constexpr auto c_traceFile = "/run/wslgd-bench/trace.json";
+constexpr auto c_rdpConnectFile = "/run/wslgd-bench/rdp-connect";
+constexpr auto c_standIn = "/usr/libexec/wslgd-bench/stand-in";
+constexpr auto c_wslgd = "/usr/libexec/wslgd-bench/WSLGd";
+constexpr auto c_vmId = "0F1E2D3C-4B5A-6978-8796-A5B4C3D2E1F0";
+constexpr uint64_t c_defaultRuns = 20;
+constexpr uint64_t c_countedRuns = 3;
+constexpr uint64_t c_readyTimeoutMs = 30000;
+
+// Where WSLGd, the manifest and the shell it uses for popen expect them.
+constexpr std::pair<const char *, const char *> c_standIns[] = {
+    {"weston", "/usr/bin/weston"},
+    {"dbus-daemon", "/usr/bin/dbus-daemon"},
+    {"dbus-launch", "/usr/bin/dbus-launch"},
+    {"pulseaudio", "/usr/bin/pulseaudio"},
+    {"init", "/init"},
+    {"wslinfo", "/usr/bin/wslinfo"},
+    {"wslpath", "/usr/bin/wslpath"},
+    {"xset", "/usr/bin/xset"},
+    {"fc-cache", "/usr/bin/fc-cache"},
+};
+
+using wslgd::test::c_skipped;
+using wslgd::test::ReadFile;
+using wslgd::test::WriteFile;
+
+struct RunResult
+{
+    uint64_t readyUs = 0;
+    std::map<std::string, uint64_t> launchUs{}; /* first launch of each stand-in */
+    std::optional<uint64_t> rdpConnectUs{}; /* from launch of the rdp client */
+    uint64_t processes = 0;
+    uint64_t threads = 0;
+    uint64_t execs = 0;
+};
+
+wil::unique_fd Listen(const char *path, int type)
+{
+    wil::unique_fd socketFd{socket(AF_UNIX, (type | SOCK_CLOEXEC), 0)};
+    THROW_LAST_ERROR_IF(!socketFd);
+
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    snprintf(address.sun_path, sizeof(address.sun_path), "%s", path);
+    unlink(path);
+    THROW_LAST_ERROR_IF(bind(socketFd.get(), reinterpret_cast<const sockaddr*>(&address), sizeof(address)) < 0);
+    THROW_LAST_ERROR_IF(listen(socketFd.get(), SOMAXCONN) < 0);
+    return socketFd;
+}
+
+// Appends to one of the files the sandbox creates for the stand-ins, which may run as another user.
+void AppendLine(const char *path, const std::string& line)
+{
+    wil::unique_fd fd(open(path, (O_WRONLY | O_APPEND | O_CLOEXEC)));
+    if (fd) {
+        write(fd.get(), line.data(), line.size());
+    }
+}
+
+// Runs as one of the programs WSLGd launches, logging the launch first.
+int RunStandIn(const std::string& name, int argc, char *argv[])
+{
+    AppendLine(c_launchLog, name + " " + std::to_string(wslgd::Trace::Now()) + "\n");
+
+    wil::unique_fd socketFd;
+    if (name == "wslinfo") {
+        printf("%s", c_vmId);
+        return 0;
+    } else if (name == "wslpath") {
+        // C:\a\b to /mnt/c/a/b.
+        std::string path = argv[argc - 1];
+        if ((path.size() < 2) || (path[1] != ':')) {
+            return 1;
+        }
+
+        std::replace(path.begin(), path.end(), '\\', '/');
+        printf("/mnt/%c%s\n", tolower(path[0]), path.c_str() + 2);
+        return 0;
+    } else if (name == "dbus-launch") {
+        execv(argv[1], &argv[1]);
+        return 127;
+    } else if (name == "weston") {
+        // As wslgd-notify.so, once the compositor is up.
+        auto notifySocket = getenv("WSLGD_NOTIFY_SOCKET");
+        THROW_ERRNO_IF(EINVAL, !notifySocket);
+        socketFd.reset(socket(AF_UNIX, (SOCK_SEQPACKET | SOCK_CLOEXEC), 0));
+        THROW_LAST_ERROR_IF(!socketFd);
+        sockaddr_un address{};
+        address.sun_family = AF_UNIX;
+        snprintf(address.sun_path, sizeof(address.sun_path), "%s", notifySocket);
+        THROW_LAST_ERROR_IF(connect(socketFd.get(), reinterpret_cast<const sockaddr*>(&address), sizeof(address)) < 0);
+
+        // As the rdp backend, on the vsock WSLGd passed.
+        auto vsockFd = getenv("USE_VSOCK");
+        THROW_ERRNO_IF(EINVAL, !vsockFd);
+        wil::unique_fd connectionFd(accept4(atoi(vsockFd), nullptr, nullptr, SOCK_CLOEXEC));
+        THROW_LAST_ERROR_IF(!connectionFd);
+        AppendLine(c_rdpConnectFile, std::to_string(wslgd::Trace::Now()) + "\n");
+    } else if (name == "init") {
+        // The rdp client, connecting to the port in its service id. Without vsock loopback there is
+        // nothing to wait for.
+        for (int i = 1; i < argc; i++) {
+            if (strncmp(argv[i], "/hvsocketserviceid:", 19) == 0) {
+                sockaddr_vm address{};
+                address.svm_family = AF_VSOCK;
+                address.svm_cid = VMADDR_CID_LOCAL;
+                address.svm_port = strtoul(std::string(argv[i] + 19, 8).c_str(), nullptr, 16);
+                socketFd.reset(socket(AF_VSOCK, (SOCK_STREAM | SOCK_CLOEXEC), 0));
+                if (!socketFd || (connect(socketFd.get(), reinterpret_cast<const sockaddr*>(&address), sizeof(address)) < 0)) {
+                    AppendLine(c_rdpConnectFile, "failed\n");
+                }
+            }
+        }
+    } else if (name == "dbus-daemon") {
+        socketFd = Listen("/var/run/dbus/system_bus_socket", SOCK_STREAM);
+    } else if (name == "pulseaudio") {
+        // Socket activated pulseaudio gets its socket passed, otherwise it is in a --load option.
+        if (!getenv("LISTEN_FDS")) {
+            for (int i = 1; i < argc; i++) {
+                auto option = strstr(argv[i], "module-native-protocol-unix socket=");
+                if (option) {
+                    std::string path = strchr(option, '=') + 1;
+                    socketFd = Listen(path.substr(0, path.find(' ')).c_str(), SOCK_STREAM);
+                }
+            }
+        }
+    } else {
+        return 0;
+    }
+
+    for (;;) {
+        pause();
+    }
+}
+
+// Builds the root the sandboxes chroot to, an overlay of the host's root over a private tmpfs.
+std::string CreateRoot(const char *wslgdPath, const char *servicesDir)
+{
+    THROW_LAST_ERROR_IF(unshare(CLONE_NEWNS) < 0);
+    THROW_LAST_ERROR_IF(mount(nullptr, "/", nullptr, (MS_REC | MS_PRIVATE), nullptr) < 0);
+
+    static char base[] = "/tmp/wslgd-bench.XXXXXX";
+    THROW_LAST_ERROR_IF(!mkdtemp(base));
+    atexit([]() {
+        umount2(base, MNT_DETACH);
+        rmdir(base);
+    });
+
+    THROW_LAST_ERROR_IF(mount("tmpfs", base, "tmpfs", 0, nullptr) < 0);
+    std::string root = std::string(base) + "/root";
+    for (auto dir : {"/upper", "/work", "/root"}) {
+        std::filesystem::create_directories(std::string(base) + dir);
+    }
+
+    std::string options = std::string("lowerdir=/,upperdir=") + base + "/upper,workdir=" + base + "/work";
+    THROW_LAST_ERROR_IF(mount("overlay", root.c_str(), "overlay", 0, options.c_str()) < 0);
+    for (auto dir : {"/dev", "/sys"}) {
+        THROW_LAST_ERROR_IF(mount(dir, (root + dir).c_str(), nullptr, (MS_BIND | MS_REC), nullptr) < 0);
+    }
+
+    std::filesystem::create_directories(std::filesystem::path(root + c_standIn).parent_path());
+    std::filesystem::copy_file("/proc/self/exe", root + c_standIn);
+    std::filesystem::copy_file(wslgdPath, root + c_wslgd);
+    for (auto &standIn : c_standIns) {
+        std::error_code error;
+        std::filesystem::remove(root + standIn.second, error);
+        std::filesystem::create_directories(std::filesystem::path(root + standIn.second).parent_path());
+        std::filesystem::create_symlink(c_standIn, root + standIn.second);
+    }
+
+    // The service manifest from the source tree, and what else WSLGd expects of the system distro.
+    std::filesystem::remove_all(root + "/etc/wslg/services.d");
+    std::filesystem::create_directories(root + "/etc/wslg");
+    std::filesystem::copy(servicesDir, root + "/etc/wslg/services.d", std::filesystem::copy_options::recursive);
+    WriteFile(root + "/etc/passwd", ReadFile("/etc/passwd") + "wslg:x:4242:4242::/home/wslg:/bin/sh\n");
+    WriteFile(root + "/etc/group", ReadFile("/etc/group") + "wslg:x:4242:\n");
+    WriteFile(root + "/etc/versions.txt", "WSLGd: bench\n");
+    std::filesystem::create_directories(root + "/home/wslg");
+    std::filesystem::create_directories(root + "/usr/share/doc");
+    std::filesystem::remove_all(root + "/var/cache/wslgd");
+
+    // The Windows side, with msrdc installed.
+    WriteFile(root + "/mnt/c/ProgramData/Microsoft/WSL/msrdc.exe", "MZ", 0755);
+    WriteFile(root + "/mnt/c/Windows/System32/mstsc.exe", "MZ", 0755);
+    WriteFile(root + "/mnt/c/Windows/Media/Windows Default.wav", std::string(64 * 1024, '\0'));
+    return root;
+}
+
+bool HandleTraceStop(int pid, int status, RunResult& result, std::set<int>& attached)
+{
+    int event = status >> 16;
+    int signal = WSTOPSIG(status);
+    if (event != 0) {
+        unsigned long message = 0;
+        ptrace(PTRACE_GETEVENTMSG, pid, nullptr, &message);
+        if ((event == PTRACE_EVENT_FORK) || (event == PTRACE_EVENT_VFORK)) {
+            result.processes++;
+        } else if (event == PTRACE_EVENT_CLONE) {
+            // A clone is a thread unless it has its own thread group.
+            auto status = ReadFile(("/proc/" + std::to_string(message) + "/status").c_str());
+            auto tgid = strstr(status.c_str(), "\nTgid:");
+            if (tgid && (strtoul(tgid + 6, nullptr, 10) == message)) {
+                result.processes++;
+            } else {
+                result.threads++;
+            }
+        } else if (event == PTRACE_EVENT_EXEC) {
+            result.execs++;
+        }
+
+        signal = 0;
+    } else if ((signal == SIGTRAP) && (attached.count(pid) == 0)) {
+        // WSLGd stopping at its exec after PTRACE_TRACEME.
+        attached.insert(pid);
+        result.processes++;
+        result.execs++;
+        ptrace(PTRACE_SETOPTIONS, pid, nullptr,
+            (PTRACE_O_TRACEFORK | PTRACE_O_TRACEVFORK | PTRACE_O_TRACECLONE | PTRACE_O_TRACEEXEC | PTRACE_O_EXITKILL));
+        signal = 0;
+    } else if ((signal == SIGSTOP) && (attached.count(pid) == 0)) {
+        // A new child or thread, attached automatically.
+        attached.insert(pid);
+        signal = 0;
+    }
+
+    return ptrace(PTRACE_CONT, pid, nullptr, signal) == 0;
+}
+
+// Runs as pid 1 of a new pid namespace, boots WSLGd in the root and writes the result to resultFd.
+// Timed runs also wait for the first rdp connection, which may come after ready.
+int RunSandbox(const std::string& root, bool isCounted, bool isRdpClientEarlyLaunch, int resultFd)
+{
+    for (auto dir : {"/run", "/tmp", "/mnt/wslg"}) {
+        THROW_LAST_ERROR_IF(mount("tmpfs", (root + dir).c_str(), "tmpfs", 0, nullptr) < 0);
+    }
+
+    THROW_LAST_ERROR_IF(mount("proc", (root + "/proc").c_str(), "proc", 0, nullptr) < 0);
+    THROW_LAST_ERROR_IF(chroot(root.c_str()) < 0);
+    THROW_LAST_ERROR_IF(chdir("/") < 0);
+    WriteFile(c_launchLog, "", 0666);
+    WriteFile(c_rdpConnectFile, "", 0666);
+
+    wil::unique_fd inotifyFd(inotify_init1(IN_NONBLOCK | IN_CLOEXEC));
+    THROW_LAST_ERROR_IF(!inotifyFd);
+    THROW_LAST_ERROR_IF(inotify_add_watch(inotifyFd.get(), c_benchDir, IN_CLOSE_WRITE) < 0);
+
+    wslgd::EventLoop loop;
+    RunResult result;
+    std::set<int> attached;
+    int wslgdPid = -1;
+    loop.AddSignal(SIGCHLD, [&](const signalfd_siginfo&) {
+        int status;
+        int pid;
+        while ((pid = waitpid(-1, &status, (WNOHANG | __WALL))) > 0) {
+            if (WIFSTOPPED(status)) {
+                HandleTraceStop(pid, status, result, attached);
+            } else if (pid == wslgdPid) {
+                fprintf(stderr, "WSLGd exited with status 0x%x before it was ready\n", status);
+                loop.Stop(1);
+            }
+        }
+    });
+
+    // The trace is written once startup completes, with its time.
+    std::string rdpConnect;
+    loop.AddFd(inotifyFd.get(), EPOLLIN, [&](uint32_t) {
+        std::array<char, 4096> buffer;
+        while (read(inotifyFd.get(), buffer.data(), buffer.size()) > 0) {
+        }
+
+        auto trace = ReadFile(c_traceFile);
+        auto mark = trace.find("\"startup complete\"");
+        if ((result.readyUs == 0) && (mark != std::string::npos)) {
+            auto ts = trace.find("\"ts\":", mark);
+            THROW_ERRNO_IF(EINVAL, ts == std::string::npos);
+            result.readyUs = strtoull(trace.c_str() + ts + 5, nullptr, 10);
+        }
+
+        rdpConnect = ReadFile(c_rdpConnectFile);
+        if ((result.readyUs != 0) && (isCounted || !rdpConnect.empty())) {
+            loop.Stop(0);
+        }
+    });
+
+    loop.AddTimer(c_readyTimeoutMs, [&]() {
+        fprintf(stderr, "WSLGd not ready after %llu ms\n", static_cast<unsigned long long>(c_readyTimeoutMs));
+        loop.Stop(1);
+    });
+
+    auto startUs = wslgd::Trace::Now();
+    wslgdPid = fork();
+    THROW_LAST_ERROR_IF(wslgdPid < 0);
+    if (wslgdPid == 0) {
+        sigset_t mask;
+        sigemptyset(&mask);
+        sigprocmask(SIG_SETMASK, &mask, nullptr);
+        int nullFd = open("/dev/null", O_RDWR);
+        dup2(nullFd, STDIN_FILENO);
+        dup2(nullFd, STDOUT_FILENO);
+        if (isCounted) {
+            ptrace(PTRACE_TRACEME, 0, nullptr, nullptr);
+        }
+
+        std::string tracePath = std::string("WSLG_TRACE_PATH=") + c_traceFile;
+        const char *env[] = {"PATH=/usr/sbin:/usr/bin:/sbin:/bin", "WSLG_TRACE=1", tracePath.c_str(),
+            (isRdpClientEarlyLaunch ? "WSLG_RDP_CLIENT_EARLY_LAUNCH=true" : nullptr), nullptr};
+        execle(c_wslgd, "WSLGd", nullptr, env);
+        _exit(127);
+    }
+
+    int exitCode = loop.Run();
+    if (exitCode != 0) {
+        fprintf(stderr, "%s", ReadFile(SHARE_PATH "/stderr.log").c_str());
+    }
+
+    // Launches up to ready, relative to exec of WSLGd.
+    std::string out;
+    if (exitCode == 0) {
+        out += "ready " + std::to_string(result.readyUs - startUs) + "\n";
+        auto launches = ReadFile(c_launchLog);
+        char *savePtr = nullptr;
+        for (char *line = strtok_r(&launches[0], "\n", &savePtr); line; line = strtok_r(nullptr, "\n", &savePtr)) {
+            char name[64];
+            unsigned long long us;
+            if (sscanf(line, "%63s %llu", name, &us) != 2) {
+                continue;
+            }
+
+            if (us <= result.readyUs) {
+                out += std::string("launch ") + name + " " + std::to_string(us - startUs) + "\n";
+            }
+
+            // The first connection is timed from the first launch of the rdp client, ready or not.
+            unsigned long long connectUs;
+            if ((strcmp(name, "init") == 0) && (sscanf(rdpConnect.c_str(), "%llu", &connectUs) == 1)) {
+                out += "rdp-connect " + std::to_string(connectUs - us) + "\n";
+                rdpConnect.clear();
+            }
+        }
+
+        if (isCounted) {
+            out += "processes " + std::to_string(result.processes) + "\n";
+            out += "threads " + std::to_string(result.threads) + "\n";
+            out += "execs " + std::to_string(result.execs) + "\n";
+        }
+    }
+
+    write(resultFd, out.data(), out.size());
+
+    // Everything else in the namespace goes with its pid 1.
+    kill(-1, SIGKILL);
+    while ((waitpid(-1, nullptr, __WALL) > 0) || (errno == EINTR)) {
+    }
+
+    return exitCode;
+}
+
+std::optional<RunResult> RunOnce(const std::string& root, bool isCounted, bool isRdpClientEarlyLaunch)
+{
+    int pipeFds[2];
+    THROW_LAST_ERROR_IF(pipe2(pipeFds, O_CLOEXEC) < 0);
+    wil::unique_fd readFd(pipeFds[0]);
+    wil::unique_fd writeFd(pipeFds[1]);
+
+    int pid = fork();
+    THROW_LAST_ERROR_IF(pid < 0);
+    if (pid == 0) {
+        int exitCode = 1;
+        try {
+            readFd.reset();
+            THROW_LAST_ERROR_IF(unshare(CLONE_NEWNS | CLONE_NEWPID) < 0);
+            int initPid = fork();
+            THROW_LAST_ERROR_IF(initPid < 0);
+            if (initPid == 0) {
+                try {
+                    _exit(RunSandbox(root, isCounted, isRdpClientEarlyLaunch, writeFd.get()));
+                }
+                CATCH_LOG();
+                _exit(1);
+            }
+
+            writeFd.reset();
+            int status;
+            THROW_LAST_ERROR_IF(waitpid(initPid, &status, 0) < 0);
+            exitCode = WIFEXITED(status) ? WEXITSTATUS(status) : 1;
+        }
+        CATCH_LOG();
+        _exit(exitCode);
+    }
+
+    writeFd.reset();
+    std::string out;
+    std::array<char, 4096> buffer;
+    ssize_t size;
+    while ((size = read(readFd.get(), buffer.data(), buffer.size())) > 0) {
+        out.append(buffer.data(), size);
+    }
+
+    int status;
+    THROW_LAST_ERROR_IF(waitpid(pid, &status, 0) < 0);
+    if (!WIFEXITED(status) || (WEXITSTATUS(status) != 0)) {
+        return {};
+    }
+
+    RunResult result;
+    char *savePtr = nullptr;
+    for (char *line = strtok_r(&out[0], "\n", &savePtr); line; line = strtok_r(nullptr, "\n", &savePtr)) {
+        char name[64];
+        unsigned long long value;
+        if (sscanf(line, "launch %63s %llu", name, &value) == 2) {
+            result.launchUs.emplace(name, value);
+        } else if (sscanf(line, "ready %llu", &value) == 1) {
+            result.readyUs = value;
+        } else if (sscanf(line, "rdp-connect %llu", &value) == 1) {
+            result.rdpConnectUs = value;
+        } else if (sscanf(line, "processes %llu", &value) == 1) {
+            result.processes = value;
+        } else if (sscanf(line, "threads %llu", &value) == 1) {
+            result.threads = value;
+        } else if (sscanf(line, "execs %llu", &value) == 1) {
+            result.execs = value;
+        }
+    }
+
+    return result;
+}
+
+// Prints the median, min and max of values, in us, or as counts.
+void ReportStats(const std::string& name, std::vector<uint64_t> values, bool isTime = true)
+{
+    if (values.empty()) {
+        return;
+    }
+
+    std::sort(values.begin(), values.end());
+    double scale = isTime ? 1000.0 : 1.0;
+    printf("%-40s %4zu runs %10.3f %s median %10.3f min %10.3f max\n", name.c_str(), values.size(),
+        values[values.size() / 2] / scale, isTime ? "ms" : "  ", values.front() / scale, values.back() / scale);
+}
+
+int main(int argc, char *argv[])
+try {
+    std::string name = std::filesystem::path(argv[0]).filename();
+    for (auto &standIn : c_standIns) {
+        if (name == standIn.first) {
+            return RunStandIn(name, argc, argv);
+        }
+    }
+
+    if (argc < 3) {
+        fprintf(stderr, "usage: %s <WSLGd> <services.d> [runs]\n", argv[0]);
+        return 1;
+    }
+
+    if (geteuid() != 0) {
+        printf("skipped, booting WSLGd needs root\n");
+        return c_skipped;
+    }
+
+    uint64_t runs = (argc > 3) ? strtoull(argv[3], nullptr, 10) : c_defaultRuns;
+    auto root = CreateRoot(argv[1], argv[2]);
+
+    // The first boot writes the probe cache the others start from, runs with the rdp client launched
+    // early follow the ones launching it after weston.
+    std::vector<RunResult> timed;
+    std::vector<RunResult> early;
+    std::vector<RunResult> counted;
+    for (uint64_t i = 0; i < (2 * runs) + c_countedRuns; i++) {
+        bool isEarlyLaunch = (i >= runs) && (i < (2 * runs));
+        auto result = RunOnce(root, (i >= (2 * runs)), isEarlyLaunch);
+        if (!result) {
+            fprintf(stderr, "run %llu failed\n", static_cast<unsigned long long>(i));
+            return 1;
+        }
+
+        ((i < runs) ? timed : (isEarlyLaunch ? early : counted)).push_back(std::move(*result));
+    }
+
+    std::map<std::string, std::vector<uint64_t>> values;
+    auto addValues = [&](const std::vector<RunResult>& results, bool isEarlyLaunch) {
+        for (size_t i = 0; i < results.size(); i++) {
+            auto prefix = isEarlyLaunch ? std::string("early, ") : (i == 0) ? std::string("cold, ") : std::string("warm, ");
+            values[prefix + "ready"].push_back(results[i].readyUs);
+            for (auto &launch : results[i].launchUs) {
+                values[prefix + "launch " + launch.first].push_back(launch.second);
+            }
+
+            if (results[i].rdpConnectUs) {
+                values[std::string("rdp first connect, ") + (isEarlyLaunch ? "early" : "deferred") + " launch"].push_back(*results[i].rdpConnectUs);
+            }
+        }
+    };
+
+    addValues(timed, false);
+    addValues(early, true);
+
+    for (auto &value : values) {
+        ReportStats(value.first, value.second);
+    }
+
+    std::vector<uint64_t> processes, threads, execs;
+    for (auto &result : counted) {
+        processes.push_back(result.processes);
+        threads.push_back(result.threads);
+        execs.push_back(result.execs);
+    }
+
+    ReportStats("processes to ready", processes, false);
+    ReportStats("threads to ready", threads, false);
+    ReportStats("execs to ready", execs, false);
+    return 0;
+}
+CATCH_RETURN_ERRNO();
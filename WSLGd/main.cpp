@@ -4,12 +4,19 @@
 #include "common.h"
 #include "ProcessMonitor.h"
 #include "FontMonitor.h"
+#include "ServiceGraph.h"
+#include "PathTranslator.h"
+#include "Trace.h"
+#include "Logger.h"
+#include "MetricsServer.h"
+#include "ControlServer.h"
+#include "ConfigMonitor.h"
+#include "ProbeCache.h"
+#include "ServiceManifest.h"
 
 #define CONFIG_FILE ".wslgconfig"
 #define MSRDC_EXE "msrdc.exe"
 #define MSTSC_EXE "mstsc.exe"
-#define GDBSERVER_PATH "/usr/bin/gdbserver"
-#define WESTON_NOTIFY_SOCKET SHARE_PATH "/weston-notify.sock"
 #define DEFAULT_ICON_PATH "/usr/share/icons"
 #define USER_DISTRO_ICON_PATH USER_DISTRO_MOUNT_PATH DEFAULT_ICON_PATH
 #define MAX_RESERVED_PORT 1024
@@ -25,6 +32,12 @@ constexpr auto c_shareDocsMount = SHARE_PATH "/doc";
 constexpr auto c_x11RuntimeDir = SHARE_PATH "/.X11-unix";
 constexpr auto c_xdgRuntimeDir = SHARE_PATH "/runtime-dir";
 constexpr auto c_stdErrLogFile = SHARE_PATH "/stderr.log";
+constexpr uint64_t c_stdErrLogSegmentSize = 2 * 1024 * 1024;
+constexpr int c_stdErrLogSegments = 4;
+constexpr int c_stdErrPipeSize = 1024 * 1024;
+constexpr auto c_pulseServerSocket = SHARE_PATH "/PulseServer";
+constexpr auto c_metricsSocket = SHARE_PATH "/wslgd-metrics.sock";
+constexpr auto c_controlSocket = SHARE_PATH "/wslgd-control.sock";
 
 constexpr auto c_sharedMemoryMountPoint = "/mnt/shared_memory";
 constexpr auto c_sharedMemoryMountPointEnv = "WSL2_SHARED_MEMORY_MOUNT_POINT";
@@ -33,6 +46,13 @@ constexpr auto c_sharedMemoryObDirectoryPathEnv = "WSL2_SHARED_MEMORY_OB_DIRECTO
 constexpr auto c_installPathEnv = "WSL2_INSTALL_PATH";
 constexpr auto c_userProfileEnv = "WSL2_USER_PROFILE";
 constexpr auto c_systemDistroEnvSection = "system-distro-env";
+constexpr auto c_configCacheFile = "/var/cache/wslgd/wslgconfig.cache";
+constexpr uint64_t c_configPollMs = 5000;
+constexpr uint64_t c_rdpFirstConnectTimeoutMs = 60000;
+constexpr auto c_serviceManifestDir = "/etc/wslg/services.d";
+constexpr auto c_probeCacheFile = "/var/cache/wslgd/probes.cache";
+constexpr auto c_windowsBellSample = "/mnt/c/Windows/Media/Windows Default.wav";
+constexpr auto c_bellSampleFile = "/var/cache/wslgd/x11-bell.wav";
 
 constexpr auto c_windowsSystem32 = "/mnt/c/Windows/System32";
 
@@ -44,28 +64,6 @@ constexpr auto c_westonRdpdesktopShell = "desktop-shell";
 constexpr auto c_rdpRailFile = "wslg.rdp";
 constexpr auto c_rdpDesktopFile = "wslg_desktop.rdp";
 
-void LogPrint(int level, const char *func, int line, const char *fmt, ...) noexcept
-{
-    std::array<char, 128> buffer;
-    struct timeval tv;
-    struct tm *time;
-    va_list va_args;
-
-    gettimeofday(&tv, NULL);
-    time = localtime(&tv.tv_sec);
-    strftime(buffer.data(), buffer.size(), "%H:%M:%S", time);
-    fprintf(stderr, "[%s.%03ld] <%d>WSLGd: %s:%u: ",
-        buffer.data(), (tv.tv_usec / 1000),
-        level, func, line);
-
-    va_start(va_args, fmt);
-    vfprintf(stderr, fmt, va_args);
-    va_end(va_args);
-    fprintf(stderr, "\n");
-
-    return;
-}
-
 void LogException(const char *message, const char *exceptionDescription) noexcept
 {
     LogPrint(LOG_LEVEL_EXCEPTION, __FUNCTION__, __LINE__, "%s %s", message ? message : "Exception:", exceptionDescription);
@@ -94,25 +92,10 @@ std::string ToServiceId(unsigned int port)
 
 std::string TranslateWindowsPath(const char * Path)
 {
-    std::string commandLine = "/usr/bin/wslpath -a \"";
-    commandLine += Path;
-    commandLine += "\"";
-    std::array<char, 128> buffer;
-    std::string result;
-    std::unique_ptr<FILE, decltype(&pclose)> pipe(popen(commandLine.c_str(), "r"), pclose);
-    THROW_LAST_ERROR_IF(!pipe);
-
-    while (fgets(buffer.data(), buffer.size(), pipe.get()) != nullptr) {
-        result += buffer.data();
-    }
-    /* trim '\n' from wslpath output */
-    while (result.back() == '\n') {
-        result.pop_back();
-    }
-
-    THROW_ERRNO_IF(EINVAL, pclose(pipe.release()) != 0);
-
-    return result;
+    // Drive letters are resolved from the mount table, wslpath is only used when that fails.
+    TRACE_SPAN("TranslateWindowsPath");
+    static wslgd::PathTranslator translator;
+    return translator.Translate(Path);
 }
 
 bool GetEnvBool(const char *EnvName, bool DefaultValue)
@@ -136,6 +119,9 @@ bool GetEnvBool(const char *EnvName, bool DefaultValue)
 
 std::string GetVmId()
 {
+    TRACE_SPAN("GetVmId");
+
+    wslgd::Trace::Increment("fork");
     std::unique_ptr<FILE, decltype(&pclose)> pipe(popen("/usr/bin/wslinfo --vm-id -n", "r"), pclose);
     THROW_LAST_ERROR_IF(!pipe);
 
@@ -150,9 +136,25 @@ std::string GetVmId()
     return result;
 }
 
-void SetupOptionalEnv()
+wil::unique_fd CreateUnixListenSocket(const char *Path)
+{
+    wil::unique_fd socketFd{socket(AF_UNIX, (SOCK_STREAM | SOCK_CLOEXEC), 0)};
+    THROW_LAST_ERROR_IF(!socketFd);
+
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    THROW_ERRNO_IF(ENAMETOOLONG, strlen(Path) >= sizeof(address.sun_path));
+    strcpy(address.sun_path, Path);
+    unlink(Path);
+    THROW_LAST_ERROR_IF(bind(socketFd.get(), reinterpret_cast<const sockaddr*>(&address), sizeof(address)) < 0);
+    THROW_LAST_ERROR_IF(chmod(Path, 0666) < 0);
+    THROW_LAST_ERROR_IF(listen(socketFd.get(), SOMAXCONN) < 0);
+
+    return socketFd;
+}
+
+std::string GetConfigFilePath()
 {
-#if HAVE_WINPR
     // Get the path to the WSLG config file.
     std::string configFilePath = "/mnt/c/ProgramData/Microsoft/WSL/" CONFIG_FILE;
     auto userProfile = getenv(c_userProfileEnv);
@@ -161,65 +163,40 @@ void SetupOptionalEnv()
         configFilePath += "/" CONFIG_FILE;
     }
 
-    // Set additional environment variables.
-    wIniFile* wslgConfigIniFile = IniFile_New();
-    if (wslgConfigIniFile) {
-        if (IniFile_ReadFile(wslgConfigIniFile, configFilePath.c_str()) > 0) {
-            int numKeys = 0;
-            char **keyNames = IniFile_GetSectionKeyNames(wslgConfigIniFile, c_systemDistroEnvSection, &numKeys);
-            for (int n = 0; keyNames && n < numKeys; n++) {
-                const char *value = IniFile_GetKeyValueString(wslgConfigIniFile, c_systemDistroEnvSection, keyNames[n]);
-                if (value) {
-                    setenv(keyNames[n], value, true);
-                }
-            }
-
-            free(keyNames);
-        }
-
-        IniFile_Free(wslgConfigIniFile);
-    }
-#endif // HAVE_WINPR
-
-    return;
+    return configFilePath;
 }
 
-int SetupReadyNotify(const char *socket_path)
+void SetupLogLevel()
 {
-    struct sockaddr_un addr = {};
-    socklen_t size, name_size;
-
-    addr.sun_family = AF_LOCAL;
-    name_size = snprintf(addr.sun_path, sizeof addr.sun_path,
-                         "%s", socket_path) + 1;
-    size = offsetof(struct sockaddr_un, sun_path) + name_size;
-    unlink(addr.sun_path);
-
-    wil::unique_fd socketFd{socket(PF_LOCAL, SOCK_SEQPACKET, 0)};
-    THROW_LAST_ERROR_IF(!socketFd);
-
-    THROW_LAST_ERROR_IF(bind(socketFd.get(), reinterpret_cast<const sockaddr*>(&addr), size) < 0);
-    THROW_LAST_ERROR_IF(listen(socketFd.get(), 1) < 0);
-
-    return socketFd.release();
-}
+    // The log level can be set from .wslgconfig, by number or name. This also runs on every reload,
+    // so a level that was removed or is not valid goes back to the default.
+    int level = wslgd::Logger::c_defaultLevel;
+    auto logLevel = getenv("WSLG_LOG_LEVEL");
+    if (logLevel && *logLevel) {
+        if (strcmp(logLevel, "error") == 0) {
+            level = LOG_LEVEL_ERROR;
+        } else if (strcmp(logLevel, "info") == 0) {
+            level = LOG_LEVEL_INFO;
+        } else if (IsNumeric(logLevel)) {
+            level = atoi(logLevel);
+        }
+    }
 
-void WaitForReadyNotify(int notifyFd)
-{
-    // wait under client connects */
-    wil::unique_fd fd(accept(notifyFd, 0, 0));
-    THROW_LAST_ERROR_IF(!fd);
+    wslgd::Logger::SetLevel(level);
 }
 
 int main(int Argc, char *Argv[])
 try {
     wil::g_LogExceptionCallback = LogException;
 
+    auto startTime = wslgd::Trace::Now();
+
     // Restore default processing for SIGCHLD as both WSLGd and Xwayland depends on this.
     signal(SIGCHLD, SIG_DFL);
 
-    // Create a process monitor to track child processes
-    wslgd::ProcessMonitor monitor(c_userName);
+    // Create the event loop that supervises everything, and a process monitor to track child processes
+    wslgd::EventLoop loop;
+    wslgd::ProcessMonitor monitor(c_userName, loop);
     auto passwordEntry = monitor.GetUserInfo();
 
     // Set required environment variables.
@@ -236,7 +213,7 @@ try {
         {"XCURSOR_PATH", USER_DISTRO_ICON_PATH ":" DEFAULT_ICON_PATH , false},
         {"XCURSOR_THEME", "whiteglass", false},
         {"XCURSOR_SIZE", "16", false},
-        {"PULSE_SERVER", SHARE_PATH "/PulseServer", false},
+        {"PULSE_SERVER", c_pulseServerSocket, false},
         {"PULSE_AUDIO_RDP_SINK", SHARE_PATH "/PulseAudioRDPSink", false},
         {"PULSE_AUDIO_RDP_SOURCE", SHARE_PATH "/PulseAudioRDPSource", false},
         {"WSL2_DEFAULT_APP_ICON", DEFAULT_ICON_PATH "/wsl/linux.png", false},
@@ -247,24 +224,88 @@ try {
         THROW_LAST_ERROR_IF(setenv(var.name, var.value, var.override) < 0);
     }
 
-    SetupOptionalEnv();
+    // Set additional environment variables from .wslgconfig.
+    auto envTime = wslgd::Trace::Now();
+    wslgd::ConfigMonitor config(loop, GetConfigFilePath(), c_configCacheFile, c_systemDistroEnvSection);
+    config.Reload();
+
+    SetupLogLevel();
+
+    // Tracing can be enabled from .wslgconfig, so spans before this point are added afterwards.
+    wslgd::Trace::Initialize();
+    wslgd::Trace::AddSpan("environment", "startup", startTime, envTime);
+    wslgd::Trace::AddSpan("SetupOptionalEnv", "startup", envTime, wslgd::Trace::Now());
 
     // if any components output log to /dev/kmsg, make it writable.
     if (GetEnvBool("WSLG_LOG_KMSG", false))
         THROW_LAST_ERROR_IF(chmod("/dev/kmsg", 0666) < 0);
 
-    // Open a file for logging errors and set it to stderr for WSLGd as well as any child process.
+    // Open a size bounded, rotating file for logging errors. Children write their stderr into a pipe
+    // that WSLGd forwards to the same log, so that only WSLGd ever writes the file.
+    wil::unique_fd stdErrPipe;
+    bool isLoggerStarted = false;
     {
+        TRACE_SPAN("stderr log");
         const char *errLog = getenv("WSLG_ERR_LOG_PATH");
         if (!errLog) {
             errLog = c_stdErrLogFile;
         }
-        wil::unique_fd stdErrLogFd(open(errLog, (O_RDWR | O_CREAT), (S_IRUSR | S_IRGRP | S_IROTH)));
-        if (stdErrLogFd && (stdErrLogFd.get() != STDERR_FILENO)) {
-            dup2(stdErrLogFd.get(), STDERR_FILENO);
+
+        uint64_t segmentSize = c_stdErrLogSegmentSize;
+        char *segmentSizeEnv = getenv("WSLG_ERR_LOG_SEGMENT_SIZE");
+        if (segmentSizeEnv && *segmentSizeEnv && IsNumeric(segmentSizeEnv)) {
+            segmentSize = strtoull(segmentSizeEnv, nullptr, 10);
+        }
+
+        int segments = c_stdErrLogSegments;
+        char *segmentsEnv = getenv("WSLG_ERR_LOG_SEGMENTS");
+        if (segmentsEnv && *segmentsEnv && IsNumeric(segmentsEnv)) {
+            segments = atoi(segmentsEnv);
         }
+
+        try {
+            auto logFile = std::make_unique<wslgd::LogFile>(errLog, segmentSize, segments);
+            int pipeFds[2];
+            THROW_LAST_ERROR_IF(pipe2(pipeFds, (O_CLOEXEC | O_NONBLOCK)) < 0);
+            wil::unique_fd pipeRead(pipeFds[0]);
+            wil::unique_fd pipeWrite(pipeFds[1]);
+
+            // Children block on a full pipe, give them room while the event loop is busy.
+            fcntl(pipeWrite.get(), F_SETPIPE_SZ, c_stdErrPipeSize);
+            THROW_LAST_ERROR_IF(fcntl(pipeWrite.get(), F_SETFL, 0) < 0);
+            wslgd::Logger::Start(std::move(logFile));
+            isLoggerStarted = true;
+
+            // Redirect stderr last, a pipe left without its reader would raise SIGPIPE on every write.
+            THROW_LAST_ERROR_IF(dup2(pipeWrite.get(), STDERR_FILENO) < 0);
+            stdErrPipe = std::move(pipeRead);
+        }
+        CATCH_LOG();
+    }
+
+    if (!isLoggerStarted) {
+        wslgd::Logger::Start();
+    }
+
+    if (stdErrPipe) {
+        loop.AddFd(stdErrPipe.get(), EPOLLIN, [&](uint32_t) {
+            std::array<char, 4096> buffer;
+            ssize_t size;
+            while ((size = read(stdErrPipe.get(), buffer.data(), buffer.size())) > 0) {
+                wslgd::Logger::WriteRaw(buffer.data(), size);
+            }
+        });
     }
 
+    // Crashed services are restarted with backoff, the ceiling can be tuned from .wslgconfig.
+    wslgd::RestartPolicy restartPolicy;
+    char *restartMaxDelay = getenv("WSLG_RESTART_MAX_DELAY_MS");
+    if (restartMaxDelay && IsNumeric(restartMaxDelay)) {
+        restartPolicy.maxDelayMs = strtoull(restartMaxDelay, nullptr, 10);
+    }
+
+    monitor.SetDefaultRestartPolicy(restartPolicy);
+
     // Ensure the daemon is launched as root.
     if (geteuid() != 0) {
         LOG_ERROR("must be run as root.");
@@ -287,21 +328,8 @@ try {
         wslInstallPath = installPath;
     }
 
-    // Bind mount the versions.txt file which contains version numbers of the various WSLG pieces.
-    {
-        wil::unique_fd fd(open(c_versionMount, (O_RDWR | O_CREAT), (S_IRUSR | S_IRGRP | S_IROTH)));
-        THROW_LAST_ERROR_IF(!fd);
-    }
-
-    THROW_LAST_ERROR_IF(mount(c_versionFile, c_versionMount, NULL, MS_BIND | MS_RDONLY, NULL) < 0);
-
-    std::filesystem::create_directories(c_shareDocsMount);
-    THROW_LAST_ERROR_IF(mount(c_shareDocsDir, c_shareDocsMount, NULL, MS_BIND | MS_RDONLY, NULL) < 0);
-
-    // Create a font folder monitor
-    wslgd::FontMonitor fontMonitor;
-
     // Make directories and ensure the correct permissions.
+    auto directoriesTime = wslgd::Trace::Now();
     std::filesystem::create_directories(c_dbusDir);
     THROW_LAST_ERROR_IF(chown(c_dbusDir, passwordEntry->pw_uid, passwordEntry->pw_gid) < 0);
     THROW_LAST_ERROR_IF(chmod(c_dbusDir, 0777) < 0);
@@ -328,6 +356,8 @@ try {
         LOG_ERROR("shared memory ob directory path is not set.");
     }
 
+    wslgd::Trace::AddSpan("directories and shared memory mount", "startup", directoriesTime, wslgd::Trace::Now());
+
     // Create a listening vsock in the reserved port range to be used for the RDP connection.
     sockaddr_vm address{};
     address.svm_family = AF_VSOCK;
@@ -335,21 +365,21 @@ try {
     socklen_t addressSize = sizeof(address);
     wil::unique_fd socketFd{socket(AF_VSOCK, SOCK_STREAM, 0)};
     THROW_LAST_ERROR_IF(!socketFd);
-    for (unsigned int port = 1; port < MAX_RESERVED_PORT; port += 1) {
-        address.svm_port = port;
-        if (bind(socketFd.get(), reinterpret_cast<const sockaddr*>(&address), addressSize) == 0) {
-            break;
-        }
+    {
+        TRACE_SPAN("vsock bind");
+        for (unsigned int port = 1; port < MAX_RESERVED_PORT; port += 1) {
+            address.svm_port = port;
+            if (bind(socketFd.get(), reinterpret_cast<const sockaddr*>(&address), addressSize) == 0) {
+                break;
+            }
 
-        THROW_LAST_ERROR_IF(errno != EADDRINUSE);
+            THROW_LAST_ERROR_IF(errno != EADDRINUSE);
+        }
     }
 
     THROW_ERRNO_IF(EINVAL, (address.svm_port == MAX_RESERVED_PORT));
-    THROW_LAST_ERROR_IF(listen(socketFd.get(), 1) < 0);
-    std::string socketEnvString("USE_VSOCK=");
-    socketEnvString += std::to_string(socketFd.get());
-    std::string serviceIdEnvString("WSLG_SERVICE_ID=");
-    serviceIdEnvString += ToServiceId(address.svm_port);
+    // N.B. The RDP client may connect before weston accepts, its connection then waits in the backlog.
+    THROW_LAST_ERROR_IF(listen(socketFd.get(), SOMAXCONN) < 0);
 
     struct rlimit limit;
     THROW_LAST_ERROR_IF(getrlimit(RLIMIT_NOFILE, &limit) < 0);
@@ -364,187 +394,300 @@ try {
         isSharedMemoryMounted = false;
     }
 
-    // Construct socket option string.
-    std::string westonSocketOption("--socket=");
-    westonSocketOption += getenv("WAYLAND_DISPLAY");
+    // Describe the command lines of the services in the manifest, with what WSLGd resolved at boot.
+    wslgd::ServiceManifest manifest;
+    manifest.SetVariable("SHARE_PATH", SHARE_PATH);
+    manifest.SetVariable("WSLGD_VSOCK_FD", std::to_string(socketFd.get()));
+    manifest.SetVariable("WSLGD_SERVICE_ID", ToServiceId(address.svm_port));
+    manifest.SetVariable("WSLGD_VM_ID", vmId);
 
     // Check if weston shell override is specified.
     // Otherwise, default shell is 'rdprail-shell'.
     // Alternatively, it can be 'desktop-shell'.
     bool isRdpDesktopShell = GetEnvBool(c_westonShellDesktopEnv, false);
-    std::string westonShellName;
-    if (isRdpDesktopShell)
-        westonShellName = c_westonRdpdesktopShell;
-    else
-        westonShellName = c_westonRdprailShell;
-
-    // Construct shell option string.
-    std::string westonShellOption("--shell=");
-    westonShellOption += westonShellName;
-    westonShellOption += ".so";
-
-    // Construct log file option string.
-    std::string westonLogFileOption("--log=");
-    auto westonLogFilePathEnv = getenv("WSLG_WESTON_LOG_PATH");
-    if (westonLogFilePathEnv) {
-        westonLogFileOption += westonLogFilePathEnv;
-    } else {
-        westonLogFileOption += SHARE_PATH "/weston.log";
-    }
+    manifest.SetVariable("WSLGD_WESTON_SHELL", isRdpDesktopShell ? c_westonRdpdesktopShell : c_westonRdprailShell);
 
-    // Construct logger option string.
     // By default, enable standard log and rdp-backend.
-    std::string westonLoggerOption("--logger-scopes=log,rdp-backend");
+    std::string westonLoggerScopes("log,rdp-backend");
     // If rdprail-shell is used, enable logger for that.
     if (!isRdpDesktopShell) {
-        westonLoggerOption += ",";
-        westonLoggerOption += c_westonRdprailShell;
+        westonLoggerScopes += ",";
+        westonLoggerScopes += c_westonRdprailShell;
     }
-
-    // Setup notify for wslgd-notify.so
-    wil::unique_fd notifyFd(SetupReadyNotify(WESTON_NOTIFY_SOCKET));
-    THROW_LAST_ERROR_IF(!notifyFd);
-
-    // Construct weston option string.
-    std::string westonArgs;
-    char *gdbServerPort = getenv("WSLG_WESTON_GDBSERVER_PORT");
-    if ((access(GDBSERVER_PATH, X_OK) == 0) && IsNumeric(gdbServerPort)) {
-        westonArgs += GDBSERVER_PATH;
-        westonArgs += " :";
-        westonArgs += gdbServerPort;
-        westonArgs += " ";
-    }
-    westonArgs += "/usr/bin/weston ";
-    westonArgs += "--backend=rdp-backend.so --modules=wslgd-notify.so --xwayland ";
-    westonArgs += westonSocketOption;
-    westonArgs += " ";
-    westonArgs += westonShellOption;
-    westonArgs += " ";
-    westonArgs += westonLogFileOption;
-    westonArgs += " ";
-    westonArgs += westonLoggerOption;
-
-    // Launch weston.
-    // N.B. Additional capabilities are needed to setns to the mount namespace of the user distro.
-    monitor.LaunchProcess(std::vector<std::string>{
-                "/usr/bin/sh",
-                "-c",
-                std::move(westonArgs)
-            },
-            std::vector<cap_value_t>{
-                CAP_SYS_ADMIN,
-                CAP_SYS_CHROOT,
-                CAP_SYS_PTRACE
-            },
-            std::vector<std::string>{
-                std::move(socketEnvString),
-                std::move(serviceIdEnvString),
-                "WSLGD_NOTIFY_SOCKET=" WESTON_NOTIFY_SOCKET,
-                "WESTON_DISABLE_ABSTRACT_FD=1",
-                getenv("WLOG_APPENDER") ? : "", "WLOG_APPENDER=file",
-                getenv("WLOG_FILEAPPENDER_OUTPUT_FILE_NAME") ? "" : "WLOG_FILEAPPENDER_OUTPUT_FILE_NAME=wlog.log",
-                getenv("WLOG_FILEAPPENDER_OUTPUT_FILE_PATH") ? "" : "WLOG_FILEAPPENDER_OUTPUT_FILE_PATH=" SHARE_PATH
-            }
-        );
-
-    // Wait weston to be ready before starting RDP client, pulseaudio server.
-    WaitForReadyNotify(notifyFd.get());
-    unlink(WESTON_NOTIFY_SOCKET);
-
-    // Start font monitoring if user distro's X11 fonts to be shared with system distro.
-    if (GetEnvBool("WSLG_USE_USER_DISTRO_XFONTS", true))
-        fontMonitor.Start(); 
-
-    // Launch the mstsc/msrdc client.
-    std::string remote("/v:");
-    remote += vmId;
-    std::string serviceId("/hvsocketserviceid:");
-    serviceId += ToServiceId(address.svm_port);
-    std::string sharedMemoryObPath("");
+    manifest.SetVariable("WSLGD_WESTON_LOGGER_SCOPES", std::move(westonLoggerScopes));
+
+    // With WSLG_PULSEAUDIO_ON_DEMAND, WSLGd owns the pulseaudio socket and only starts pulseaudio once
+    // a client connects to it, which requires a pulseaudio built with systemd socket activation support.
+    // An on demand pulseaudio may exit once idle, it is started again by the next client.
+    bool isPulseAudioOnDemand = GetEnvBool("WSLG_PULSEAUDIO_ON_DEMAND", false);
+    char *pulseaudioIdleExit = getenv("WSLG_PULSEAUDIO_IDLE_EXIT_SECONDS");
+    manifest.SetVariable("WSLGD_PULSEAUDIO_ON_DEMAND", isPulseAudioOnDemand ? "true" : "false");
+    manifest.SetVariable("WSLGD_PULSEAUDIO_EXIT_IDLE_TIME",
+        (isPulseAudioOnDemand && IsNumeric(pulseaudioIdleExit)) ? pulseaudioIdleExit : "-1");
+
+    // Launch the mstsc/msrdc client once weston is ready to accept the RDP connection, or at the same
+    // time as weston with WSLG_RDP_CLIENT_EARLY_LAUNCH since the connection is queued on the vsock.
+    bool isRdpClientEarlyLaunch = GetEnvBool("WSLG_RDP_CLIENT_EARLY_LAUNCH", false);
+    manifest.SetVariable("WSLGD_RDP_CLIENT_AFTER", isRdpClientEarlyLaunch ? "" : "weston");
     if (isSharedMemoryMounted) {
-        sharedMemoryObPath += "/wslgsharedmemorypath:";
-        sharedMemoryObPath += sharedMemoryObDirectoryPath;
+        manifest.SetVariable("WSLGD_SHARED_MEMORY_OPTION", std::string("/wslgsharedmemorypath:") + sharedMemoryObDirectoryPath);
     }
 
-    std::filesystem::path rdpClientExePath;
-    bool isUseMstsc = GetEnvBool("WSLG_USE_MSTSC", false);
-    if (!isUseMstsc && !wslInstallPath.empty()) {
-        std::filesystem::path msrdcExePath = TranslateWindowsPath(wslInstallPath.c_str());
-        msrdcExePath /= MSRDC_EXE;
-        if (access(msrdcExePath.c_str(), X_OK) == 0) {
-            rdpClientExePath = std::move(msrdcExePath);
-        }
-    }
-    if (rdpClientExePath.empty()) {
-        rdpClientExePath = c_windowsSystem32;
-        rdpClientExePath /= MSTSC_EXE;
-    }
-
-    std::string wslDvcPlugin;
     if (GetEnvBool("WSLG_USE_WSLDVC_PRIVATE", false))
-        wslDvcPlugin = "/plugin:WSLDVC_PRIVATE";
+        manifest.SetVariable("WSLGD_WSLDVC_PLUGIN", "/plugin:WSLDVC_PRIVATE");
     else if (isWslInstallPathEnvPresent)
-        wslDvcPlugin = "/plugin:WSLDVC_PACKAGE";
+        manifest.SetVariable("WSLGD_WSLDVC_PLUGIN", "/plugin:WSLDVC_PACKAGE");
     else
-        wslDvcPlugin = "/plugin:WSLDVC";
+        manifest.SetVariable("WSLGD_WSLDVC_PLUGIN", "/plugin:WSLDVC");
 
     std::string rdpFilePathArg(wslInstallPath);
     rdpFilePathArg += "\\"; // Windows-style path
-    if (isRdpDesktopShell) 
+    if (isRdpDesktopShell)
         rdpFilePathArg += c_rdpDesktopFile;
-    else 
+    else
         rdpFilePathArg += c_rdpRailFile;
+    manifest.SetVariable("WSLGD_RDP_FILE", std::move(rdpFilePathArg));
 
-    monitor.LaunchProcess(std::vector<std::string>{
-        "/init",
-        std::move(rdpClientExePath),
-        basename(rdpClientExePath.c_str()),
-        "/wslg", // set wslg option first so following parameters are parsed in context of wslg.
-        "/silent", // then set silent option before anything-else.
-        std::move(remote),
-        std::move(serviceId),
-        std::move(wslDvcPlugin),
-        std::move(sharedMemoryObPath),
-        std::move(rdpFilePathArg)
+    {
+        TRACE_SPAN("service manifest");
+        manifest.Load(c_serviceManifestDir, restartPolicy);
+    }
+
+    // Answer probes of the Windows drives from what was seen on previous boots.
+    wslgd::ProbeCache probes(c_probeCacheFile);
+    probes.Load();
+
+    // Create a font folder monitor
+    wslgd::FontMonitor fontMonitor(loop, monitor);
+
+    // Describe the services to start. Everything without a dependency starts at once, in table order,
+    // and only what truly needs weston waits for its ready notification.
+    wslgd::ServiceGraph services(loop);
+    monitor.SetReadyCallback([&](const std::string& name) { services.SetReady(name); });
+
+    // Launch the services from the manifest, directly rather than through a shell so the monitored
+    // pid is the service itself. The command line and the wrapper, e.g. gdbserver or a profiler from
+    // WSLG_<SERVICE>_WRAPPER, are resolved again on every launch, so a restart sees variables changed
+    // by a reload of .wslgconfig and each profiled run gets its own output file.
+    for (auto &service : manifest.GetServices()) {
+        if (service.restartPolicy) {
+            monitor.SetRestartPolicy(service.name, *service.restartPolicy);
+        }
+
+        monitor.SetEnvironmentKeys(service.name, std::vector<std::string>(service.environmentKeys));
+        bool waitForReady = !service.isOnDemand && (service.readiness.mode != wslgd::ReadyMode::Started);
+        if (waitForReady) {
+            monitor.SetReadiness(service.name, service.readiness);
+        }
+
+        monitor.SetWrapper(service.name, [&]() { return manifest.GetWrapper(service); });
+        monitor.SetCommand(service.name, [&]() { return manifest.GetCommand(service); });
+        services.Add({service.name, service.dependencies, [&]() {
+            auto command = manifest.GetCommand(service);
+            if (service.isOnDemand) {
+                monitor.SetSocketActivation(service.name, CreateUnixListenSocket(service.activationSocket.c_str()));
+                monitor.LaunchOnDemand(std::string(service.name),
+                    std::move(command.argv),
+                    std::vector<cap_value_t>(service.capabilities),
+                    std::move(command.env));
+            } else {
+                monitor.LaunchProcess(std::string(service.name),
+                    std::move(command.argv),
+                    std::vector<cap_value_t>(service.capabilities),
+                    std::move(command.env));
+            }
+        }, waitForReady});
+    }
+
+    // Bind mount the versions.txt file which contains version numbers of the various WSLG pieces.
+    services.Add({"mounts", {}, [&]() {
+        {
+            wil::unique_fd fd(open(c_versionMount, (O_RDWR | O_CREAT), (S_IRUSR | S_IRGRP | S_IROTH)));
+            THROW_LAST_ERROR_IF(!fd);
+        }
+
+        THROW_LAST_ERROR_IF(mount(c_versionFile, c_versionMount, NULL, MS_BIND | MS_RDONLY, NULL) < 0);
+
+        std::filesystem::create_directories(c_shareDocsMount);
+        THROW_LAST_ERROR_IF(mount(c_shareDocsDir, c_shareDocsMount, NULL, MS_BIND | MS_RDONLY, NULL) < 0);
+    }});
+
+    // Copy the Windows bell sample that default_wslg.pa loads, so pulseaudio reads it locally.
+    services.Add({"bell-sample", {}, [&]() {
+        probes.CopyLocal(c_windowsBellSample, c_bellSampleFile);
+    }});
+
+    // Resolve the mstsc/msrdc client while weston is starting.
+    std::string msrdcExePath; /* when msrdc was chosen, possibly from the probe cache */
+    auto setRdpClientPath = [&](const std::filesystem::path& rdpClientExePath) {
+        manifest.SetVariable("WSLGD_RDP_CLIENT_NAME", rdpClientExePath.filename().string());
+        manifest.SetVariable("WSLGD_RDP_CLIENT_PATH", rdpClientExePath.string());
+    };
+
+    services.Add({"rdp-client-path", {}, [&]() {
+        std::filesystem::path rdpClientExePath;
+        bool isUseMstsc = GetEnvBool("WSLG_USE_MSTSC", false);
+        if (!isUseMstsc && !wslInstallPath.empty()) {
+            std::filesystem::path msrdcPath = TranslateWindowsPath(wslInstallPath.c_str());
+            msrdcPath /= MSRDC_EXE;
+            if (probes.IsExecutable(msrdcPath)) {
+                msrdcExePath = msrdcPath.string();
+                rdpClientExePath = std::move(msrdcPath);
+            }
+        }
+        if (rdpClientExePath.empty()) {
+            rdpClientExePath = c_windowsSystem32;
+            rdpClientExePath /= MSTSC_EXE;
+        }
+
+        setRdpClientPath(rdpClientExePath);
+    }});
+
+    // The cached answer for msrdc may be stale, e.g. after WSL was updated or removed. When the client
+    // cannot be run, 127 for ENOENT and 126 for EACCES, probe it again and fall back to mstsc, which
+    // the restart picks up as its command line is expanded again.
+    monitor.SetExitCallback([&](const std::string& name, int status) {
+        if ((name != "rdp-client") || msrdcExePath.empty() || !WIFEXITED(status) ||
+            ((WEXITSTATUS(status) != 127) && (WEXITSTATUS(status) != 126))) {
+            return;
+        }
+
+        probes.Invalidate(msrdcExePath);
+        if (probes.IsExecutable(msrdcExePath)) {
+            return;
+        }
+
+        LOG_ERROR("%s cannot be run anymore, falling back to " MSTSC_EXE, msrdcExePath.c_str());
+        msrdcExePath.clear();
+        setRdpClientPath(std::filesystem::path(c_windowsSystem32) / MSTSC_EXE);
     });
 
-    // Launch the system dbus daemon.
-    monitor.LaunchProcess(std::vector<std::string>{
-        "/usr/bin/dbus-daemon",
-        "--syslog",
-        "--nofork",
-        "--nopidfile",
-        "--system"
-        },
-        std::vector<cap_value_t>{CAP_SETGID, CAP_SETUID}
-    );
-
-    // Construct pulseaudio launch command line.
-    std::string pulseaudioLaunchArgs =
-        "/usr/bin/dbus-launch "
-        "/usr/bin/pulseaudio "
-        "--log-time=true "
-        "--disallow-exit=true "
-        "--exit-idle-time=-1 "
-        "--load=\"module-rdp-sink sink_name=RDPSink\" "
-        "--load=\"module-rdp-source source_name=RDPSource\" "
-        "--load=\"module-native-protocol-unix socket=" SHARE_PATH "/PulseServer auth-anonymous=true\" ";
-
-    // Construct log file option string.
-    std::string pulseaudioLogFileOption("--log-target=");
-    auto pulseAudioLogFilePathEnv = getenv("WSLG_PULSEAUDIO_LOG_PATH");
-    if (pulseAudioLogFilePathEnv) {
-        pulseaudioLogFileOption += pulseAudioLogFilePathEnv;
-    } else {
-        pulseaudioLogFileOption += "newfile:" SHARE_PATH "/pulseaudio.log";
+    // Record the time to the first connection, seen as the listening vsock becoming readable.
+    // N.B. This is best effort, weston usually accepts the connection first once it is up, so WSLGd
+    //      mostly sees it with early launch. StartupBench times the first accepted connection in both
+    //      modes. The vsock is no longer watched after a timeout.
+    uint64_t rdpClientLaunchTime = 0;
+    int rdpFirstConnectTimer = -1;
+    services.Add({"rdp-first-connect", {"rdp-client"}, [&]() {
+        rdpClientLaunchTime = wslgd::Trace::Now();
+        rdpFirstConnectTimer = loop.AddTimer(c_rdpFirstConnectTimeoutMs, [&]() {
+            loop.RemoveFd(socketFd.get());
+            LOG_INFO("rdp client connection not seen by WSLGd (%s launch)", isRdpClientEarlyLaunch ? "early" : "deferred");
+        });
+
+        loop.AddFd(socketFd.get(), EPOLLIN, [&](uint32_t) {
+            loop.RemoveFd(socketFd.get());
+            loop.CancelTimer(rdpFirstConnectTimer);
+            auto connectTime = wslgd::Trace::Now();
+            LOG_INFO("rdp client connected after %llu ms (%s launch)",
+                static_cast<unsigned long long>((connectTime - rdpClientLaunchTime) / 1000),
+                isRdpClientEarlyLaunch ? "early" : "deferred");
+            wslgd::Trace::AddSpan("rdp first connect", "startup", rdpClientLaunchTime, connectTime);
+            wslgd::Trace::Write();
+        });
+    }});
+
+    // Start font monitoring if user distro's X11 fonts to be shared with system distro.
+    // Font folders are scanned right away, but font path changes need the X server from weston.
+    // WSLG_FONT_MONITOR_FANOTIFY watches the font trees with a single fanotify mark instead of an
+    // inotify watch per folder, at the cost of waking WSLGd for any file created on their filesystem.
+    bool isFontMonitorEnabled = GetEnvBool("WSLG_USE_USER_DISTRO_XFONTS", true);
+    if (isFontMonitorEnabled) {
+        services.Add({"font-scan", {}, [&]() { fontMonitor.Scan(GetEnvBool("WSLG_FONT_MONITOR_FANOTIFY", false)); }});
+        services.Add({"font-monitor", {"weston", "font-scan"}, [&]() { fontMonitor.Start(); }});
+    }
+
+    // Expose the state of the supervised services, e.g. for triaging boot and crash loops.
+    wslgd::MetricsServer metrics(loop);
+    metrics.AddSource([&](std::string& out) { monitor.WriteMetrics(out); });
+    metrics.AddSource([&](std::string& out) { services.WriteMetrics(out); });
+    metrics.AddSource([&](std::string& out) { fontMonitor.WriteMetrics(out); });
+    metrics.AddSource([](std::string& out) {
+        wslgd::MetricsServer::Describe(out, "wslgd_log_dropped_total", "counter", "Log messages dropped because the log buffer was full.");
+        wslgd::MetricsServer::Add(out, "wslgd_log_dropped_total", "", wslgd::Logger::GetDropped());
+    });
+
+    try {
+        metrics.Start(c_metricsSocket);
+    }
+    CATCH_LOG();
+
+    // Allow recovering a single stuck service without restarting the whole VM.
+    wslgd::ControlServer control(loop);
+    control.AddCommand("list", "list", [&](const std::vector<std::string>&, std::string& reply) {
+        monitor.ListServices(reply);
+    });
+
+    control.AddCommand("restart", "restart <service>", [&](const std::vector<std::string>& args, std::string&) {
+        THROW_INVALID_IF(args.size() != 2);
+        monitor.RestartService(args[1]);
+    });
+
+    control.AddCommand("reload", "reload", [&](const std::vector<std::string>&, std::string&) {
+        config.Reload();
+    });
+
+    control.AddCommand("dump", "dump", [&](const std::vector<std::string>&, std::string& reply) {
+        monitor.DumpState(reply);
+        fontMonitor.DumpState(reply);
+        reply += "log level " + std::to_string(wslgd::Logger::GetLevel()) + "\n";
+        reply += std::string("tracing ") + (wslgd::Trace::IsEnabled() ? "on" : "off") + "\n";
+    });
+
+    control.AddCommand("trace", "trace on|off|write", [&](const std::vector<std::string>& args, std::string&) {
+        THROW_INVALID_IF(args.size() != 2);
+        if (args[1] == "on") {
+            wslgd::Trace::SetEnabled(true);
+        } else if (args[1] == "off") {
+            wslgd::Trace::Write();
+            wslgd::Trace::SetEnabled(false);
+        } else if (args[1] == "write") {
+            wslgd::Trace::Write();
+        } else {
+            THROW_INVALID();
+        }
+    });
+
+    try {
+        control.Start(c_controlSocket, passwordEntry->pw_uid, passwordEntry->pw_gid);
     }
-    pulseaudioLaunchArgs += pulseaudioLogFileOption;
+    CATCH_LOG();
+
+    // Probes of the Windows drives were answered from the cache, check them again off the critical path.
+    bool isBootComplete = false;
+    services.Start([&]() {
+        isBootComplete = true;
+        wslgd::Trace::Write();
+        probes.Refresh();
+    });
+
+    // Apply .wslgconfig edits without restarting the VM. Children read their environment at launch,
+    // so only services declaring a changed variable are restarted, and options WSLGd itself turned
+    // into command lines at boot, e.g. the weston shell or backend, still need WSLGd restarted.
+    config.Start(c_configPollMs, [&](const std::set<std::string>& keys) {
+        SetupLogLevel();
+
+        if (keys.count("WSLG_USE_USER_DISTRO_XFONTS") || keys.count("WSLG_FONT_MONITOR_FANOTIFY")) {
+            bool isEnabled = GetEnvBool("WSLG_USE_USER_DISTRO_XFONTS", true);
+            // The monitor started by boot picks up a change made before it ran.
+            if (isFontMonitorEnabled && (!isEnabled || isBootComplete)) {
+                fontMonitor.Stop();
+                isFontMonitorEnabled = false;
+            }
 
-    // Launch pulseaudio and the associated dbus daemon.
-    monitor.LaunchProcess(std::vector<std::string>{
-        "/usr/bin/sh",
-        "-c",
-        std::move(pulseaudioLaunchArgs)
+            if (isEnabled && !isFontMonitorEnabled && isBootComplete) {
+                if ((fontMonitor.Scan(GetEnvBool("WSLG_FONT_MONITOR_FANOTIFY", false)) == 0) && (fontMonitor.Start() == 0)) {
+                    isFontMonitorEnabled = true;
+                }
+            }
+        }
+
+        for (auto &name : monitor.GetServicesUsing(keys)) {
+            try {
+                monitor.RestartService(name);
+            }
+            CATCH_LOG();
+        }
     });
 
     return monitor.Run();
@@ -6,12 +6,19 @@
 #include <sys/prctl.h>
 #include <sys/mount.h>
 #include <sys/socket.h>
+#include <sched.h>
 #include <sys/un.h>
 #include <sys/signalfd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
 #include <sys/stat.h>
+#include <sys/syscall.h>
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <sys/inotify.h>
+#include <sys/fanotify.h>
+#include <sys/statfs.h>
 #include <assert.h>
 #include <dirent.h>
 #include <errno.h>
@@ -28,12 +35,19 @@
 #include <algorithm>
 #include <linux/vm_sockets.h>
 #include <array>
+#include <atomic>
+#include <deque>
 #include <filesystem>
+#include <functional>
 #include <map>
+#include <memory>
+#include <mutex>
 #include <new>
+#include <optional>
+#include <random>
+#include <set>
+#include <thread>
+#include <unordered_map>
 #include <vector>
 #include "config.h"
 #include "lxwil.h"
-#if HAVE_WINPR
-#include "winpr/ini.h"
-#endif // HAVE_WINPR
@@ -0,0 +1,78 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+#include "precomp.h"
+#include "common.h"
+#include "ConfigFile.h"
+#include "Test.h"
+
+constexpr auto c_config =
+    "\xEF\xBB\xBF"
+    "ignored=before any section\r\n"
+    "; a comment\r\n"
+    "[system-distro-env]\r\n"
+    "  WSLG_LOG_LEVEL = error  \r\n"
+    "WESTON_RDP_DEBUG_DESKTOP_SCALING_FACTOR=100\r\n"
+    "no value line\r\n"
+    "WSLG_LOG_LEVEL=info\r\n"
+    "# another comment\n"
+    "[Other]\n"
+    "key=a=b\n"
+    "[SYSTEM-DISTRO-ENV]\n"
+    "WSLG_USE_MSTSC=true";
+
+std::string ValueOf(const wslgd::ConfigFile& config, const char *section, const char *key)
+{
+    auto value = config.GetValue(section, key);
+    return value ? value : "(none)";
+}
+
+int main()
+try {
+    // Sections are case insensitive and merged, keys keep their first position and last value.
+    wslgd::ConfigFile config;
+    config.Parse(c_config, strlen(c_config));
+    auto& section = config.GetSection("system-distro-env");
+    VERIFY_ARE_EQUAL(3u, section.size());
+    VERIFY_ARE_EQUAL("WSLG_LOG_LEVEL", section[0].first);
+    VERIFY_ARE_EQUAL("info", section[0].second);
+    VERIFY_ARE_EQUAL("100", ValueOf(config, "System-Distro-Env", "WESTON_RDP_DEBUG_DESKTOP_SCALING_FACTOR"));
+    VERIFY_ARE_EQUAL("true", ValueOf(config, "system-distro-env", "WSLG_USE_MSTSC"));
+    VERIFY_ARE_EQUAL("a=b", ValueOf(config, "other", "key"));
+    VERIFY_ARE_EQUAL("(none)", ValueOf(config, "system-distro-env", "ignored"));
+    VERIFY_ARE_EQUAL("(none)", ValueOf(config, "missing", "key"));
+
+    // A load writes the cache, the next one reads it instead of the source.
+    std::string path = wslgd::test::TempPath(".wslgconfig");
+    std::string cachePath = wslgd::test::TempPath("cache/wslgconfig");
+    wslgd::test::WriteFile(path, "[system-distro-env]\nWSLG_LOG_LEVEL=error\n");
+    VERIFY(config.Load(path, cachePath.c_str()));
+    VERIFY_ARE_EQUAL("error", ValueOf(config, "system-distro-env", "WSLG_LOG_LEVEL"));
+
+    std::string cache = wslgd::test::ReadFile(cachePath);
+    VERIFY(cache.find(path) != std::string::npos);
+    auto marked = cache;
+    marked.replace(marked.find("=error"), strlen("=error"), "=cache");
+    wslgd::test::WriteFile(cachePath, marked);
+    VERIFY(config.Load(path, cachePath.c_str()));
+    VERIFY_ARE_EQUAL("cache", ValueOf(config, "system-distro-env", "WSLG_LOG_LEVEL"));
+
+    // Another file of the same size and time does not match the cache.
+    std::string otherPath = wslgd::test::TempPath("other.wslgconfig");
+    wslgd::test::WriteFile(otherPath, "[system-distro-env]\nWSLG_LOG_LEVEL=other\n");
+    struct stat source;
+    THROW_LAST_ERROR_IF(stat(path.c_str(), &source) < 0);
+    struct timespec times[2] = {source.st_atim, source.st_mtim};
+    THROW_LAST_ERROR_IF(utimensat(AT_FDCWD, otherPath.c_str(), times, 0) < 0);
+    VERIFY(config.Load(otherPath, cachePath.c_str()));
+    VERIFY_ARE_EQUAL("other", ValueOf(config, "system-distro-env", "WSLG_LOG_LEVEL"));
+
+    // Nor does the source once it changed.
+    wslgd::test::WriteFile(path, "[system-distro-env]\nWSLG_LOG_LEVEL=changed\n");
+    VERIFY(config.Load(path, cachePath.c_str()));
+    VERIFY_ARE_EQUAL("changed", ValueOf(config, "system-distro-env", "WSLG_LOG_LEVEL"));
+
+    VERIFY(!config.Load(wslgd::test::TempPath("missing"), cachePath.c_str()));
+    VERIFY_ARE_EQUAL("(none)", ValueOf(config, "system-distro-env", "WSLG_LOG_LEVEL"));
+    return 0;
+}
+CATCH_RETURN_ERRNO();
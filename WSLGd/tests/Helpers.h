@@ -0,0 +1,40 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+#pragma once
+#include "precomp.h"
+
+// Shared by the tests and the benchmarks, which include it as "tests/Helpers.h".
+namespace wslgd::test
+{
+    constexpr int c_skipped = 77; /* meson's exit code for a skipped test or benchmark */
+
+    // Writes data to path, creating its folder.
+    inline void WriteFile(const std::string& path, const std::string& data, mode_t mode = 0644)
+    {
+        std::filesystem::create_directories(std::filesystem::path(path).parent_path());
+        wil::unique_fd fd(open(path.c_str(), (O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC), mode));
+        THROW_LAST_ERROR_IF(!fd);
+        THROW_LAST_ERROR_IF(write(fd.get(), data.data(), data.size()) != static_cast<ssize_t>(data.size()));
+        THROW_LAST_ERROR_IF(fchmod(fd.get(), mode) < 0);
+    }
+
+    // The content of path, empty if it does not exist.
+    inline std::string ReadFile(const std::string& path)
+    {
+        std::string data;
+        wil::unique_fd fd(open(path.c_str(), (O_RDONLY | O_CLOEXEC)));
+        if (!fd) {
+            THROW_LAST_ERROR_IF(errno != ENOENT);
+            return data;
+        }
+
+        std::array<char, 4096> buffer;
+        ssize_t size;
+        while ((size = read(fd.get(), buffer.data(), buffer.size())) > 0) {
+            data.append(buffer.data(), size);
+        }
+
+        THROW_LAST_ERROR_IF(size < 0);
+        return data;
+    }
+}
@@ -0,0 +1,74 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+#include "precomp.h"
+#include "common.h"
+#include "Logger.h"
+#include "Test.h"
+
+// Several threads log at once into the ring, more than it holds. Every message is written once and
+// in order for its thread, or is counted in a dropped messages record.
+constexpr int c_producers = 4;
+constexpr int c_messages = 5000;
+
+int main()
+try {
+    std::string path = wslgd::test::TempPath("stderr.log");
+    wslgd::Logger::Start(std::make_unique<wslgd::LogFile>(path.c_str(), 64 * 1024 * 1024, 1));
+
+    // A child's output line longer than a record is split, each part tagged with its source.
+    std::string output(1200, 'x');
+    wslgd::Logger::WriteOutput("child", 42, output.data(), output.size());
+
+    std::vector<std::thread> producers;
+    for (int producer = 0; producer < c_producers; producer++) {
+        producers.emplace_back([producer]() {
+            for (int i = 0; i < c_messages; i++) {
+                LOG_INFO("producer %d message %d", producer, i);
+            }
+        });
+    }
+
+    for (auto &thread : producers) {
+        thread.join();
+    }
+
+    wslgd::Logger::Stop();
+
+    // Messages logged once stopped are written synchronously.
+    LOG_INFO("after stop");
+
+    std::unique_ptr<FILE, decltype(&fclose)> file(fopen(path.c_str(), "r"), fclose);
+    THROW_LAST_ERROR_IF(!file);
+    std::array<int, c_producers> last;
+    last.fill(-1);
+    uint64_t written = 0;
+    uint64_t dropped = 0;
+    size_t outputLength = 0;
+    bool isAfterStop = false;
+    char line[2048];
+    while (fgets(line, sizeof(line), file.get())) {
+        int producer, message;
+        unsigned long long count;
+        const char *found;
+        if ((found = strstr(line, "producer ")) && (sscanf(found, "producer %d message %d", &producer, &message) == 2)) {
+            VERIFY((producer >= 0) && (producer < c_producers));
+            VERIFY(message > last[producer]);
+            last[producer] = message;
+            written++;
+        } else if ((found = strstr(line, "dropped ")) && (sscanf(found, "dropped %llu messages", &count) == 1)) {
+            dropped += count;
+        } else if ((found = strstr(line, "child[42]: "))) {
+            found += strlen("child[42]: ");
+            outputLength += strspn(found, "x");
+        } else if (strstr(line, "after stop")) {
+            isAfterStop = true;
+        }
+    }
+
+    VERIFY_ARE_EQUAL(static_cast<uint64_t>(c_producers * c_messages), written + dropped);
+    VERIFY_ARE_EQUAL(dropped, wslgd::Logger::GetDropped());
+    VERIFY_ARE_EQUAL(output.size(), outputLength);
+    VERIFY(isAfterStop);
+    return 0;
+}
+CATCH_RETURN_ERRNO();
@@ -0,0 +1,58 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+#include "precomp.h"
+#include "common.h"
+#include "PathTranslator.h"
+#include "Test.h"
+
+// Drives as the user distro sees them: C: over 9p reporting the drive as the source, D: over
+// virtiofs only in the path option, E: mounted at a path with a space, F: below the root of its
+// drive, and C: again under the shared mount.
+constexpr auto c_mountInfo =
+    "22 1 8:32 / / rw,relatime - ext4 /dev/sdc rw\n"
+    "90 22 0:58 / /mnt/c rw,noatime - 9p C:\\134 rw,aname=drvfs;path=C:\\;uid=1000;gid=1000\n"
+    "91 22 0:59 / /mnt/d rw,noatime - virtiofs drvfsaD rw,path=D:\\\n"
+    "92 22 0:60 / /mnt/with\\040space rw,noatime - 9p E: rw,aname=drvfs;path=E:\n"
+    "93 22 0:61 /sub /mnt/f rw,noatime - 9p F:\\134 rw,aname=drvfs;path=F:\\\n"
+    "94 30 0:58 / /mnt/wslg/distro/mnt/c rw,noatime - 9p C:\\134 rw,aname=drvfs;path=C:\\\n";
+
+int main()
+try {
+    // Paths the mount table cannot answer go to the fallback instead of wslpath, so the result
+    // does not depend on whether wslpath is installed.
+    std::vector<std::string> fallbackPaths;
+    std::string mountInfo = wslgd::test::TempPath("mountinfo");
+    wslgd::test::WriteFile(mountInfo, c_mountInfo);
+    wslgd::PathTranslator translator(mountInfo, [&fallbackPaths](const char *path) {
+        fallbackPaths.push_back(path);
+        return std::string("fallback");
+    });
+
+    VERIFY_ARE_EQUAL("/mnt/c/Users/me/file.txt", translator.Translate("C:\\Users\\me\\file.txt"));
+    VERIFY_ARE_EQUAL("/mnt/c/Users/me", translator.Translate("c:/Users//me"));
+    VERIFY_ARE_EQUAL("/mnt/c", translator.Translate("C:"));
+    VERIFY_ARE_EQUAL("/mnt/c/", translator.Translate("C:\\"));
+    VERIFY_ARE_EQUAL("/mnt/d/Program Files/app.exe", translator.Translate("D:\\Program Files\\app.exe"));
+    VERIFY_ARE_EQUAL("/mnt/with space/a", translator.Translate("E:\\a"));
+    VERIFY_ARE_EQUAL(0u, fallbackPaths.size());
+
+    // Anything not under a drive root mount is left to the fallback.
+    std::vector<std::string> untranslated{"F:\\sub\\a", "Z:\\a", "\\\\server\\share\\a", "C:relative"};
+    for (auto &path : untranslated) {
+        VERIFY_ARE_EQUAL("fallback", translator.Translate(path.c_str()));
+    }
+
+    VERIFY_ARE_EQUAL(untranslated, fallbackPaths);
+
+    // The fallback also answers when the mount table cannot be read.
+    fallbackPaths.clear();
+    wslgd::PathTranslator missing(wslgd::test::TempPath("missing"), [&fallbackPaths](const char *path) {
+        fallbackPaths.push_back(path);
+        return std::string("fallback");
+    });
+
+    VERIFY_ARE_EQUAL("fallback", missing.Translate("C:\\a"));
+    VERIFY_ARE_EQUAL(std::vector<std::string>{"C:\\a"}, fallbackPaths);
+    return 0;
+}
+CATCH_RETURN_ERRNO();
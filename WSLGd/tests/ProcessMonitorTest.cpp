@@ -0,0 +1,57 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+#include "precomp.h"
+#include "common.h"
+#include "EventLoop.h"
+#include "ProcessMonitor.h"
+#include "Test.h"
+
+constexpr auto c_program = "/bin/true";
+constexpr uint64_t c_timeoutMs = 10000;
+
+// A restart whose launch fails in WSLGd itself, here with an empty command line as clone failing
+// with EAGAIN would, is retried with backoff instead of dropping the service.
+void TestLaunchFailure()
+{
+    wslgd::EventLoop loop;
+    wslgd::ProcessMonitor monitor(getpwuid(getuid())->pw_name, loop);
+    wslgd::RestartPolicy policy;
+    policy.initialDelayMs = 10;
+    policy.maxDelayMs = 50;
+    monitor.SetRestartPolicy("service", policy);
+
+    int commands = 0;
+    monitor.SetCommand("service", [&commands]() {
+        commands++;
+        return (commands == 1) ? wslgd::LaunchCommand{} : wslgd::LaunchCommand{{c_program}, {}};
+    });
+
+    int exits = 0;
+    std::string listed;
+    monitor.SetExitCallback([&](const std::string& name, int) {
+        VERIFY_ARE_EQUAL("service", name);
+        if (++exits == 1) {
+            return;
+        }
+
+        // The child of the second launch exited, the service is still scheduled to restart.
+        loop.AddTimer(0, [&]() {
+            monitor.ListServices(listed);
+            loop.Stop(0);
+        });
+    });
+
+    loop.AddTimer(c_timeoutMs, [&loop]() { loop.Stop(ETIMEDOUT); });
+    monitor.LaunchProcess("service", {c_program});
+    VERIFY_ARE_EQUAL(0, loop.Run());
+    VERIFY_ARE_EQUAL(2, exits);
+    VERIFY_ARE_EQUAL(2, commands);
+    VERIFY(listed.find("service restart-pending") != std::string::npos);
+}
+
+int main()
+try {
+    TestLaunchFailure();
+    return 0;
+}
+CATCH_RETURN_ERRNO();
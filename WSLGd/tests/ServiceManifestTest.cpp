@@ -0,0 +1,154 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+#include "precomp.h"
+#include "common.h"
+#include "ServiceManifest.h"
+#include "Test.h"
+
+using Words = std::vector<std::string>;
+
+void TestSplit()
+{
+    wslgd::ServiceManifest manifest;
+    manifest.SetVariable("WAYLAND_DISPLAY", "wayland-0");
+    manifest.SetVariable("ARGS", "x y");
+    manifest.SetVariable("EMPTY", "");
+    unsetenv("WSLGD_TEST_UNSET");
+    setenv("WSLGD_TEST_ENV", "from-env", 1);
+    setenv("WAYLAND_DISPLAY", "from-env", 1);
+
+    VERIFY_ARE_EQUAL((Words{"/usr/bin/weston", "--socket=wayland-0", "--log=/mnt/wslg/weston.log"}),
+        manifest.Split("/usr/bin/weston --socket=${WAYLAND_DISPLAY} --log=${WSLGD_TEST_UNSET:-/mnt/wslg/weston.log}"));
+
+    // Quotes group words and are removed, a quoted empty word is kept.
+    VERIFY_ARE_EQUAL((Words{"a", "b c", "d\"e", ""}), manifest.Split("  a \"b c\"  'd\"e' \"\"  "));
+
+    // An unquoted word expanding to nothing is dropped, a value with spaces stays one word.
+    VERIFY_ARE_EQUAL((Words{"run", "x y"}), manifest.Split("run ${WSLGD_TEST_UNSET} ${ARGS} ${EMPTY}"));
+    VERIFY_ARE_EQUAL((Words{"run", ""}), manifest.Split("run \"${WSLGD_TEST_UNSET}\""));
+
+    // Spaces within ${...} do not split the word.
+    VERIFY_ARE_EQUAL((Words{"--title=a b", "c"}), manifest.Split("--title=${WSLGD_TEST_UNSET:-a b} c"));
+    VERIFY_ARE_EQUAL(Words{}, manifest.Split(" \t "));
+}
+
+void TestExpand()
+{
+    wslgd::ServiceManifest manifest;
+    manifest.SetVariable("EMPTY", "");
+    manifest.SetVariable("SET", "set");
+    VERIFY_ARE_EQUAL("from-env", manifest.Expand("${WSLGD_TEST_ENV}"));
+    VERIFY_ARE_EQUAL("a-set-b", manifest.Expand("a-${SET}-b"));
+    VERIFY_ARE_EQUAL("fallback", manifest.Expand("${EMPTY:-fallback}"));
+    VERIFY_ARE_EQUAL("set", manifest.Expand("${WSLGD_TEST_UNSET:-${SET:-no}}"));
+    VERIFY_ARE_EQUAL("inner", manifest.Expand("${WSLGD_TEST_UNSET:-${EMPTY:-inner}}"));
+    VERIFY_ARE_EQUAL("", manifest.Expand("${WSLGD_TEST_UNSET}"));
+
+    // Variables set by WSLGd take precedence over the environment.
+    manifest.SetVariable("WSLGD_TEST_ENV", "from-wslgd");
+    VERIFY_ARE_EQUAL("from-wslgd", manifest.Expand("${WSLGD_TEST_ENV}"));
+
+    // An unterminated reference is left as is.
+    VERIFY_ARE_EQUAL("a ${SET", manifest.Expand("a ${SET"));
+}
+
+void TestLoad()
+{
+    std::string directory = wslgd::test::TempPath("services.d");
+    std::filesystem::create_directories(directory);
+    wslgd::test::WriteFile(directory + "/10-weston.conf",
+        "[service]\n"
+        "name=weston\n"
+        "exec=/usr/bin/weston --socket=${WAYLAND_DISPLAY}\n"
+        "environment=WESTON_DISABLE_ABSTRACT_FD=1 \"TITLE=a b\"\n"
+        "capabilities=CAP_SYS_ADMIN CAP_SYS_NICE\n"
+        "ready=connect /mnt/wslg/weston-notify.sock 60000\n"
+        "restart-max-delay-ms=5000\n"
+        "[wrapper]\n"
+        "exec=/usr/bin/gdbserver :${WSLGD_TEST_PORT}\n"
+        "if=WSLGD_TEST_PORT\n");
+    wslgd::test::WriteFile(directory + "/20-broken.conf", "[service]\nname=broken\n");
+    wslgd::test::WriteFile(directory + "/30-pulseaudio.conf",
+        "[service]\n"
+        "exec=/usr/bin/pulseaudio\n"
+        "after=weston dbus\n"
+        "listen=/mnt/wslg/PulseServer\n"
+        "on-demand=true\n");
+    wslgd::test::WriteFile(directory + "/05-dbus.conf", "[service]\nname=dbus\nexec=/usr/bin/dbus-daemon\n");
+    wslgd::test::WriteFile(directory + "/40-dbus.conf", "[service]\nname=dbus\nexec=/usr/bin/dbus-daemon --system\n");
+    wslgd::test::WriteFile(directory + "/50-ignored.txt", "[service]\nexec=/bin/false\n");
+
+    // Files are read in name order, a later definition replaces an earlier one in place and a
+    // broken file is skipped.
+    wslgd::RestartPolicy defaultPolicy;
+    wslgd::ServiceManifest manifest;
+    manifest.SetVariable("WAYLAND_DISPLAY", "wayland-0");
+    manifest.Load(directory.c_str(), defaultPolicy);
+    auto& services = manifest.GetServices();
+    VERIFY_ARE_EQUAL(3u, services.size());
+    VERIFY_ARE_EQUAL("dbus", services[0].name);
+    VERIFY_ARE_EQUAL((Words{"/usr/bin/dbus-daemon", "--system"}), manifest.GetArgv(services[0]));
+    VERIFY(!services[0].restartPolicy.has_value());
+
+    auto& weston = services[1];
+    VERIFY_ARE_EQUAL("weston", weston.name);
+    VERIFY_ARE_EQUAL((Words{"/usr/bin/weston", "--socket=wayland-0"}), manifest.GetArgv(weston));
+    VERIFY_ARE_EQUAL((Words{"WESTON_DISABLE_ABSTRACT_FD=1", "TITLE=a b"}), manifest.GetEnvironment(weston));
+    VERIFY_ARE_EQUAL(2u, weston.capabilities.size());
+    VERIFY(weston.readiness.mode == wslgd::ReadyMode::Connect);
+    VERIFY_ARE_EQUAL("/mnt/wslg/weston-notify.sock", weston.readiness.socketPath);
+    VERIFY_ARE_EQUAL(60000u, weston.readiness.timeoutMs);
+    VERIFY(weston.restartPolicy.has_value());
+    VERIFY_ARE_EQUAL(5000u, weston.restartPolicy->maxDelayMs);
+    VERIFY_ARE_EQUAL(defaultPolicy.stableMs, weston.restartPolicy->stableMs);
+
+    // The wrapper only applies when its variable is set.
+    unsetenv("WSLG_WESTON_WRAPPER");
+    unsetenv("WSLGD_TEST_PORT");
+    VERIFY_ARE_EQUAL(Words{}, manifest.GetWrapper(weston));
+
+    auto& pulseaudio = services[2];
+    VERIFY_ARE_EQUAL("30-pulseaudio", pulseaudio.name); /* the file name without a name key */
+    VERIFY_ARE_EQUAL((Words{"weston", "dbus"}), pulseaudio.dependencies);
+    VERIFY(pulseaudio.isOnDemand);
+    VERIFY_ARE_EQUAL("/mnt/wslg/PulseServer", pulseaudio.activationSocket);
+}
+
+void TestCommand()
+{
+    std::string directory = wslgd::test::TempPath("command.d");
+    std::filesystem::create_directories(directory);
+    wslgd::test::WriteFile(directory + "/10-weston.conf",
+        "[service]\n"
+        "name=weston\n"
+        "exec=/usr/bin/weston --log=${WSLGD_TEST_LOG_PATH:-/mnt/wslg/weston.log}\n"
+        "environment=WLOG_APPENDER=${WSLGD_TEST_APPENDER:-file}\n"
+        "environment-keys=WSLGD_TEST_*\n");
+
+    wslgd::ServiceManifest manifest;
+    manifest.Load(directory.c_str(), wslgd::RestartPolicy{});
+    VERIFY_ARE_EQUAL(1u, manifest.GetServices().size());
+    auto& weston = manifest.GetServices()[0];
+    unsetenv("WSLGD_TEST_LOG_PATH");
+    unsetenv("WSLGD_TEST_APPENDER");
+    auto command = manifest.GetCommand(weston);
+    VERIFY_ARE_EQUAL((Words{"/usr/bin/weston", "--log=/mnt/wslg/weston.log"}), command.argv);
+    VERIFY_ARE_EQUAL((Words{"WLOG_APPENDER=file"}), command.env);
+
+    // A restart after a reload of .wslgconfig asks for the command again, and sees the new values.
+    setenv("WSLGD_TEST_LOG_PATH", "/tmp/weston.log", 1);
+    setenv("WSLGD_TEST_APPENDER", "console", 1);
+    command = manifest.GetCommand(weston);
+    VERIFY_ARE_EQUAL((Words{"/usr/bin/weston", "--log=/tmp/weston.log"}), command.argv);
+    VERIFY_ARE_EQUAL((Words{"WLOG_APPENDER=console"}), command.env);
+}
+
+int main()
+try {
+    TestSplit();
+    TestExpand();
+    TestLoad();
+    TestCommand();
+    return 0;
+}
+CATCH_RETURN_ERRNO();
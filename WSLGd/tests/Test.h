@@ -0,0 +1,63 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+#pragma once
+#include "precomp.h"
+#include <sstream>
+#include "Helpers.h"
+
+// A failed check prints what was expected and exits, so a test stops at the first broken check.
+#define VERIFY(condition) wslgd::test::Verify((condition), #condition, __FILE__, __LINE__)
+#define VERIFY_ARE_EQUAL(expected, actual) wslgd::test::VerifyAreEqual((expected), (actual), #actual, __FILE__, __LINE__)
+
+namespace wslgd::test
+{
+    inline void Verify(bool condition, const char *text, const char *file, int line)
+    {
+        if (!condition) {
+            fprintf(stderr, "%s:%d: %s failed\n", file, line, text);
+            exit(1);
+        }
+    }
+
+    template <typename Value>
+    void Print(std::ostream& stream, const Value& value)
+    {
+        stream << value;
+    }
+
+    inline void Print(std::ostream& stream, const std::vector<std::string>& words)
+    {
+        for (auto &word : words) {
+            stream << "[" << word << "]";
+        }
+    }
+
+    template <typename Expected, typename Actual>
+    void VerifyAreEqual(const Expected& expected, const Actual& actual, const char *text, const char *file, int line)
+    {
+        if (!(expected == actual)) {
+            std::ostringstream message;
+            message << text << " is '";
+            Print(message, actual);
+            message << "', expected '";
+            Print(message, expected);
+            message << "'";
+            fprintf(stderr, "%s:%d: %s\n", file, line, message.str().c_str());
+            exit(1);
+        }
+    }
+
+    // A file under a private temporary folder, removed with the folder at exit.
+    inline std::string TempPath(const char *name)
+    {
+        static char folder[] = "/tmp/wslgd-test.XXXXXX";
+        static bool isCreated = false;
+        if (!isCreated) {
+            THROW_LAST_ERROR_IF(!mkdtemp(folder));
+            atexit([]() { std::error_code error; std::filesystem::remove_all(folder, error); });
+            isCreated = true;
+        }
+
+        return std::string(folder) + "/" + name;
+    }
+}
@@ -0,0 +1,40 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+#include "precomp.h"
+#include "common.h"
+#include "LogFile.h"
+
+// Prints a log written by WSLGd's LogFile in order, the oldest segment first. WSLGd itself only
+// ever writes the segments, reading them is left to this tool.
+constexpr auto c_stdErrLogFile = SHARE_PATH "/stderr.log";
+
+int main(int Argc, char *Argv[])
+try {
+    std::string path = (Argc > 1) ? Argv[1] : c_stdErrLogFile;
+    int oldest = 0;
+    while (access(wslgd::LogFile::SegmentPath(path, oldest + 1).c_str(), F_OK) == 0) {
+        oldest++;
+    }
+
+    std::array<char, 64 * 1024> buffer;
+    for (int segment = oldest; segment >= 0; segment--) {
+        wil::unique_fd fd(open(wslgd::LogFile::SegmentPath(path, segment).c_str(), (O_RDONLY | O_CLOEXEC)));
+        if (!fd) {
+            continue;
+        }
+
+        ssize_t size;
+        while ((size = read(fd.get(), buffer.data(), buffer.size())) > 0) {
+            for (ssize_t offset = 0; offset < size;) {
+                auto written = write(STDOUT_FILENO, buffer.data() + offset, size - offset);
+                THROW_LAST_ERROR_IF((written < 0) && (errno != EINTR));
+                offset += std::max<ssize_t>(written, 0);
+            }
+        }
+
+        THROW_LAST_ERROR_IF(size < 0);
+    }
+
+    return 0;
+}
+CATCH_RETURN_ERRNO();